@@ -6,7 +6,17 @@
 #include <thread>
 
 #include <QMessageBox>
+#include <QPainter>
+#include <QTimer>
+#include <QCoreApplication>
 #include <QDebug>
+#include <QtMath>
+
+#ifdef QT_QUICK_LIB
+#include <QMouseEvent>
+#include <QOpenGLExtraFunctions>
+#include <QQmlError>
+#endif
 
 #define INITIAL_ROTATION	QVector3D(0.0f, 180.0f, 0.0f)
 #define INITIAL_TRANSLATION QVector3D(0.0f, 0.0f, 0.0f)
@@ -15,18 +25,177 @@
 #define NEAR_CLIP	0.1f
 #define FAR_CLIP	10000.0f
 
+#define MIRROR_FIELD_OF_VIEW	90.0f
+
+#define RECONNECT_INTERVAL_MS	2000
+
+#define EYE_SAMPLES		4
+
+#define DEFAULT_DISPLAY_FREQUENCY	90.0f
+#define QUALITY_WINDOW_FRAMES		90
+#define QUALITY_DEGRADE_LOAD		0.9f
+#define QUALITY_UPGRADE_LOAD		0.7f
+#define QUALITY_UPGRADE_DELAY		450
+#define QUALITY_CPU_FRAMES			8
+
+#define MIN_RENDER_SCALE			0.5f
+#define DEFAULT_UPSCALE_SHARPNESS	0.5f
+#define EYE_COMPUTE_GROUP_SIZE		8
+
+#define FOVEA_FRACTION		0.5f
+#define FOVEA_BLEND_WIDTH	0.2f
+#define PERIPHERY_SCALE		0.5f
+
+#define DENSITY_MASK_INNER_RADIUS	0.5f
+#define DENSITY_MASK_OUTER_RADIUS	0.8f
+
+#define FRAME_UNIFORMS_BINDING	15
+// the shader storage bindings stay below 8, the minimum of GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS
+#define LIGHTS_BINDING			7
+#define CLUSTER_LIGHTS_BINDING	6
+#define CLUSTER_GRID_X			16
+#define CLUSTER_GRID_Y			9
+#define CLUSTER_GRID_Z			24
+#define CLUSTER_MAX_LIGHTS		63
+#define CLUSTER_BUILD_GROUP_SIZE	64
+
+#define OCCLUSION_OBJECTS_BINDING	4
+#define OCCLUSION_COMMANDS_BINDING	5
+#define OCCLUSION_GROUP_SIZE		64
+
+#define SCENE_OBJECTS_BINDING		2
+#define SCENE_MATERIALS_BINDING		3
+
+#define DEFAULT_STREAM_BUFFER_FRAME_SIZE	(4 * 1024 * 1024)
+#define STREAM_BUFFER_WAIT_TIMEOUT_NS		1000000000
+
+#define GPU_MEMORY_QUERY_INTERVAL	90
+#define GPU_MEMORY_MIN_AVAILABLE	(64 * 1024 * 1024)
+#ifndef GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX	0x9049
+#endif
+#ifndef GL_TEXTURE_FREE_MEMORY_ATI
+#define GL_TEXTURE_FREE_MEMORY_ATI	0x87FC
+#endif
+
+#ifdef _DEBUG
+#define DEFAULT_DEBUG_SEVERITIES	QOpenGLDebugMessage::AnySeverity
+#else
+#define DEFAULT_DEBUG_SEVERITIES	QOpenGLDebugMessage::HighSeverity
+#endif
+
+#define DEBUG_QUEUE_POLL_INTERVAL	std::chrono::milliseconds(20)
+#define DEBUG_REPEATS_REPORT_PERIOD	std::chrono::seconds(5)
+
 COpenVROpenGLWidget::COpenVROpenGLWidget(QWidget *parent) : 
 	QOpenGLWidget(parent),
 	m_vrSystem(nullptr),
+	m_glState(nullptr),
+	m_bGLStateCacheExclusive(false),
+	m_logger(nullptr),
+	m_debugQueue(nullptr),
+	m_debugLogging(DebugLoggingAsynchronous),
+	m_debugSeverities(DEFAULT_DEBUG_SEVERITIES),
 	m_cameraTranslation(INITIAL_TRANSLATION),
-	m_cameraRotations(INITIAL_ROTATION)
+	m_cameraRotations(INITIAL_ROTATION),
+	m_pendingVrSystem(nullptr),
+	m_startupStage(StartupNotStarted),
+	m_bAutoReconnect(true),
+	m_bReconnecting(false),
+	m_pResourceHost(nullptr),
+	m_bContextLost(false),
+	m_bVRSetupPending(false),
+	m_fRenderScale(1.0f),
+	m_fUpscaleSharpness(DEFAULT_UPSCALE_SHARPNESS),
+	m_pUpscalePass(nullptr),
+	m_bFixedFoveation(false),
+	m_pFoveationPass(nullptr),
+	m_iViewportIndex(0),
+	m_bRadialDensityMask(false),
+	m_pDensityMask(nullptr),
+	m_pDensityReconstructPass(nullptr),
+	m_fFarFieldSplitDepth(0.0f),
+	m_bHalfRate(false),
+	m_uiCadenceFrameIndex(0),
+	m_dCadenceFrameTime(0.0),
+	m_frameCpuIndices(QUALITY_CPU_FRAMES, 0),
+	m_frameCpuTimes(QUALITY_CPU_FRAMES, 0.0f),
+	m_fDisplayFrequency(DEFAULT_DISPLAY_FREQUENCY),
+	m_iQualityLevel(0),
+	m_bQualityGovernor(false),
+	m_frameLoads(QUALITY_WINDOW_FRAMES),
+	m_iFrameLoadCount(0),
+	m_frameDrops(QUALITY_WINDOW_FRAMES),
+	m_iFramesSinceDegrade(0),
+	m_iEyeSamples(EYE_SAMPLES),
+	m_iMirrorInterval(1),
+	m_uiMirrorFrame(0),
+	m_iInputSamplingRate(0),
+	m_pInputSampler(nullptr),
+	m_bVRQuit(false),
+	m_bCompositorLost(false),
+	m_bHeadsetStandby(false),
+	m_bEyeTransformsOutdated(true),
+	m_pRenderTargetPool(nullptr),
+	m_pFarField(nullptr),
+	m_pFarFieldCompositor(nullptr),
+	m_glFrameUniforms(0),
+	m_pClusteredLighting(nullptr),
+	m_pOcclusionCulling(nullptr),
+	m_pSceneRenderer(nullptr),
+	m_pStreamBuffer(nullptr),
+	m_streamBufferFrameSize(DEFAULT_STREAM_BUFFER_FRAME_SIZE),
+	m_iGpuMemoryBudget(0),
+	m_iGpuMemoryAvailable(-1),
+	m_iGpuMemoryQueryCountdown(0),
+	m_bGpuMemoryOverBudget(false),
+	m_bFramePassesDirty(true),
+	m_iTransientMemoryNeeded(0),
+	m_bEyesOutdated(false)
 {
 	m_eyeInfos[Left] = m_eyeInfos[Right] = nullptr;
+	ResetCadenceStats();
+
+	// from the full quality down to a quarter of the pixels without multisampling
+	m_qualityLadder = {
+		{ EYE_SAMPLES, 1.0f, 1, 0.0f, ~0u },
+		{ 2, 1.0f, 1, 0.0f, ~0u },
+		{ 2, 0.85f, 2, 0.5f, ~0u },
+		{ 0, 0.7f, 4, 1.0f, ~0u },
+		{ 0, 0.5f, 4, 2.0f, 0u }
+	};
+
+	for (int i = 0; i < 4; i++)
+		m_headTangents[i] = m_eyesTangents[i] = (i % 2) ? 1.0f : -1.0f;
+
+	for (vr::TrackedDeviceIndex_t device = 0; device < vr::k_unMaxTrackedDeviceCount; device++)
+	{
+		m_deviceClasses[device] = vr::TrackedDeviceClass_Invalid;
+		m_deviceHands[device] = -1;
+	}
+
+	for (int stage = 0; stage < StartupStageCount; stage++)
+		m_startupTimeline[stage] = -1;
 }
 
 COpenVROpenGLWidget::~COpenVROpenGLWidget()
 {
+	// the runtime initialization can't be interrupted: wait for it
+	if (m_vrInitThread.joinable())
+		m_vrInitThread.join();
+
+	// initialized but never handed to the GUI thread
+	if (m_pendingVrSystem && !m_vrSystem)
+		m_vrSystem = m_pendingVrSystem;
+
+	// the context is destroyed by QOpenGLWidget, after this object
+	if (context())
+		disconnect(context(), SIGNAL(aboutToBeDestroyed()), this, SLOT(onContextAboutToBeDestroyed()));
+
 	ShutDownVR();
+
+	if (m_pResourceHost)
+		CGLResourceHost::Release();
 }
 
 void COpenVROpenGLWidget::Destroy()
@@ -34,304 +203,1455 @@ void COpenVROpenGLWidget::Destroy()
 	for (int eye = 0; eye < 2; eye++)
 	{
 		delete m_eyeInfos[eye];
+		m_eyeInfos[eye] = nullptr;
+	}
+
+	delete m_pUpscalePass;
+	m_pUpscalePass = nullptr;
+
+	delete m_pFoveationPass;
+	m_pFoveationPass = nullptr;
+
+	delete m_pDensityMask;
+	m_pDensityMask = nullptr;
+
+	delete m_pDensityReconstructPass;
+	m_pDensityReconstructPass = nullptr;
+
+	delete m_pFarField;
+	m_pFarField = nullptr;
+
+	delete m_pFarFieldCompositor;
+	m_pFarFieldCompositor = nullptr;
+
+	// after the eyes, which give their buffers back
+	delete m_pRenderTargetPool;
+	m_pRenderTargetPool = nullptr;
+
+	for (SFramePass& pass : m_framePasses)
+	{
+		delete pass.m_pTimer;
+		if (pass.m_glFrameBuffer)
+			glDeleteFramebuffers(1, &pass.m_glFrameBuffer);
+	}
+	m_framePasses.clear();
+
+	destroyTransientTextures();
+	m_transientTargets.clear();
+
+	for (CFrameTarget* target : m_frameTargets)
+		delete target;
+	m_frameTargets.clear();
+
+	delete m_pClusteredLighting;
+	m_pClusteredLighting = nullptr;
+
+	delete m_pOcclusionCulling;
+	m_pOcclusionCulling = nullptr;
+
+	delete m_pSceneRenderer;
+	m_pSceneRenderer = nullptr;
+
+	delete m_pStreamBuffer;
+	m_pStreamBuffer = nullptr;
+
+	if (m_glFrameUniforms)
+	{
+		CGpuMemoryTracker::Untrack(GL_BUFFER, m_glFrameUniforms);
+		glDeleteBuffers(1, &m_glFrameUniforms);
 	}
+	m_glFrameUniforms = 0;
 
 	for (int hand = 0; hand < 2; hand++)
 	{
 		delete m_controllers[hand].m_pRenderModel;
+		m_controllers[hand].m_pRenderModel = nullptr;
+
+		if (m_controllers[hand].m_pPendingModel)
+			vr::VRRenderModels()->FreeRenderModel(m_controllers[hand].m_pPendingModel);
+		m_controllers[hand].m_pPendingModel = nullptr;
 	}
 
-#ifdef _DEBUG
-	delete m_logger;
+	for (COverlayPanel* panel : m_overlayPanels)
+		delete panel;
+	m_overlayPanels.clear();
+
+#ifdef QT_QUICK_LIB
+	for (CQuickPanel* panel : m_quickPanels)
+		delete panel;
+	m_quickPanels.clear();
 #endif
+
+	delete m_glState;
+	m_glState = nullptr;
+
+	delete m_logger;
+	m_logger = nullptr;
+
+	delete m_debugQueue;
+	m_debugQueue = nullptr;
 }
 
 void COpenVROpenGLWidget::ShutDownVR()
 {
-	makeCurrent();
+	bool current = makeResourcesCurrent();
 
 	Destroy();
 
 	if (m_vrSystem)
 	{
+		stopInputSampler();
+		m_pendingVREvents.clear();
 		vr::VR_Shutdown();
 		m_vrSystem = nullptr;
 	}
 
-	doneCurrent();
+	if (current)
+		doneResourcesCurrent();
 }
 
-#ifdef _DEBUG
-void COpenVROpenGLWidget::debugMessage(QOpenGLDebugMessage message)
+bool COpenVROpenGLWidget::makeResourcesCurrent()
+{
+	if (context())
+	{
+		makeCurrent();
+		return true;
+	}
+
+	// the widget's context was destroyed: the shared resources are still reachable from the host
+	return m_pResourceHost && m_pResourceHost->MakeCurrent();
+}
+
+void COpenVROpenGLWidget::doneResourcesCurrent()
 {
-	qDebug() << message;
+	if (context())
+		doneCurrent();
+	else if (m_pResourceHost)
+		m_pResourceHost->DoneCurrent();
 }
-#endif
 
-void COpenVROpenGLWidget::initializeGL()
+void COpenVROpenGLWidget::onContextAboutToBeDestroyed()
 {
-	initializeOpenGLFunctions();
+	makeCurrent();
 
-#ifdef _DEBUG
-	m_logger = new QOpenGLDebugLogger(this);
+	ReleaseContextResources();
 
-	connect(m_logger, SIGNAL(messageLogged(QOpenGLDebugMessage)), this, SLOT(debugMessage(QOpenGLDebugMessage)), Qt::DirectConnection);
+	// the objects bound to the context
+	for (CContextObjects* objects : contextObjects())
+		objects->ReleaseContext();
 
-	if (m_logger->initialize())
+	for (SFramePass& pass : m_framePasses)
 	{
-		m_logger->startLogging(QOpenGLDebugLogger::SynchronousLogging);
-		m_logger->enableMessages();
+		if (pass.m_glFrameBuffer)
+			glDeleteFramebuffers(1, &pass.m_glFrameBuffer);
+		pass.m_glFrameBuffer = 0;
 	}
-#endif
-
-	glEnable(GL_DEPTH_TEST);
+	m_bFramePassesDirty = true;
 
-	if (!InitializeVR())
-		return;
-	
-	// create eyes
-	if (!InitializeEyesRendering()) // Pop up error message
-		return;
+	for (CFrameTarget* target : m_frameTargets)
+		target->ReleaseContext();
 
-	// create controllers
-	InitializeControllers(); // Pop up error message
+	for (COverlayPanel* panel : m_overlayPanels)
+		panel->ReleaseContext(m_pResourceHost != nullptr);
 
-	// init scene
-	InitializeRendering();
-}
+#ifdef QT_QUICK_LIB
+	for (CQuickPanel* panel : m_quickPanels)
+		panel->ReleaseContext(m_pResourceHost != nullptr);
+#endif
 
-bool COpenVROpenGLWidget::InitializeVR()
-{
-	// Check whether there’s an HMD connected and a runtime installed 
-	QString errMessage;
-	if (!vr::VR_IsRuntimeInstalled())
-	{
-		errMessage = QString("No VR runtime installed.");
-		qDebug() << errMessage;
-		QMessageBox::critical(this, windowTitle(), errMessage);
-		return false;
-	}
-	
-	if (!vr::VR_IsHmdPresent())
-	{
-		errMessage = QString("Any headset found.");
-		qDebug() << errMessage;
-		QMessageBox::critical(this, windowTitle(), errMessage);
-		return false;
-	}
+	delete m_glState;
+	m_glState = nullptr;
 
-	// Initialize device
-	vr::EVRInitError initErr = vr::VRInitError_Unknown;
-	m_vrSystem = vr::VR_Init(&initErr, vr::VRApplication_Scene);
-	if (initErr != vr::VRInitError_None)
-	{
-		m_vrSystem = nullptr;
-		errMessage = QString("Unable to init VR runtime: %1").arg(vr::VR_GetVRInitErrorAsEnglishDescription(initErr));
-		qDebug() << errMessage;
-		QMessageBox::critical(this, windowTitle(), errMessage);
-		return false;
-	}
+	delete m_logger;
+	m_logger = nullptr;
 
-	// Initialize compositor
-	if (!vr::VRCompositor())
+	// without a resource host, the shared resources are destroyed with the context
+	if (!m_pResourceHost)
 	{
-		errMessage = "Compositor initialization failed. See log file for details";
-		qCritical() << errMessage;
-		QMessageBox::critical(this, windowTitle(), errMessage);
-		vr::VR_Shutdown();
-		m_vrSystem = nullptr;
-		return false;
-	}
+		for (int eye = 0; eye < 2; eye++)
+		{
+			delete m_eyeInfos[eye];
+			m_eyeInfos[eye] = nullptr;
+		}
 
-	return true;
-}
+		delete m_pUpscalePass;
+		m_pUpscalePass = nullptr;
 
+		delete m_pFoveationPass;
+		m_pFoveationPass = nullptr;
 
-bool COpenVROpenGLWidget::InitializeEyesRendering()
-{
-	// get eye size
-	uint32_t eyeWidth, eyeHeight;
-	m_vrSystem->GetRecommendedRenderTargetSize(&eyeWidth, &eyeHeight);
-	QSize eyeSize(static_cast<int>(eyeWidth), static_cast<int>(eyeHeight));
+		delete m_pDensityMask;
+		m_pDensityMask = nullptr;
 
-	// create eyes
-	bool noErr = true;
-	for (int eye = 0; eye < 2; eye++)
-	{
-		m_eyeInfos[eye] = new CEyeInfos(eyeSize);
-		noErr &= m_eyeInfos[eye]->IsValid();
-	}
+		delete m_pDensityReconstructPass;
+		m_pDensityReconstructPass = nullptr;
 
-	return noErr;
-}
+		delete m_pFarField;
+		m_pFarField = nullptr;
 
-bool COpenVROpenGLWidget::InitializeControllers()
-{
-	// Get devices positions and information
-	vr::VRCompositor()->WaitGetPoses(m_trackedDevicePose, vr::k_unMaxTrackedDeviceCount, NULL, 0);
+		delete m_pFarFieldCompositor;
+		m_pFarFieldCompositor = nullptr;
 
-	QString controllerName;
-	for (unsigned int i = 0; i < vr::k_unMaxTrackedDeviceCount; i++)
-	{
-		if (m_vrSystem->GetTrackedDeviceClass(i) != vr::TrackedDeviceClass_Controller)
-			continue;
+		delete m_pRenderTargetPool;
+		m_pRenderTargetPool = nullptr;
 
-		controllerName = getTrackedDeviceString(i, vr::Prop_RenderModelName_String);
-		
-		int handIndex = (vr::ETrackedControllerRole::TrackedControllerRole_LeftHand == m_vrSystem->GetControllerRoleForTrackedDeviceIndex(i)) ? Left : Right;
-		m_controllers[handIndex].m_pRenderModel = COpenVROpenGLWidget::CRenderModel::LoadModel(controllerName);
-		m_controllers[handIndex].m_bShowController = true;
-	}
+		// the application creates them again in InitializeRendering()
+		for (CFrameTarget* target : m_frameTargets)
+			delete target;
+		m_frameTargets.clear();
 
-	InitializeInputs();
+		// the transient targets get new textures at the next frame
+		destroyTransientTextures();
 
-	return true;
-}
+		if (m_pClusteredLighting)
+		{
+			RemoveFramePass("clustered lighting");
+			delete m_pClusteredLighting;
+			m_pClusteredLighting = nullptr;
+		}
 
-void COpenVROpenGLWidget::paintGL()
-{
-	if (m_vrSystem)
-	{
-		// Update eyes and devices matrix transform
-		UpdatePositions();
+		if (m_pOcclusionCulling)
+		{
+			RemoveFramePass("occlusion culling");
+			delete m_pOcclusionCulling;
+			m_pOcclusionCulling = nullptr;
+		}
 
-		// Updates acording to controllers actions
-		UpdateInputs();
+		if (m_pSceneRenderer)
+		{
+			RemoveFramePass("scene renderer");
+			delete m_pSceneRenderer;
+			m_pSceneRenderer = nullptr;
+		}
 
-		glClearColor(0.15f, 0.15f, 0.18f, 1.0f);
+		delete m_pStreamBuffer;
+		m_pStreamBuffer = nullptr;
 
-		UpdateRendering();
+		CGpuMemoryTracker::Untrack(GL_BUFFER, m_glFrameUniforms);
+		glDeleteBuffers(1, &m_glFrameUniforms);
+		m_glFrameUniforms = 0;
 
-		// Render for eyes
-		for (int eye = 0; eye < 2; eye++)
+		for (int hand = 0; hand < 2; hand++)
 		{
-			m_eyeInfos[eye]->SetSurface();
-			renderEye(static_cast<Eye>(eye));
-			m_eyeInfos[eye]->UnsetSurface();
+			SControllerInfos& controller = m_controllers[hand];
+			if (controller.m_pRenderModel && controller.m_sPendingModelName.isEmpty())
+				controller.m_sPendingModelName = controller.m_pRenderModel->GetName();
+
+			delete controller.m_pRenderModel;
+			controller.m_pRenderModel = nullptr;
+			controller.m_bShowController = false;
 		}
 	}
 
-	// Render mirror view in window
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glViewport(0, 0, width(), height());
-	glDisable(GL_MULTISAMPLE);
-	renderEye(Right);
+	m_bContextLost = true;
 
-	if (m_vrSystem)
-	{
-		for (int eye = 0; eye < 2; eye++)
-		{
-			vr::Texture_t composite = { (void*)m_eyeInfos[eye]->Texture(), vr::TextureType_OpenGL, vr::ColorSpace_Gamma };
-			vr::VRCompositor()->Submit(static_cast<vr::EVREye>(eye), &composite);
-		}
-	}
+	doneCurrent();
+}
 
-	update();
+QVector<COpenVROpenGLWidget::CContextObjects*> COpenVROpenGLWidget::contextObjects() const
+{
+	// the pool first: the other helpers may take their targets from it
+	QVector<CContextObjects*> objects;
+	objects << m_pRenderTargetPool << m_eyeInfos[Left] << m_eyeInfos[Right] << m_pUpscalePass << m_pFoveationPass
+		<< m_pDensityMask << m_pDensityReconstructPass << m_pFarField << m_pFarFieldCompositor << m_pClusteredLighting
+		<< m_pOcclusionCulling << m_pSceneRenderer << m_pStreamBuffer;
+	for (int hand = 0; hand < 2; hand++)
+		objects << m_controllers[hand].m_pRenderModel;
+	for (CFrameTarget* target : m_frameTargets)
+		objects << target;
+	for (const SFramePass& pass : m_framePasses)
+		objects << pass.m_pTimer;
+
+	objects.removeAll(nullptr);
+	return objects;
 }
 
-void COpenVROpenGLWidget::renderEye(Eye i_eye)
+void COpenVROpenGLWidget::restoreContext()
 {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_DEPTH_TEST);
+	m_bContextLost = false;
 
-	const QMatrix4x4& projection = m_eyeInfos[i_eye]->GetProjectionMatrix();
-	const QMatrix4x4 view = m_eyeInfos[i_eye]->GetViewMatrix() * m_hmdPose;
-	
-	// Render controller
-	QMatrix4x4 matVP = projection * view;
-	for (int hand = 0; hand < 2; hand++)
+	// only the container objects have to be recreated; without a resource host, only the timers of the passes
+	// are left, the other helpers are created again below
+	for (CContextObjects* objects : contextObjects())
+		objects->RestoreContext();
+
+	if (m_pResourceHost)
+		RestoreContextResources();
+	else
 	{
-		if (!m_controllers[hand].m_bShowController)
-			continue;
-		m_controllers[hand].m_pRenderModel->Draw(matVP * m_controllers[hand].m_rmat4Pose);
+		// everything was lost with the previous context, except the vr runtime
+		qDebug() << "OpenGL contexts are not shared (Qt::AA_ShareOpenGLContexts): the OpenGL resources are recreated";
+
+#ifdef QT_QUICK_LIB
+		for (CQuickPanel* panel : m_quickPanels)
+			panel->RestoreContext(context());
+#endif
+
+		if (m_vrSystem && !InitializeEyesRendering())
+		{
+			qCritical() << "Unable to create the eyes frame buffers.";
+			disconnectVR();
+		}
+
+		InitializeRendering();
 	}
+}
 
-	// Render scene
-	Render( i_eye, view * GetCameraMatrix(), projection);
+void COpenVROpenGLWidget::debugMessage(QOpenGLDebugMessage message)
+{
+	if (m_debugLogging == DebugLoggingAsynchronous && m_debugQueue)
+		m_debugQueue->Push(message);
+	else
+		qDebug() << message;
 }
 
-void COpenVROpenGLWidget::resizeGL(int, int)
+void COpenVROpenGLWidget::SetDebugLogging(DebugLogging i_mode, QOpenGLDebugMessage::Severities i_severities)
 {
-	// do nothing
+	m_debugLogging = i_mode;
+	m_debugSeverities = i_severities;
+
+	// Applied in initializeGL() if there is no context yet
+	if (!isValid())
+		return;
+
+	makeCurrent();
+	applyDebugLogging();
+	doneCurrent();
 }
 
-void COpenVROpenGLWidget::UpdatePositions()
+void COpenVROpenGLWidget::applyDebugLogging()
 {
-	// Get eyes matrices
-	for (int eye = 0; eye < 2; eye++)
+	if (m_logger && m_logger->isLogging())
+		m_logger->stopLogging();
+
+	// the queue and its thread only live in asynchronous mode, it prints its last messages once the logger stopped
+	if (m_debugLogging != DebugLoggingAsynchronous)
 	{
-		m_eyeInfos[eye]->SetTransformMatrix(
-			vrMatrixToQt(m_vrSystem->GetEyeToHeadTransform(static_cast<vr::EVREye>(eye))).inverted(),
-			vrMatrixToQt(m_vrSystem->GetProjectionMatrix(static_cast<vr::EVREye>(eye), NEAR_CLIP, FAR_CLIP))
-		);
+		delete m_debugQueue;
+		m_debugQueue = nullptr;
 	}
 
-	// Get devices matrices
-	vr::VRCompositor()->WaitGetPoses(m_trackedDevicePose, vr::k_unMaxTrackedDeviceCount, NULL, 0);
+	if (m_debugLogging == DebugLoggingOff)
+		return;
 
-	for (unsigned int nDevice = 0; nDevice < vr::k_unMaxTrackedDeviceCount; nDevice++)
+	if (!m_logger)
 	{
-		if (m_trackedDevicePose[nDevice].bPoseIsValid)
+		m_logger = new QOpenGLDebugLogger(this);
+		connect(m_logger, SIGNAL(messageLogged(QOpenGLDebugMessage)), this, SLOT(debugMessage(QOpenGLDebugMessage)), Qt::DirectConnection);
+
+		if (!m_logger->initialize())
 		{
-			m_matrixDevicePose[nDevice] = vrMatrixToQt(m_trackedDevicePose[nDevice].mDeviceToAbsoluteTracking);
-			
-			switch (m_vrSystem->GetTrackedDeviceClass(nDevice))
-			{
+			qDebug() << "OpenGL debug logging is not supported by this context.";
+			delete m_logger;
+			m_logger = nullptr;
+			m_debugLogging = DebugLoggingOff;
+			return;
+		}
+	}
 
-			case vr::TrackedDeviceClass_Controller:
-			{
-				int handIndex = (vr::ETrackedControllerRole::TrackedControllerRole_LeftHand == m_vrSystem->GetControllerRoleForTrackedDeviceIndex(nDevice)) ? Left : Right;
-				m_controllers[handIndex].m_rmat4Pose = vrMatrixToQt(m_trackedDevicePose[nDevice].mDeviceToAbsoluteTracking);
-			}
-				break;
+	if (m_debugLogging == DebugLoggingAsynchronous && !m_debugQueue)
+		m_debugQueue = new CDebugMessageQueue();
 
-			case vr::TrackedDeviceClass_HMD:
-				m_hmdPose = m_matrixDevicePose[vr::k_unTrackedDeviceIndex_Hmd].inverted();
-				break;
+	// let the driver filter the severities: the disabled messages are never generated
+	m_logger->disableMessages();
+	m_logger->enableMessages(QOpenGLDebugMessage::AnySource, QOpenGLDebugMessage::AnyType, m_debugSeverities);
 
-			default:
-				break;
-			}
-		}
-	}
+	m_logger->startLogging(m_debugLogging == DebugLoggingSynchronous ? QOpenGLDebugLogger::SynchronousLogging : QOpenGLDebugLogger::AsynchronousLogging);
 }
 
-QMatrix4x4 COpenVROpenGLWidget::vrMatrixToQt(const vr::HmdMatrix34_t &mat)
+void COpenVROpenGLWidget::initializeGL()
 {
-	return QMatrix4x4(
-		mat.m[0][0], mat.m[0][1], mat.m[0][2], mat.m[0][3],
-		mat.m[1][0], mat.m[1][1], mat.m[1][2], mat.m[1][3],
-		mat.m[2][0], mat.m[2][1], mat.m[2][2], mat.m[2][3],
-		0.0, 0.0, 0.0, 1.0f
-	);
-}
+	initializeOpenGLFunctions();
 
-QMatrix4x4 COpenVROpenGLWidget::vrMatrixToQt(const vr::HmdMatrix44_t &mat)
-{
-	return QMatrix4x4(
-		mat.m[0][0], mat.m[0][1], mat.m[0][2], mat.m[0][3],
-		mat.m[1][0], mat.m[1][1], mat.m[1][2], mat.m[1][3],
-		mat.m[2][0], mat.m[2][1], mat.m[2][2], mat.m[2][3],
-		mat.m[3][0], mat.m[3][1], mat.m[3][2], mat.m[3][3]
-	);
-}
+	// called again each time the widget is reparented or moved to another top-level window
+	connect(context(), SIGNAL(aboutToBeDestroyed()), this, SLOT(onContextAboutToBeDestroyed()), Qt::DirectConnection);
 
-QString COpenVROpenGLWidget::getTrackedDeviceString(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, vr::TrackedPropertyError *o_error)
-{
-	uint32_t len = m_vrSystem->GetStringTrackedDeviceProperty(i_device, i_prop, NULL, 0, o_error);
-	if (len == 0)
-		return "";
+	applyDebugLogging();
 
-	char *buf = new char[len];
-	m_vrSystem->GetStringTrackedDeviceProperty(i_device, i_prop, buf, len, o_error);
+	m_glState = new CGLStateCache();
+	m_glState->Enable(GL_DEPTH_TEST);
 
-	QString result = QString::fromLocal8Bit(buf);
-	delete[] buf;
+	// kept with the shared resources
+	if (!m_glFrameUniforms)
+	{
+		glCreateBuffers(1, &m_glFrameUniforms);
+		glNamedBufferStorage(m_glFrameUniforms, sizeof(SFrameUniforms), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		CGpuMemoryTracker::Track(GpuMemoryScene, GL_BUFFER, m_glFrameUniforms, sizeof(SFrameUniforms));
+	}
 
-	return result;
+	if (!m_pRenderTargetPool)
+		m_pRenderTargetPool = new CRenderTargetPool();
+
+	if (m_bContextLost)
+	{
+		restoreContext();
+
+		// the vr runtime was initialized while there was no context
+		if (m_bVRSetupPending)
+			setupVRRendering();
+		return;
+	}
+
+	m_pResourceHost = CGLResourceHost::Acquire();
+	if (!m_pResourceHost)
+		qDebug() << "Set Qt::AA_ShareOpenGLContexts to keep the OpenGL resources when the widget is reparented.";
+
+	m_startupTimer.start();
+
+	// the runtime initialization takes seconds: it runs while the scene is initialized
+	InitializeVR();
+
+	// init scene
+	InitializeRendering();
+	setStartupStage(StartupSceneReady);
 }
 
-void COpenVROpenGLWidget::TranslateEyes(float i_deltaX, float i_deltaY, float i_deltaZ)
+void COpenVROpenGLWidget::InitializeVR()
+{
+	if (m_vrInitThread.joinable())
+		return;
+
+	m_vrInitThread = std::thread([this]()
+	{
+		m_vrInitError = initializeVRRuntime(&m_pendingVrSystem);
+		QMetaObject::invokeMethod(this, "onRuntimeInitialized", Qt::QueuedConnection);
+	});
+}
+
+QString COpenVROpenGLWidget::initializeVRRuntime(vr::IVRSystem** o_vrSystem)
+{
+	*o_vrSystem = nullptr;
+
+	// Check whether there’s an HMD connected and a runtime installed 
+	if (!vr::VR_IsRuntimeInstalled())
+		return QString("No VR runtime installed.");
+	
+	if (!vr::VR_IsHmdPresent())
+		return QString("Any headset found.");
+
+	// Initialize device
+	vr::EVRInitError initErr = vr::VRInitError_Unknown;
+	vr::IVRSystem* vrSystem = vr::VR_Init(&initErr, vr::VRApplication_Scene);
+	if (initErr != vr::VRInitError_None)
+		return QString("Unable to init VR runtime: %1").arg(vr::VR_GetVRInitErrorAsEnglishDescription(initErr));
+
+	// Initialize compositor
+	if (!vr::VRCompositor())
+	{
+		vr::VR_Shutdown();
+		return QString("Compositor initialization failed. See log file for details");
+	}
+
+	*o_vrSystem = vrSystem;
+	return QString();
+}
+
+void COpenVROpenGLWidget::onRuntimeInitialized()
+{
+	m_vrInitThread.join();
+
+	if (!m_pendingVrSystem && m_bReconnecting)
+	{
+		qDebug() << "VR reconnection failed:" << m_vrInitError;
+		if (m_bAutoReconnect)
+			QTimer::singleShot(RECONNECT_INTERVAL_MS, this, SLOT(Reconnect()));
+		return;
+	}
+
+	if (!m_pendingVrSystem)
+	{
+		qCritical() << m_vrInitError;
+		setStartupStage(StartupFailed);
+		emit startupFailed(m_vrInitError);
+		QMessageBox::critical(this, windowTitle(), m_vrInitError);
+		return;
+	}
+
+	m_vrSystem = m_pendingVrSystem;
+	m_pendingVrSystem = nullptr;
+	if (m_startupStage != StartupComplete)
+		setStartupStage(StartupRuntimeReady);
+
+	// the widget is being reparented: the eyes will be created in its next context
+	if (!context())
+	{
+		m_bVRSetupPending = true;
+		return;
+	}
+
+	makeCurrent();
+	setupVRRendering();
+	doneCurrent();
+}
+
+void COpenVROpenGLWidget::setupVRRendering()
+{
+	m_bVRSetupPending = false;
+
+	// create eyes, now the target size is known (kept if it didn't change after a reconnection)
+	if (!InitializeEyesRendering())
+	{
+		QString errMessage("Unable to create the eyes frame buffers.");
+		qCritical() << errMessage;
+		for (int eye = 0; eye < 2; eye++)
+		{
+			delete m_eyeInfos[eye];
+			m_eyeInfos[eye] = nullptr;
+		}
+		vr::VR_Shutdown();
+		m_vrSystem = nullptr;
+		m_bReconnecting = false;
+
+		setStartupStage(StartupFailed);
+		emit startupFailed(errMessage);
+		QMessageBox::critical(this, windowTitle(), errMessage);
+		return;
+	}
+	if (m_startupStage != StartupComplete)
+		setStartupStage(StartupEyesReady);
+
+	// the caches are filled again, the events only tell the changes
+	for (vr::TrackedDeviceIndex_t device = 0; device < vr::k_unMaxTrackedDeviceCount; device++)
+		updateDeviceCache(device);
+	m_bHeadsetStandby = false;
+
+	// create controllers, their models are loaded by paintGL()
+	InitializeControllers();
+	pollControllersModels();
+
+	for (COverlayPanel* panel : m_overlayPanels)
+		panel->CreateOverlay();
+
+	// the compositor forgets the mode with the connection
+	vr::VRCompositor()->ForceInterleavedReprojectionOn(m_bHalfRate);
+
+	// the load of the frames is relative to the display interval
+	m_fDisplayFrequency = GetDeviceFloat(vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_DisplayFrequency_Float);
+	if (m_fDisplayFrequency <= 0.0f)
+		m_fDisplayFrequency = DEFAULT_DISPLAY_FREQUENCY;
+
+	if (m_bReconnecting)
+	{
+		m_bReconnecting = false;
+		qDebug() << "VR reconnected";
+		emit vrReconnected();
+	}
+}
+
+const COpenVROpenGLWidget::SVREventHandler COpenVROpenGLWidget::s_vrEventHandlers[] = {
+	{ vr::VREvent_Quit, &COpenVROpenGLWidget::handleVRQuit },
+	{ vr::VREvent_TrackedDeviceActivated, &COpenVROpenGLWidget::handleVRDeviceChanged },
+	{ vr::VREvent_TrackedDeviceDeactivated, &COpenVROpenGLWidget::handleVRDeviceChanged },
+	{ vr::VREvent_TrackedDeviceRoleChanged, &COpenVROpenGLWidget::handleVRDeviceChanged },
+	{ vr::VREvent_IpdChanged, &COpenVROpenGLWidget::handleVRIpdChanged },
+	{ vr::VREvent_EnterStandbyMode, &COpenVROpenGLWidget::handleVRStandby },
+	{ vr::VREvent_LeaveStandbyMode, &COpenVROpenGLWidget::handleVRStandby },
+	{ vr::VREvent_PropertyChanged, &COpenVROpenGLWidget::handleVRPropertyChanged }
+};
+
+bool COpenVROpenGLWidget::processVREvents()
+{
+	// the handlers and ProcessVREvent() read the vr system while the input sampling thread runs
+	std::unique_lock<std::recursive_mutex> lock = LockRuntime();
+	m_bVRQuit = false;
+
+	// the events polled by the input sampling thread before it stopped come first
+	for (const vr::VREvent_t& event : m_pendingVREvents)
+		dispatchVREvent(event);
+	m_pendingVREvents.clear();
+
+	// the events are drained by batches into the fixed buffer, nothing is allocated
+	int count;
+	do
+	{
+		// the input sampling thread polls the events when it runs
+		count = 0;
+		while (count < s_vrEventBufferSize &&
+			(m_pInputSampler ? m_pInputSampler->PopEvent(m_vrEvents[count]) : m_vrSystem->PollNextEvent(&m_vrEvents[count], sizeof(vr::VREvent_t))))
+			count++;
+
+		for (int i = 0; i < count; i++)
+			dispatchVREvent(m_vrEvents[i]);
+	} while (count == s_vrEventBufferSize && !m_bVRQuit);
+
+	return !m_bVRQuit && vr::VRCompositor() != nullptr;
+}
+
+void COpenVROpenGLWidget::dispatchVREvent(const vr::VREvent_t& i_event)
+{
+	for (const SVREventHandler& handler : s_vrEventHandlers)
+	{
+		if (handler.m_uiEventType == i_event.eventType)
+			(this->*handler.m_handler)(i_event);
+	}
+	ProcessVREvent(i_event);
+}
+
+void COpenVROpenGLWidget::handleVRQuit(const vr::VREvent_t& i_event)
+{
+	Q_UNUSED(i_event);
+	m_bVRQuit = true;
+
+	// the runtime waits for the acknowledgement before closing, or until its timeout
+	m_vrSystem->AcknowledgeQuit_Exiting();
+}
+
+void COpenVROpenGLWidget::handleVRDeviceChanged(const vr::VREvent_t& i_event)
+{
+	// a role change may swap both hands
+	if (i_event.eventType == vr::VREvent_TrackedDeviceRoleChanged)
+	{
+		for (vr::TrackedDeviceIndex_t device = 0; device < vr::k_unMaxTrackedDeviceCount; device++)
+		{
+			if (m_deviceClasses[device] == vr::TrackedDeviceClass_Controller)
+			{
+				updateDeviceCache(device);
+				queueControllerModel(device);
+			}
+		}
+		return;
+	}
+
+	if (i_event.trackedDeviceIndex >= vr::k_unMaxTrackedDeviceCount)
+		return;
+
+	updateDeviceCache(i_event.trackedDeviceIndex);
+	if (i_event.eventType == vr::VREvent_TrackedDeviceActivated && m_deviceClasses[i_event.trackedDeviceIndex] == vr::TrackedDeviceClass_Controller)
+		queueControllerModel(i_event.trackedDeviceIndex);
+}
+
+void COpenVROpenGLWidget::handleVRIpdChanged(const vr::VREvent_t& i_event)
+{
+	Q_UNUSED(i_event);
+	m_bEyeTransformsOutdated = true;
+}
+
+void COpenVROpenGLWidget::handleVRStandby(const vr::VREvent_t& i_event)
+{
+	m_bHeadsetStandby = (i_event.eventType == vr::VREvent_EnterStandbyMode);
+}
+
+void COpenVROpenGLWidget::updateDeviceCache(vr::TrackedDeviceIndex_t i_device)
+{
+	m_deviceClasses[i_device] = m_vrSystem->GetTrackedDeviceClass(i_device);
+	m_deviceHands[i_device] = -1;
+	if (m_deviceClasses[i_device] == vr::TrackedDeviceClass_Controller)
+		m_deviceHands[i_device] = (m_vrSystem->GetControllerRoleForTrackedDeviceIndex(i_device) == vr::TrackedControllerRole_LeftHand) ? Left : Right;
+
+	if (m_deviceClasses[i_device] == vr::TrackedDeviceClass_Invalid)
+		m_deviceProperties.Clear(i_device);
+	else
+		m_deviceProperties.Read(m_vrSystem, i_device);
+}
+
+void COpenVROpenGLWidget::disconnectVR()
+{
+	qDebug() << "VR system lost, OpenGL resources are kept for reconnection";
+
+	// the models being loaded belong to the runtime
+	for (int hand = 0; hand < 2; hand++)
+	{
+		if (m_controllers[hand].m_pPendingModel)
+			vr::VRRenderModels()->FreeRenderModel(m_controllers[hand].m_pPendingModel);
+		m_controllers[hand].m_pPendingModel = nullptr;
+		m_controllers[hand].m_sPendingModelName.clear();
+	}
+
+	// the overlays are recreated with the same textures
+	for (COverlayPanel* panel : m_overlayPanels)
+		panel->DestroyOverlay();
+
+	// only the runtime is released: the eyes, the controllers models and the scene stay alive
+	stopInputSampler();
+	m_pendingVREvents.clear();
+	vr::VR_Shutdown();
+	m_vrSystem = nullptr;
+	m_bReconnecting = true;
+
+	emit vrDisconnected();
+
+	if (m_bAutoReconnect)
+		QTimer::singleShot(RECONNECT_INTERVAL_MS, this, SLOT(Reconnect()));
+}
+
+void COpenVROpenGLWidget::Reconnect()
+{
+	if (m_vrSystem || m_vrInitThread.joinable())
+		return;
+
+	// a startup failure is retried as a reconnection: no more message box
+	m_bReconnecting = true;
+	InitializeVR();
+}
+
+void COpenVROpenGLWidget::SetAutoReconnect(bool i_bAutoReconnect)
+{
+	m_bAutoReconnect = i_bAutoReconnect;
+}
+
+bool COpenVROpenGLWidget::IsVRConnected() const
+{
+	return m_vrSystem != nullptr && m_eyeInfos[Left] != nullptr;
+}
+
+void COpenVROpenGLWidget::setStartupStage(StartupStage i_stage)
+{
+	m_startupStage = i_stage;
+	m_startupTimeline[i_stage] = m_startupTimer.elapsed();
+
+	emit startupStageChanged(i_stage);
+}
+
+COpenVROpenGLWidget::StartupStage COpenVROpenGLWidget::GetStartupStage() const
+{
+	return m_startupStage;
+}
+
+qint64 COpenVROpenGLWidget::GetStartupTime(StartupStage i_stage) const
+{
+	return m_startupTimeline[i_stage];
+}
+
+
+bool COpenVROpenGLWidget::InitializeEyesRendering()
+{
+	// get eye size
+	uint32_t eyeWidth, eyeHeight;
+	{
+		std::unique_lock<std::recursive_mutex> lock = LockRuntime();
+		m_vrSystem->GetRecommendedRenderTargetSize(&eyeWidth, &eyeHeight);
+	}
+	QSize eyeSize(static_cast<int>(eyeWidth), static_cast<int>(eyeHeight));
+	QSize renderSize = (m_fRenderScale < 1.0f) ? (QSizeF(eyeSize) * m_fRenderScale).toSize() : eyeSize;
+	m_bEyesOutdated = false;
+
+	// the new eyes, or the far field, need the transforms
+	m_bEyeTransformsOutdated = true;
+
+	// the occlusion culling reads the depth of the eyes, unless it is packed in regions
+	const bool keepDepth = (m_pOcclusionCulling || m_pSceneRenderer) && !m_bFixedFoveation;
+
+	// create eyes
+	bool noErr = true;
+	for (int eye = 0; eye < 2; eye++)
+	{
+		if (!m_eyeInfos[eye] || m_eyeInfos[eye]->GetSize() != eyeSize || m_eyeInfos[eye]->GetRenderSize() != renderSize ||
+			m_eyeInfos[eye]->GetSamples() != m_iEyeSamples || m_eyeInfos[eye]->IsFoveated() != m_bFixedFoveation ||
+			(m_eyeInfos[eye]->DepthTexture() != 0) != keepDepth || (m_eyeInfos[eye]->MaskedTexture() != 0) != m_bRadialDensityMask)
+		{
+			delete m_eyeInfos[eye];
+			m_eyeInfos[eye] = new CEyeInfos(m_pRenderTargetPool, eyeSize, renderSize, m_iEyeSamples, m_bFixedFoveation, keepDepth, m_bRadialDensityMask);
+		}
+		noErr &= m_eyeInfos[eye]->IsValid();
+	}
+
+	// the upscale pass is only needed below the recommended size
+	if (renderSize == eyeSize)
+	{
+		delete m_pUpscalePass;
+		m_pUpscalePass = nullptr;
+	}
+	else if (!m_pUpscalePass)
+	{
+		m_pUpscalePass = CEyeComputePass::CreateUpscale();
+		noErr &= m_pUpscalePass->IsValid();
+	}
+
+	if (!m_bFixedFoveation)
+	{
+		delete m_pFoveationPass;
+		m_pFoveationPass = nullptr;
+	}
+	else
+	{
+		if (!m_pFoveationPass)
+			m_pFoveationPass = CEyeComputePass::CreateFoveationRecombine();
+		noErr &= m_pFoveationPass->IsValid();
+
+		// the regions only change with the eyes
+		const QRect& centre = m_eyeInfos[Left]->GetRegion(0);
+		const QRect& periphery = m_eyeInfos[Left]->GetRegion(1);
+		QOpenGLShaderProgram* program = m_pFoveationPass->Bind(m_glState);
+		program->setUniformValue("centre", QVector4D(centre.x(), centre.y(), centre.width(), centre.height()));
+		program->setUniformValue("periphery", QVector4D(periphery.x(), periphery.y(), periphery.width(), periphery.height()));
+		program->setUniformValue("fovea", FOVEA_FRACTION);
+		program->setUniformValue("blend", FOVEA_BLEND_WIDTH);
+	}
+
+	if (!m_bRadialDensityMask)
+	{
+		delete m_pDensityMask;
+		m_pDensityMask = nullptr;
+		delete m_pDensityReconstructPass;
+		m_pDensityReconstructPass = nullptr;
+	}
+	else if (!m_pDensityMask)
+	{
+		m_pDensityMask = new CRadialDensityMask();
+		m_pDensityReconstructPass = CEyeComputePass::CreateDensityReconstruct();
+		noErr &= m_pDensityMask->IsValid() && m_pDensityReconstructPass->IsValid();
+	}
+
+	// the far field is rendered at the size of the eyes, without foveation nor mask
+	if (m_fFarFieldSplitDepth <= 0.0f)
+	{
+		delete m_pFarField;
+		m_pFarField = nullptr;
+		delete m_pFarFieldCompositor;
+		m_pFarFieldCompositor = nullptr;
+	}
+	else
+	{
+		if (!m_pFarField || m_pFarField->GetSize() != renderSize || m_pFarField->GetSamples() != m_iEyeSamples)
+		{
+			delete m_pFarField;
+			m_pFarField = new CEyeInfos(m_pRenderTargetPool, renderSize, renderSize, m_iEyeSamples, false);
+		}
+		noErr &= m_pFarField->IsValid();
+
+		if (!m_pFarFieldCompositor)
+			m_pFarFieldCompositor = new CFarFieldCompositor();
+		noErr &= m_pFarFieldCompositor->IsValid();
+	}
+
+	return noErr;
+}
+
+void COpenVROpenGLWidget::SetRenderScale(float i_fScale)
+{
+	i_fScale = qBound(MIN_RENDER_SCALE, i_fScale, 1.0f);
+	if (i_fScale == m_fRenderScale)
+		return;
+
+	m_fRenderScale = i_fScale;
+	m_bEyesOutdated = true;
+}
+
+float COpenVROpenGLWidget::GetRenderScale() const
+{
+	return m_fRenderScale;
+}
+
+void COpenVROpenGLWidget::SetUpscaleSharpness(float i_fSharpness)
+{
+	m_fUpscaleSharpness = qBound(0.0f, i_fSharpness, 1.0f);
+}
+
+void COpenVROpenGLWidget::SetFixedFoveation(bool i_bEnabled)
+{
+	if (i_bEnabled == m_bFixedFoveation)
+		return;
+
+	m_bFixedFoveation = i_bEnabled;
+	if (i_bEnabled)
+		m_bRadialDensityMask = false;
+	m_bEyesOutdated = true;
+}
+
+bool COpenVROpenGLWidget::IsFixedFoveationEnabled() const
+{
+	return m_bFixedFoveation;
+}
+
+int COpenVROpenGLWidget::GetCurrentViewportIndex() const
+{
+	return m_iViewportIndex;
+}
+
+void COpenVROpenGLWidget::SetRadialDensityMask(bool i_bEnabled)
+{
+	if (i_bEnabled == m_bRadialDensityMask)
+		return;
+
+	m_bRadialDensityMask = i_bEnabled;
+	if (i_bEnabled)
+		m_bFixedFoveation = false;
+	m_bEyesOutdated = true;
+}
+
+bool COpenVROpenGLWidget::IsRadialDensityMaskEnabled() const
+{
+	return m_bRadialDensityMask;
+}
+
+void COpenVROpenGLWidget::SetFarFieldSplitDepth(float i_fDepth)
+{
+	i_fDepth = qBound(0.0f, i_fDepth, FAR_CLIP);
+	if (i_fDepth == m_fFarFieldSplitDepth)
+		return;
+
+	// only the creation of the far field needs the eyes to be initialized again
+	if ((i_fDepth > 0.0f) != (m_fFarFieldSplitDepth > 0.0f))
+		m_bEyesOutdated = true;
+	m_fFarFieldSplitDepth = i_fDepth;
+	m_bEyeTransformsOutdated = true;
+}
+
+float COpenVROpenGLWidget::GetFarFieldSplitDepth() const
+{
+	return m_fFarFieldSplitDepth;
+}
+
+void COpenVROpenGLWidget::SetHalfRate(bool i_bEnabled)
+{
+	if (i_bEnabled == m_bHalfRate)
+		return;
+
+	m_bHalfRate = i_bEnabled;
+	ResetCadenceStats();
+
+	// the loads measured against the other interval are meaningless
+	m_iFrameLoadCount = 0;
+
+	// otherwise applied once the compositor is ready
+	if (m_vrSystem && m_eyeInfos[Left])
+		vr::VRCompositor()->ForceInterleavedReprojectionOn(m_bHalfRate);
+}
+
+COpenVROpenGLWidget::SCadenceStats COpenVROpenGLWidget::GetCadenceStats() const
+{
+	SCadenceStats stats = m_cadenceStats;
+
+	// the first frame has no interval
+	int intervals = stats.m_iFrames - 1;
+	if (intervals > 0)
+	{
+		double mean = m_dCadenceIntervalSum / intervals;
+		double variance = qMax(0.0, m_dCadenceIntervalSquareSum / intervals - mean * mean);
+		stats.m_fMeanIntervalMs = static_cast<float>(mean * 1000.0);
+		stats.m_fIntervalDeviationMs = static_cast<float>(qSqrt(variance) * 1000.0);
+	}
+	return stats;
+}
+
+void COpenVROpenGLWidget::ResetCadenceStats()
+{
+	m_cadenceStats.m_iFrames = 0;
+	m_cadenceStats.m_iOnCadence = 0;
+	m_cadenceStats.m_iLate = 0;
+	m_cadenceStats.m_iDropped = 0;
+	m_cadenceStats.m_iMispresented = 0;
+	m_cadenceStats.m_fMeanIntervalMs = 0.0f;
+	m_cadenceStats.m_fIntervalDeviationMs = 0.0f;
+	m_uiCadenceFrameIndex = 0;
+	m_dCadenceIntervalSum = 0.0;
+	m_dCadenceIntervalSquareSum = 0.0;
+}
+
+void COpenVROpenGLWidget::SetQualityLadder(const QVector<SQualityLevel>& i_ladder)
+{
+	if (i_ladder.isEmpty())
+	{
+		qDebug() << "The quality ladder needs at least one level.";
+		return;
+	}
+
+	// the levels only override the settings of the application while the governor runs
+	m_qualityLadder = i_ladder;
+	m_iQualityLevel = 0;
+	if (m_bQualityGovernor)
+		applyQualityLevel(0);
+}
+
+void COpenVROpenGLWidget::SetQualityGovernor(bool i_bEnabled)
+{
+	const bool enabling = i_bEnabled && !m_bQualityGovernor;
+	m_bQualityGovernor = i_bEnabled;
+	m_iFrameLoadCount = 0;
+	m_iFramesSinceDegrade = 0;
+	if (enabling)
+		applyQualityLevel(m_iQualityLevel);
+}
+
+void COpenVROpenGLWidget::submitEyes()
+{
+	// the CPU time is kept under the index of its frame, for the compositor timing of the same frame
+	vr::Compositor_FrameTiming current;
+	current.m_nSize = sizeof(vr::Compositor_FrameTiming);
+	if (m_frameCpuTimer.isValid() && vr::VRCompositor()->GetFrameTiming(&current, 0))
+	{
+		const int slot = current.m_nFrameIndex % QUALITY_CPU_FRAMES;
+		m_frameCpuIndices[slot] = current.m_nFrameIndex;
+		m_frameCpuTimes[slot] = m_frameCpuTimer.nsecsElapsed() / 1000000.0f;
+	}
+
+	for (int eye = 0; eye < 2; eye++)
+	{
+		vr::Texture_t composite = { (void*)m_eyeInfos[eye]->Texture(), vr::TextureType_OpenGL, vr::ColorSpace_Gamma };
+
+		// the depth helps the reprojection of the frames in between, if it matches the submitted texture
+		// (the density mask leaves holes in it)
+		if (m_bHalfRate && m_eyeInfos[eye]->DepthTexture() && !m_pDensityMask &&
+			m_eyeInfos[eye]->GetTargetSize() == m_eyeInfos[eye]->GetSize())
+		{
+			vr::VRTextureWithDepth_t compositeWithDepth;
+			static_cast<vr::Texture_t&>(compositeWithDepth) = composite;
+			compositeWithDepth.depth.handle = reinterpret_cast<void*>(static_cast<uintptr_t>(m_eyeInfos[eye]->DepthTexture()));
+			const QMatrix4x4& projection = m_eyeInfos[eye]->GetProjectionMatrix();
+			for (int row = 0; row < 4; row++)
+			{
+				for (int column = 0; column < 4; column++)
+					compositeWithDepth.depth.mProjection.m[row][column] = projection(row, column);
+			}
+			compositeWithDepth.depth.vRange.v[0] = 0.0f;
+			compositeWithDepth.depth.vRange.v[1] = 1.0f;
+			if (vr::VRCompositor()->Submit(static_cast<vr::EVREye>(eye), &compositeWithDepth, nullptr, vr::Submit_TextureWithDepth) == vr::VRCompositorError_RequestFailed)
+				m_bCompositorLost = true;
+		}
+		else if (vr::VRCompositor()->Submit(static_cast<vr::EVREye>(eye), &composite) == vr::VRCompositorError_RequestFailed)
+			m_bCompositorLost = true;
+	}
+}
+
+void COpenVROpenGLWidget::updateFrameTiming()
+{
+	// the previous frame, whose presents are all counted
+	vr::Compositor_FrameTiming timing;
+	timing.m_nSize = sizeof(vr::Compositor_FrameTiming);
+	if (!vr::VRCompositor()->GetFrameTiming(&timing, 1) || timing.m_nFrameIndex == m_uiCadenceFrameIndex)
+		return;
+
+	updateCadenceStats(timing);
+	if (m_bQualityGovernor)
+		updateQualityGovernor(timing);
+}
+
+void COpenVROpenGLWidget::updateCadenceStats(const vr::Compositor_FrameTiming& i_timing)
+{
+	if (m_uiCadenceFrameIndex != 0)
+	{
+		double interval = i_timing.m_flSystemTimeInSeconds - m_dCadenceFrameTime;
+		m_dCadenceIntervalSum += interval;
+		m_dCadenceIntervalSquareSum += interval * interval;
+	}
+	m_uiCadenceFrameIndex = i_timing.m_nFrameIndex;
+	m_dCadenceFrameTime = i_timing.m_flSystemTimeInSeconds;
+
+	const uint32_t expectedPresents = m_bHalfRate ? 2 : 1;
+	m_cadenceStats.m_iFrames++;
+	if (i_timing.m_nNumFramePresents == expectedPresents)
+		m_cadenceStats.m_iOnCadence++;
+	else if (i_timing.m_nNumFramePresents > expectedPresents)
+		m_cadenceStats.m_iLate++;
+	m_cadenceStats.m_iDropped += i_timing.m_nNumDroppedFrames;
+	m_cadenceStats.m_iMispresented += i_timing.m_nNumMisPresented;
+}
+
+void COpenVROpenGLWidget::updateQualityGovernor(const vr::Compositor_FrameTiming& i_timing)
+{
+	// the CPU time of the same frame, none if it was not measured
+	const int cpuSlot = i_timing.m_nFrameIndex % QUALITY_CPU_FRAMES;
+	if (m_frameCpuIndices[cpuSlot] != i_timing.m_nFrameIndex)
+		return;
+	const float cpuMs = m_frameCpuTimes[cpuSlot];
+
+	// the load is the time of the slowest of the CPU and the GPU over the interval the frame has
+	const int expectedPresents = m_bHalfRate ? 2 : 1;
+	const float intervalMs = 1000.0f * expectedPresents / m_fDisplayFrequency;
+	const float gpuMs = i_timing.m_flPreSubmitGpuMs + i_timing.m_flPostSubmitGpuMs;
+	const int slot = m_iFrameLoadCount % QUALITY_WINDOW_FRAMES;
+	m_frameLoads[slot] = qMax(cpuMs, gpuMs) / intervalMs;
+	m_frameDrops[slot] = qMax(0, static_cast<int>(i_timing.m_nNumFramePresents) - expectedPresents);
+
+	// the counts stay aligned on the ring
+	m_iFrameLoadCount++;
+	if (m_iFrameLoadCount >= 2 * QUALITY_WINDOW_FRAMES)
+		m_iFrameLoadCount -= QUALITY_WINDOW_FRAMES;
+	m_iFramesSinceDegrade = qMin(m_iFramesSinceDegrade + 1, QUALITY_UPGRADE_DELAY);
+	if (m_iFrameLoadCount < QUALITY_WINDOW_FRAMES)
+		return;
+
+	// the mean load of each half of the window, from the oldest frame
+	const int half = QUALITY_WINDOW_FRAMES / 2;
+	float olderLoad = 0.0f, recentLoad = 0.0f, maxLoad = 0.0f;
+	int drops = 0;
+	for (int i = 0; i < QUALITY_WINDOW_FRAMES; i++)
+	{
+		const int index = (m_iFrameLoadCount + i) % QUALITY_WINDOW_FRAMES;
+		if (i < half)
+			olderLoad += m_frameLoads[index];
+		else
+			recentLoad += m_frameLoads[index];
+		maxLoad = qMax(maxLoad, m_frameLoads[index]);
+		drops += m_frameDrops[index];
+	}
+	olderLoad /= half;
+	recentLoad /= QUALITY_WINDOW_FRAMES - half;
+
+	// the trend extrapolated over the next half window: down before the frames are dropped, up only after a while
+	// with enough headroom, so the levels don't alternate
+	const float predictedLoad = recentLoad + (recentLoad - olderLoad);
+	if ((drops > 0 || predictedLoad > QUALITY_DEGRADE_LOAD) && m_iQualityLevel + 1 < m_qualityLadder.size())
+	{
+		m_iFramesSinceDegrade = 0;
+		applyQualityLevel(m_iQualityLevel + 1);
+	}
+	else if (drops == 0 && maxLoad < QUALITY_UPGRADE_LOAD && m_iFramesSinceDegrade >= QUALITY_UPGRADE_DELAY && m_iQualityLevel > 0)
+		applyQualityLevel(m_iQualityLevel - 1);
+}
+
+void COpenVROpenGLWidget::applyQualityLevel(int i_iLevel)
+{
+	m_iQualityLevel = i_iLevel;
+	const SQualityLevel& quality = m_qualityLadder[i_iLevel];
+
+	// the eyes are created again at the next frame, from the pooled buffers when they match
+	if (quality.m_iSamples != m_iEyeSamples)
+	{
+		m_iEyeSamples = quality.m_iSamples;
+		m_bEyesOutdated = true;
+	}
+	SetRenderScale(quality.m_fRenderScale);
+
+	// the widget keeps the last mirror image in the frames in between
+	m_iMirrorInterval = qMax(1, quality.m_iMirrorInterval);
+	setUpdateBehavior(m_iMirrorInterval > 1 ? QOpenGLWidget::PartialUpdate : QOpenGLWidget::NoPartialUpdate);
+
+	// the frames of the previous level don't tell anything about this one
+	m_iFrameLoadCount = 0;
+
+	emit qualityLevelChanged(i_iLevel);
+}
+
+bool COpenVROpenGLWidget::InitializeControllers()
+{
+	for (unsigned int i = 0; i < vr::k_unMaxTrackedDeviceCount; i++)
+	{
+		if (m_deviceClasses[i] == vr::TrackedDeviceClass_Controller)
+			queueControllerModel(i);
+	}
+
+	InitializeInputs();
+
+	return true;
+}
+
+void COpenVROpenGLWidget::queueControllerModel(vr::TrackedDeviceIndex_t i_device)
+{
+	// the model is loaded asynchronously by pollControllersModels(), unless it is already loaded
+	int handIndex = m_deviceHands[i_device];
+	const char* modelName = m_deviceProperties.GetString(i_device, vr::Prop_RenderModelName_String);
+	if (!modelName || (m_controllers[handIndex].m_pRenderModel && m_controllers[handIndex].m_pRenderModel->GetName() == QString::fromUtf8(modelName)))
+		return;
+
+	m_controllers[handIndex].m_sPendingModelName = QString::fromUtf8(modelName);
+}
+
+void COpenVROpenGLWidget::pollControllersModels()
+{
+	bool pending = false;
+	for (int hand = 0; hand < 2; hand++)
+	{
+		SControllerInfos& controller = m_controllers[hand];
+		if (controller.m_sPendingModelName.isEmpty())
+			continue;
+
+		CRenderModel* renderModel = nullptr;
+		if (!CRenderModel::LoadModelAsync(controller.m_sPendingModelName, &controller.m_pPendingModel, &renderModel))
+		{
+			pending = true;
+			continue;
+		}
+
+		controller.m_sPendingModelName.clear();
+		delete controller.m_pRenderModel;
+		controller.m_pRenderModel = renderModel;
+		controller.m_bShowController = (renderModel != nullptr);
+	}
+
+	if (!pending && m_startupStage == StartupEyesReady)
+		setStartupStage(StartupComplete);
+}
+
+void COpenVROpenGLWidget::paintGL()
+{
+	// Qt may have changed some states since the last frame
+	m_glState->BeginFrame();
+	m_pRenderTargetPool->BeginFrame();
+	checkGpuMemory();
+
+	// The dynamic data of this frame goes to the next region of the ring
+	if (m_pStreamBuffer)
+		m_pStreamBuffer->BeginFrame();
+
+#ifdef QT_QUICK_LIB
+	// Render the Qt Quick panels whose scene changed, in their own contexts
+	for (CQuickPanel* panel : m_quickPanels)
+		panel->UpdateTexture();
+#endif
+
+	// The compositor or the runtime quit: keep rendering the mirror until it comes back
+	if (m_vrSystem && !processVREvents())
+		disconnectVR();
+
+	// The supersampling of the runtime changes the recommended size
+	if (m_vrSystem && m_eyeInfos[Left])
+	{
+		std::unique_lock<std::recursive_mutex> lock = LockRuntime();
+		uint32_t eyeWidth, eyeHeight;
+		m_vrSystem->GetRecommendedRenderTargetSize(&eyeWidth, &eyeHeight);
+		if (QSize(static_cast<int>(eyeWidth), static_cast<int>(eyeHeight)) != m_eyeInfos[Left]->GetSize())
+			m_bEyesOutdated = true;
+	}
+
+	// The render scale changed
+	if (m_vrSystem && m_bEyesOutdated && !InitializeEyesRendering())
+	{
+		qCritical() << "Unable to create the eyes frame buffers.";
+		disconnectVR();
+	}
+
+	if (m_vrSystem)
+	{
+		// Load the controllers models without blocking the frame
+		pollControllersModels();
+
+		// Update eyes and devices matrix transform
+		UpdatePositions();
+
+		// Updates acording to controllers actions, captured at once
+		std::unique_lock<std::recursive_mutex> lock = LockRuntime();
+		updateInputSnapshot();
+		UpdateInputs();
+		lock.unlock();
+
+		m_glState->ClearColor(0.15f, 0.15f, 0.18f, 1.0f);
+
+		UpdateRendering();
+		if (!m_bGLStateCacheExclusive)
+			m_glState->Invalidate();
+
+		// Render the targets shared by both eyes
+		runFramePasses();
+
+		// Render the far field once for both eyes
+		if (m_pFarField)
+		{
+			m_pFarField->SetSurface(m_glState);
+			m_pFarField->SetRegion(0, m_glState);
+			renderEye(Center);
+			m_pFarField->UnsetSurface();
+		}
+
+		// Render for eyes
+		for (int eye = 0; eye < 2; eye++)
+		{
+			m_eyeInfos[eye]->SetSurface(m_glState, m_pDensityMask);
+			for (m_iViewportIndex = 0; m_iViewportIndex < m_eyeInfos[eye]->GetRegionCount(); m_iViewportIndex++)
+			{
+				m_eyeInfos[eye]->SetRegion(m_iViewportIndex, m_glState);
+				renderEye(static_cast<Eye>(eye));
+			}
+			m_iViewportIndex = 0;
+			m_eyeInfos[eye]->UnsetSurface();
+		}
+
+		// Recombine and upscale the eyes to the submitted size
+		postProcessEyes();
+	}
+	else
+	{
+		// The mirror view may sample the shared targets too
+		runFramePasses();
+	}
+
+	// Render mirror view in window, at a lower rate when the quality governor saves its time
+	if (!m_vrSystem || (m_uiMirrorFrame++ % m_iMirrorInterval) == 0)
+	{
+		m_glState->ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		m_glState->Viewport(0, 0, width(), height());
+		m_glState->Disable(GL_MULTISAMPLE);
+		m_glState->Disable(GL_SCISSOR_TEST);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		renderEye(Right, true);
+	}
+
+	if (m_vrSystem)
+	{
+		submitEyes();
+		updateFrameTiming();
+
+		// Upload the repainted overlay panels, if any
+		for (COverlayPanel* panel : m_overlayPanels)
+			panel->Update();
+
+		// The compositor is gone without a quit event: reconnect as if it quit
+		if (m_bCompositorLost)
+			disconnectVR();
+	}
+
+	if (m_pStreamBuffer)
+		m_pStreamBuffer->EndFrame();
+
+	update();
+}
+
+void COpenVROpenGLWidget::renderEye(Eye i_eye, bool i_bMirror)
+{
+	m_glState->Enable(GL_DEPTH_TEST);
+
+	// the mirror view is displayed before the eyes are created
+	CEyeInfos* eyeInfos = (i_eye == Center) ? m_pFarField : m_eyeInfos[i_eye];
+	QMatrix4x4 projection = m_mirrorProjection;
+	if (eyeInfos)
+		projection = i_bMirror ? eyeInfos->GetProjectionMatrix() : eyeInfos->GetRegionProjectionMatrix(m_iViewportIndex);
+	const QMatrix4x4 view = eyeInfos ? eyeInfos->GetViewMatrix() * m_hmdPose : m_hmdPose;
+
+	// Render the far field behind the near field
+	if (i_eye != Center && eyeInfos && m_pFarField)
+		m_pFarFieldCompositor->Draw(m_pFarField, eyeInfos->GetViewMatrix(), projection, m_glState);
+	
+	// Render controller, always in the near field
+	QMatrix4x4 matVP = projection * view;
+	for (int hand = 0; hand < 2; hand++)
+	{
+		if (i_eye == Center || !m_controllers[hand].m_bShowController)
+			continue;
+		m_controllers[hand].m_pRenderModel->Draw(matVP * m_controllers[hand].m_rmat4Pose, m_glState);
+	}
+	m_glState->Disable(GL_CULL_FACE);
+
+	// the application may change the vertex attributes before binding its own vertex array
+	m_glState->BindVertexArray(0);
+	m_glState->UseProgram(0);
+
+	// Render scene
+	Render( i_eye, view * GetCameraMatrix(), projection);
+	if (!m_bGLStateCacheExclusive)
+		m_glState->Invalidate();
+
+#ifdef QT_QUICK_LIB
+	// Render the Qt Quick panels over the scene, in the near field
+	const QMatrix4x4 sceneViewProjection = projection * view * GetCameraMatrix();
+	for (CQuickPanel* panel : m_quickPanels)
+	{
+		if (i_eye != Center)
+			panel->Draw(sceneViewProjection, m_glState);
+	}
+#endif
+}
+
+void COpenVROpenGLWidget::resizeGL(int w, int h)
+{
+	// the frame buffer of the widget is created again: the mirror is drawn at the next frame
+	m_uiMirrorFrame = 0;
+	m_mirrorProjection.setToIdentity();
+	m_mirrorProjection.perspective(MIRROR_FIELD_OF_VIEW, static_cast<float>(w) / qMax(h, 1), NEAR_CLIP, FAR_CLIP);
+}
+
+void COpenVROpenGLWidget::UpdatePositions()
+{
+	// The eyes only change with the IPD or the far field
+	if (m_bEyeTransformsOutdated)
+		updateEyeTransforms();
+	for (int i = 0; i < 4; i++)
+		m_headTangents[i] = m_eyesTangents[i];
+
+	// Get devices matrices
+	// At half rate, the compositor returns every second vsync and predicts the poses for the first of the two
+	// the interface stays valid until the runtime is shut down: only the requests tell the compositor is gone
+	m_bCompositorLost = vr::VRCompositor()->WaitGetPoses(m_trackedDevicePose, vr::k_unMaxTrackedDeviceCount, NULL, 0) == vr::VRCompositorError_RequestFailed;
+	m_frameCpuTimer.start();
+
+	for (unsigned int nDevice = 0; nDevice < vr::k_unMaxTrackedDeviceCount; nDevice++)
+	{
+		if (m_trackedDevicePose[nDevice].bPoseIsValid)
+		{
+			m_matrixDevicePose[nDevice] = vrMatrixToQt(m_trackedDevicePose[nDevice].mDeviceToAbsoluteTracking);
+			
+			switch (m_deviceClasses[nDevice])
+			{
+
+			case vr::TrackedDeviceClass_Controller:
+				m_controllers[m_deviceHands[nDevice]].m_rmat4Pose = m_matrixDevicePose[nDevice];
+				break;
+
+			case vr::TrackedDeviceClass_HMD:
+				m_hmdPose = m_matrixDevicePose[vr::k_unTrackedDeviceIndex_Hmd].inverted();
+				break;
+
+			default:
+				break;
+			}
+		}
+	}
+}
+
+void COpenVROpenGLWidget::updateEyeTransforms()
+{
+	std::unique_lock<std::recursive_mutex> lock = LockRuntime();
+	m_bEyeTransformsOutdated = false;
+
+	// Get eyes matrices, the eyes end at the far field
+	const float eyeFarClip = m_pFarField ? m_fFarFieldSplitDepth : FAR_CLIP;
+	for (int eye = 0; eye < 2; eye++)
+	{
+		m_eyeInfos[eye]->SetTransformMatrix(
+			vrMatrixToQt(m_vrSystem->GetEyeToHeadTransform(static_cast<vr::EVREye>(eye))).inverted(),
+			vrMatrixToQt(m_vrSystem->GetProjectionMatrix(static_cast<vr::EVREye>(eye), NEAR_CLIP, eyeFarClip))
+		);
+	}
+
+	// The frustum enclosing both eyes, from the center of the head
+	float left, right, top, bottom;
+	m_vrSystem->GetProjectionRaw(vr::Eye_Left, &left, &right, &top, &bottom);
+	for (int eye = 0; eye < 2; eye++)
+	{
+		float eyeLeft, eyeRight, eyeTop, eyeBottom;
+		m_vrSystem->GetProjectionRaw(static_cast<vr::EVREye>(eye), &eyeLeft, &eyeRight, &eyeTop, &eyeBottom);
+		left = qMin(left, eyeLeft);
+		right = qMax(right, eyeRight);
+		top = qMin(top, eyeTop);
+		bottom = qMax(bottom, eyeBottom);
+	}
+
+	// the raw tangents have the y axis pointing down
+	m_eyesTangents[0] = left;
+	m_eyesTangents[1] = right;
+	m_eyesTangents[2] = top;
+	m_eyesTangents[3] = bottom;
+
+	// The far field uses this frustum, from the split depth
+	if (m_pFarField)
+	{
+		QMatrix4x4 projection;
+		projection.frustum(left * m_fFarFieldSplitDepth, right * m_fFarFieldSplitDepth, top * m_fFarFieldSplitDepth, bottom * m_fFarFieldSplitDepth, m_fFarFieldSplitDepth, FAR_CLIP);
+		m_pFarField->SetTransformMatrix(QMatrix4x4(), projection);
+	}
+}
+
+QMatrix4x4 COpenVROpenGLWidget::vrMatrixToQt(const vr::HmdMatrix34_t &mat)
+{
+	return QMatrix4x4(
+		mat.m[0][0], mat.m[0][1], mat.m[0][2], mat.m[0][3],
+		mat.m[1][0], mat.m[1][1], mat.m[1][2], mat.m[1][3],
+		mat.m[2][0], mat.m[2][1], mat.m[2][2], mat.m[2][3],
+		0.0, 0.0, 0.0, 1.0f
+	);
+}
+
+vr::HmdMatrix34_t COpenVROpenGLWidget::qtMatrixToVr(const QMatrix4x4 &mat)
+{
+	vr::HmdMatrix34_t result;
+	for (int row = 0; row < 3; row++)
+	{
+		for (int column = 0; column < 4; column++)
+			result.m[row][column] = mat(row, column);
+	}
+	return result;
+}
+
+QMatrix4x4 COpenVROpenGLWidget::vrMatrixToQt(const vr::HmdMatrix44_t &mat)
+{
+	return QMatrix4x4(
+		mat.m[0][0], mat.m[0][1], mat.m[0][2], mat.m[0][3],
+		mat.m[1][0], mat.m[1][1], mat.m[1][2], mat.m[1][3],
+		mat.m[2][0], mat.m[2][1], mat.m[2][2], mat.m[2][3],
+		mat.m[3][0], mat.m[3][1], mat.m[3][2], mat.m[3][3]
+	);
+}
+
+void COpenVROpenGLWidget::TranslateEyes(float i_deltaX, float i_deltaY, float i_deltaZ)
 {
 	QMatrix4x4 rollPitchYaw;
 	rollPitchYaw.rotate(QQuaternion::fromEulerAngles(m_cameraRotations.x(), m_cameraRotations.y(), m_cameraRotations.z()));
@@ -339,358 +1659,4525 @@ void COpenVROpenGLWidget::TranslateEyes(float i_deltaX, float i_deltaY, float i_
 	m_cameraTranslation += translation;
 }
 
-void COpenVROpenGLWidget::ResetEyesPositions()
+void COpenVROpenGLWidget::ResetEyesPositions()
+{
+	m_cameraTranslation = INITIAL_TRANSLATION;
+}
+
+QVector3D COpenVROpenGLWidget::GetTranslations()
+{
+	return m_cameraTranslation;
+}
+
+void COpenVROpenGLWidget::RotateEyes(float i_yaw, float i_pitch, float i_roll)
+{
+	m_cameraRotations += QVector3D(i_yaw, i_pitch, i_roll);
+}
+
+void COpenVROpenGLWidget::ResetEyesRotations()
+{
+	m_cameraRotations = INITIAL_ROTATION;
+}
+
+QVector3D COpenVROpenGLWidget::GetRotations()
+{
+	return m_cameraRotations;
+}
+
+const QMatrix4x4& COpenVROpenGLWidget::GetControllerPose(int i_hand)
+{
+	return m_controllers[i_hand].m_rmat4Pose;
+}
+
+QMatrix4x4 COpenVROpenGLWidget::GetCameraMatrix()
+{
+	QMatrix4x4 cameraTransform;
+	cameraTransform.rotate(QQuaternion::fromEulerAngles(m_cameraRotations));
+	cameraTransform.translate(m_cameraTranslation);
+	return cameraTransform;
+}
+
+COpenVROpenGLWidget::COverlayPanel* COpenVROpenGLWidget::AddOverlayPanel(QWidget* i_widget, const QString& i_sKey, float i_fWidthInMeters, const QMatrix4x4& i_transform)
+{
+	COverlayPanel* panel = new COverlayPanel(i_widget, i_sKey, i_fWidthInMeters, i_transform);
+	m_overlayPanels.append(panel);
+
+	// otherwise created once the vr runtime is initialized
+	if (m_vrSystem)
+		panel->CreateOverlay();
+
+	return panel;
+}
+
+void COpenVROpenGLWidget::RemoveOverlayPanel(COverlayPanel* i_panel)
+{
+	if (!m_overlayPanels.removeOne(i_panel))
+		return;
+
+	bool current = makeResourcesCurrent();
+	delete i_panel;
+	if (current)
+		doneResourcesCurrent();
+}
+
+#ifdef QT_QUICK_LIB
+
+COpenVROpenGLWidget::CQuickPanel* COpenVROpenGLWidget::AddQuickPanel(const QUrl& i_qmlSource, const QSize& i_size, float i_fWidthInMeters, const QMatrix4x4& i_transform)
+{
+	if (!context())
+		return nullptr;
+
+	// with shared contexts, the texture survives the widget's context
+	QOpenGLContext* shareContext = QOpenGLContext::globalShareContext() ? QOpenGLContext::globalShareContext() : context();
+
+	bool current = (QOpenGLContext::currentContext() == context());
+	if (!current)
+		makeCurrent();
+
+	CQuickPanel* panel = new CQuickPanel(shareContext, i_qmlSource, i_size, i_fWidthInMeters, i_transform);
+	m_quickPanels.append(panel);
+
+	if (!current)
+		doneCurrent();
+
+	return panel;
+}
+
+void COpenVROpenGLWidget::RemoveQuickPanel(CQuickPanel* i_panel)
+{
+	if (!m_quickPanels.removeOne(i_panel))
+		return;
+
+	bool current = makeResourcesCurrent();
+	delete i_panel;
+	if (current)
+		doneResourcesCurrent();
+}
+
+bool COpenVROpenGLWidget::ProcessControllerRay(int i_hand, bool i_bPressed)
+{
+	// the controller points along its -Z axis, in the tracking space: bring the ray in the scene space
+	QMatrix4x4 controllerToScene = GetCameraMatrix().inverted() * m_controllers[i_hand].m_rmat4Pose;
+	QVector3D origin = controllerToScene.map(QVector3D(0.0f, 0.0f, 0.0f));
+	QVector3D direction = controllerToScene.mapVector(QVector3D(0.0f, 0.0f, -1.0f));
+
+	CQuickPanel* hitPanel = nullptr;
+	QPointF hitPosition;
+	float hitDistance = 0.0f;
+	for (CQuickPanel* panel : m_quickPanels)
+	{
+		float distance;
+		QPointF position;
+		if (panel->Intersect(origin, direction, &distance, &position) && (!hitPanel || distance < hitDistance))
+		{
+			hitPanel = panel;
+			hitPosition = position;
+			hitDistance = distance;
+		}
+	}
+
+	if (!hitPanel)
+		return false;
+
+	hitPanel->SendMouseEvent(hitPosition, i_bPressed ? Qt::LeftButton : Qt::NoButton);
+	return true;
+}
+
+#endif // QT_QUICK_LIB
+
+COpenVROpenGLWidget::CGLStateCache* COpenVROpenGLWidget::GetGLStateCache()
+{
+	return m_glState;
+}
+
+void COpenVROpenGLWidget::SetGLStateCacheExclusive(bool i_bExclusive)
+{
+	m_bGLStateCacheExclusive = i_bExclusive;
+}
+
+
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	EYE INFORMATIONS FOR RENDERING
+//
+
+COpenVROpenGLWidget::CEyeInfos::CEyeInfos(CRenderTargetPool* i_pool, const QSize& i_eyeSize, const QSize& i_renderSize, int i_iSamples, bool i_bFoveated, bool i_bKeepDepth, bool i_bMasked) :
+	m_size(i_eyeSize),
+	m_renderSize(i_renderSize),
+	m_targetSize(i_renderSize),
+	m_bFoveated(i_bFoveated),
+	m_iSamples(i_iSamples),
+	m_glPackedTexture(0),
+	m_glMaskedTexture(0),
+	m_glDepthTexture(0),
+	m_pPool(i_pool),
+	m_glColorBuffer(0),
+	m_glDepthBuffer(0),
+	m_glResolveTexture(0),
+	m_glOutputTexture(0),
+	m_glFrameBuffer(0),
+	m_glResolveFrameBuffer(0),
+	m_bValid(false)
+{
+	initializeOpenGLFunctions();
+
+	// with foveation, the centre at full resolution and the whole view at a lower one are packed side by side
+	m_regions[0] = QRect(QPoint(0, 0), m_renderSize);
+	if (m_bFoveated)
+	{
+		QSize centreSize = (QSizeF(m_renderSize) * FOVEA_FRACTION).toSize();
+		QSize peripherySize = (QSizeF(m_renderSize) * PERIPHERY_SCALE).toSize();
+		m_regions[0] = QRect(QPoint(0, 0), centreSize);
+		m_regions[1] = QRect(QPoint(centreSize.width(), 0), peripherySize);
+		m_targetSize = QSize(centreSize.width() + peripherySize.width(), qMax(centreSize.height(), peripherySize.height()));
+	}
+
+	// the render buffers and the textures come from the pool, shared between contexts
+	m_glColorBuffer = m_pPool->AcquireRenderbuffer(m_targetSize, GL_RGBA8, m_iSamples);
+	m_glDepthBuffer = m_pPool->AcquireRenderbuffer(m_targetSize, GL_DEPTH24_STENCIL8, m_iSamples);
+
+	// the recombine pass reads the packed regions with a bilinear filter
+	if (m_bFoveated)
+	{
+		m_glPackedTexture = m_pPool->AcquireTexture(m_targetSize, GL_RGBA8);
+		glTextureParameteri(m_glPackedTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(m_glPackedTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(m_glPackedTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(m_glPackedTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	// the reconstruct pass can't read and write the same texture
+	if (i_bMasked)
+	{
+		m_glMaskedTexture = m_pPool->AcquireTexture(m_renderSize, GL_RGBA8);
+		glTextureParameteri(m_glMaskedTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTextureParameteri(m_glMaskedTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	m_glResolveTexture = m_pPool->AcquireTexture(m_renderSize, GL_RGBA8);
+	glTextureParameteri(m_glResolveTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(m_glResolveTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(m_glResolveTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(m_glResolveTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// the upscale pass writes the submitted texture as an image
+	if (m_renderSize != m_size)
+	{
+		m_glOutputTexture = m_pPool->AcquireTexture(m_size, GL_RGBA8);
+		glTextureParameteri(m_glOutputTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(m_glOutputTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	// the depth is resolved with the color, and starts at the far plane so nothing is culled at the first frame
+	if (i_bKeepDepth)
+	{
+		const GLuint farDepth = 0xFFFFFF00u;
+		m_glDepthTexture = m_pPool->AcquireTexture(m_targetSize, GL_DEPTH24_STENCIL8);
+		glTextureParameteri(m_glDepthTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTextureParameteri(m_glDepthTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glClearTexImage(m_glDepthTexture, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, &farDepth);
+	}
+
+	createFrameBuffers();
+}
+
+COpenVROpenGLWidget::CEyeInfos::~CEyeInfos()
+{
+	destroyFrameBuffers();
+
+	if (m_glPackedTexture)
+		m_pPool->ReleaseTexture(m_glPackedTexture);
+	if (m_glMaskedTexture)
+		m_pPool->ReleaseTexture(m_glMaskedTexture);
+	if (m_glDepthTexture)
+		m_pPool->ReleaseTexture(m_glDepthTexture);
+	if (m_glOutputTexture)
+		m_pPool->ReleaseTexture(m_glOutputTexture);
+	m_pPool->ReleaseTexture(m_glResolveTexture);
+	m_pPool->ReleaseRenderbuffer(m_glDepthBuffer);
+	m_pPool->ReleaseRenderbuffer(m_glColorBuffer);
+}
+
+void COpenVROpenGLWidget::CEyeInfos::createFrameBuffers()
+{
+	glCreateFramebuffers(1, &m_glFrameBuffer);
+	glNamedFramebufferRenderbuffer(m_glFrameBuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_glColorBuffer);
+	glNamedFramebufferRenderbuffer(m_glFrameBuffer, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_glDepthBuffer);
+
+	glCreateFramebuffers(1, &m_glResolveFrameBuffer);
+	const GLuint resolveTexture = m_bFoveated ? m_glPackedTexture : (m_glMaskedTexture ? m_glMaskedTexture : m_glResolveTexture);
+	glNamedFramebufferTexture(m_glResolveFrameBuffer, GL_COLOR_ATTACHMENT0, resolveTexture, 0);
+	if (m_glDepthTexture)
+		glNamedFramebufferTexture(m_glResolveFrameBuffer, GL_DEPTH_STENCIL_ATTACHMENT, m_glDepthTexture, 0);
+
+	m_bValid = (glCheckNamedFramebufferStatus(m_glFrameBuffer, GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) &&
+		(glCheckNamedFramebufferStatus(m_glResolveFrameBuffer, GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+}
+
+void COpenVROpenGLWidget::CEyeInfos::destroyFrameBuffers()
+{
+	if (m_glFrameBuffer)
+	{
+		glDeleteFramebuffers(1, &m_glResolveFrameBuffer);
+		glDeleteFramebuffers(1, &m_glFrameBuffer);
+		m_glResolveFrameBuffer = 0;
+		m_glFrameBuffer = 0;
+	}
+	m_bValid = false;
+}
+
+void COpenVROpenGLWidget::CEyeInfos::releaseObjects()
+{
+	destroyFrameBuffers();
+}
+
+void COpenVROpenGLWidget::CEyeInfos::restoreObjects()
+{
+	createFrameBuffers();
+}
+
+void COpenVROpenGLWidget::CEyeInfos::SetSurface(CGLStateCache* i_glState, CRadialDensityMask* i_mask)
+{
+	i_glState->Viewport(0, 0, m_targetSize.width(), m_targetSize.height());
+
+	i_glState->Enable(GL_MULTISAMPLE);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_glFrameBuffer);
+
+	i_glState->Disable(GL_SCISSOR_TEST);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	if (m_bFoveated)
+	{
+		// the inside of the centre is not rendered in the periphery: its depth is set to the near plane so every
+		// fragment fails the depth test, except in the band where the regions are blended
+		const QRect& periphery = m_regions[1];
+		float inner = FOVEA_FRACTION * (1.0f - FOVEA_BLEND_WIDTH);
+		int maskWidth = static_cast<int>(periphery.width() * inner);
+		int maskHeight = static_cast<int>(periphery.height() * inner);
+
+		i_glState->Enable(GL_SCISSOR_TEST);
+		glScissor(periphery.x() + (periphery.width() - maskWidth) / 2, periphery.y() + (periphery.height() - maskHeight) / 2, maskWidth, maskHeight);
+		glClearDepthf(0.0f);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glClearDepthf(1.0f);
+		i_glState->Disable(GL_SCISSOR_TEST);
+	}
+
+	if (i_mask)
+		i_mask->Apply(m_targetSize, i_glState);
+}
+
+void COpenVROpenGLWidget::CEyeInfos::SetRegion(int i_region, CGLStateCache* i_glState)
+{
+	const QRect& region = m_regions[i_region];
+	i_glState->Viewport(region.x(), region.y(), region.width(), region.height());
+}
+
+void COpenVROpenGLWidget::CEyeInfos::UnsetSurface()
+{
+	// the depth is kept for the next frame before the multisample buffers are reused
+	glBlitNamedFramebuffer(m_glFrameBuffer, m_glResolveFrameBuffer,
+		0, 0, m_targetSize.width(), m_targetSize.height(),
+		0, 0, m_targetSize.width(), m_targetSize.height(),
+		m_glDepthTexture ? (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT) : GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	// back to the frame buffer of the widget
+	glBindFramebuffer(GL_FRAMEBUFFER, QOpenGLContext::currentContext()->defaultFramebufferObject());
+}
+
+GLuint COpenVROpenGLWidget::CEyeInfos::Texture()
+{
+	return m_glOutputTexture ? m_glOutputTexture : m_glResolveTexture;
+}
+
+void COpenVROpenGLWidget::CEyeInfos::SetTransformMatrix(const QMatrix4x4& i_view, const QMatrix4x4& i_projection)
+{
+	m_view = i_view;
+	m_projection = i_projection;
+
+	// the centre region covers [-FOVEA_FRACTION, FOVEA_FRACTION] of the normalized device coordinates
+	m_regionProjections[0] = m_projection;
+	if (m_bFoveated)
+	{
+		m_regionProjections[0].setToIdentity();
+		m_regionProjections[0].scale(1.0f / FOVEA_FRACTION, 1.0f / FOVEA_FRACTION, 1.0f);
+		m_regionProjections[0] *= m_projection;
+		m_regionProjections[1] = m_projection;
+	}
+}
+
+const QMatrix4x4&  COpenVROpenGLWidget::CEyeInfos::GetProjectionMatrix()
+{
+	return m_projection;
+}
+
+const QMatrix4x4&  COpenVROpenGLWidget::CEyeInfos::GetViewMatrix()
+{
+	return m_view;
+}
+
+bool COpenVROpenGLWidget::CEyeInfos::IsValid()
+{
+	return m_bValid;
+}
+
+COpenVROpenGLWidget::CRenderTargetPool::CRenderTargetPool() :
+	m_uiFrame(0)
+{
+	initializeOpenGLFunctions();
+}
+
+COpenVROpenGLWidget::CRenderTargetPool::~CRenderTargetPool()
+{
+	for (const SEntry& entry : m_acquired)
+		destroy(entry);
+	for (const SEntry& entry : m_released)
+		destroy(entry);
+}
+
+GLuint COpenVROpenGLWidget::CRenderTargetPool::AcquireRenderbuffer(const QSize& i_size, GLenum i_glFormat, int i_iSamples)
+{
+	return acquire(false, i_size, i_glFormat, i_iSamples);
+}
+
+GLuint COpenVROpenGLWidget::CRenderTargetPool::AcquireTexture(const QSize& i_size, GLenum i_glFormat)
+{
+	return acquire(true, i_size, i_glFormat, 0);
+}
+
+GLuint COpenVROpenGLWidget::CRenderTargetPool::acquire(bool i_bTexture, const QSize& i_size, GLenum i_glFormat, int i_iSamples)
+{
+	// the oldest released object with the same key, once the GPU and the compositor are done with it
+	for (int i = 0; i < m_released.size(); i++)
+	{
+		const SEntry& entry = m_released[i];
+		if (entry.m_uiFrame + s_recycleDelay > m_uiFrame)
+			break;
+		if (entry.m_bTexture == i_bTexture && entry.m_size == i_size && entry.m_glFormat == i_glFormat && entry.m_iSamples == i_iSamples)
+		{
+			m_acquired.append(entry);
+			m_released.remove(i);
+			return m_acquired.last().m_glObject;
+		}
+	}
+
+	SEntry entry;
+	entry.m_bTexture = i_bTexture;
+	entry.m_size = i_size;
+	entry.m_glFormat = i_glFormat;
+	entry.m_iSamples = i_iSamples;
+	entry.m_uiFrame = m_uiFrame;
+	if (i_bTexture)
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &entry.m_glObject);
+		glTextureStorage2D(entry.m_glObject, 1, i_glFormat, i_size.width(), i_size.height());
+	}
+	else
+	{
+		glCreateRenderbuffers(1, &entry.m_glObject);
+		glNamedRenderbufferStorageMultisample(entry.m_glObject, i_iSamples, i_glFormat, i_size.width(), i_size.height());
+	}
+	CGpuMemoryTracker::Track(GpuMemoryEyes, i_bTexture ? GL_TEXTURE : GL_RENDERBUFFER, entry.m_glObject,
+		CGpuMemoryTracker::TextureBytes(i_size, i_glFormat, 1, i_iSamples));
+	m_acquired.append(entry);
+	return entry.m_glObject;
+}
+
+void COpenVROpenGLWidget::CRenderTargetPool::release(bool i_bTexture, GLuint i_glObject)
+{
+	for (int i = 0; i < m_acquired.size(); i++)
+	{
+		if (m_acquired[i].m_bTexture == i_bTexture && m_acquired[i].m_glObject == i_glObject)
+		{
+			SEntry entry = m_acquired[i];
+			entry.m_uiFrame = m_uiFrame;
+			m_released.append(entry);
+			m_acquired.remove(i);
+			return;
+		}
+	}
+}
+
+void COpenVROpenGLWidget::CRenderTargetPool::destroy(const SEntry& i_entry)
+{
+	CGpuMemoryTracker::Untrack(i_entry.m_bTexture ? GL_TEXTURE : GL_RENDERBUFFER, i_entry.m_glObject);
+	if (i_entry.m_bTexture)
+		glDeleteTextures(1, &i_entry.m_glObject);
+	else
+		glDeleteRenderbuffers(1, &i_entry.m_glObject);
+}
+
+void COpenVROpenGLWidget::CRenderTargetPool::BeginFrame()
+{
+	m_uiFrame++;
+
+	// the released objects are sorted by age
+	while (!m_released.isEmpty() && m_released.first().m_uiFrame + s_idleFrames < m_uiFrame)
+	{
+		destroy(m_released.first());
+		m_released.removeFirst();
+	}
+}
+
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	COMPUTE PASSES ON THE EYES
+//
+
+#define DENSITY_MASK_FUNCTION \
+	"// true if the pixel belongs to a quad skipped by the radial density mask\n" \
+	"bool isMasked(ivec2 pixel, ivec2 size)\n" \
+	"{\n" \
+	"	ivec2 quad = pixel >> 1;\n" \
+	"	float radius = length((vec2(pixel) + 0.5) / vec2(size) * 2.0 - 1.0);\n" \
+	"	if (radius < " QT_STRINGIFY(DENSITY_MASK_INNER_RADIUS) ")\n" \
+	"		return false;\n" \
+	"	if (radius < " QT_STRINGIFY(DENSITY_MASK_OUTER_RADIUS) ")\n" \
+	"		return ((quad.x + quad.y) & 1) != 0;\n" \
+	"	return ((quad.x | quad.y) & 1) != 0;\n" \
+	"}\n"
+
+#define DENSITY_MASK_VERTEX_SHADER \
+	"#version 450\n" \
+	"void main()\n" \
+	"{\n" \
+	"	// full screen triangle\n" \
+	"	gl_Position = vec4(vec2(gl_VertexID & 1, gl_VertexID >> 1) * 4.0 - 1.0, 0.0, 1.0);\n" \
+	"}\n"
+
+#define DENSITY_MASK_FRAGMENT_SHADER \
+	"#version 450 core\n" \
+	"uniform ivec2 size;\n" \
+	DENSITY_MASK_FUNCTION \
+	"void main()\n" \
+	"{\n" \
+	"	if (!isMasked(ivec2(gl_FragCoord.xy), size))\n" \
+	"		discard;\n" \
+	"	gl_FragDepth = 0.0;\n" \
+	"}\n"
+
+#define DENSITY_RECONSTRUCT_COMPUTE_SHADER \
+	"#version 450\n" \
+	"layout(local_size_x = " QT_STRINGIFY(EYE_COMPUTE_GROUP_SIZE) ", local_size_y = " QT_STRINGIFY(EYE_COMPUTE_GROUP_SIZE) ") in;\n" \
+	"uniform sampler2D source[2];\n" \
+	"layout(rgba8) writeonly uniform image2D destination[2];\n" \
+	DENSITY_MASK_FUNCTION \
+	"void main()\n" \
+	"{\n" \
+	"	uint eye = gl_WorkGroupID.z;\n" \
+	"	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);\n" \
+	"	ivec2 size = imageSize(destination[eye]);\n" \
+	"	if (any(greaterThanEqual(pixel, size)))\n" \
+	"		return;\n" \
+	"	if (!isMasked(pixel, size))\n" \
+	"	{\n" \
+	"		imageStore(destination[eye], pixel, texelFetch(source[eye], pixel, 0));\n" \
+	"		return;\n" \
+	"	}\n" \
+	"	// the masked pixels are the average of the rendered ones around\n" \
+	"	vec3 color = vec3(0.0);\n" \
+	"	float count = 0.0;\n" \
+	"	for (int y = -2; y <= 2; y += 2)\n" \
+	"	{\n" \
+	"		for (int x = -2; x <= 2; x += 2)\n" \
+	"		{\n" \
+	"			ivec2 neighbour = clamp(pixel + ivec2(x, y), ivec2(0), size - 1);\n" \
+	"			if (isMasked(neighbour, size))\n" \
+	"				continue;\n" \
+	"			color += texelFetch(source[eye], neighbour, 0).rgb;\n" \
+	"			count += 1.0;\n" \
+	"		}\n" \
+	"	}\n" \
+	"	imageStore(destination[eye], pixel, vec4(color / max(count, 1.0), 1.0));\n" \
+	"}\n"
+
+#define UPSCALE_COMPUTE_SHADER \
+	"#version 450\n" \
+	"layout(local_size_x = " QT_STRINGIFY(EYE_COMPUTE_GROUP_SIZE) ", local_size_y = " QT_STRINGIFY(EYE_COMPUTE_GROUP_SIZE) ") in;\n" \
+	"uniform sampler2D source[2];\n" \
+	"layout(rgba8) writeonly uniform image2D destination[2];\n" \
+	"uniform float sharpness;\n" \
+	"void main()\n" \
+	"{\n" \
+	"	// one layer of work groups per eye\n" \
+	"	uint eye = gl_WorkGroupID.z;\n" \
+	"	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);\n" \
+	"	ivec2 size = imageSize(destination[eye]);\n" \
+	"	if (any(greaterThanEqual(pixel, size)))\n" \
+	"		return;\n" \
+	"	vec2 texel = 1.0 / vec2(textureSize(source[eye], 0));\n" \
+	"	vec2 uv = (vec2(pixel) + 0.5) / vec2(size);\n" \
+	"	vec3 c = textureLod(source[eye], uv, 0.0).rgb;\n" \
+	"	vec3 n = textureLod(source[eye], uv - vec2(0.0, texel.y), 0.0).rgb;\n" \
+	"	vec3 s = textureLod(source[eye], uv + vec2(0.0, texel.y), 0.0).rgb;\n" \
+	"	vec3 w = textureLod(source[eye], uv - vec2(texel.x, 0.0), 0.0).rgb;\n" \
+	"	vec3 e = textureLod(source[eye], uv + vec2(texel.x, 0.0), 0.0).rgb;\n" \
+	"	// the sharpening fades out where the local contrast is high\n" \
+	"	vec3 minimum = min(c, min(min(n, s), min(w, e)));\n" \
+	"	vec3 maximum = max(c, max(max(n, s), max(w, e)));\n" \
+	"	vec3 amount = sqrt(clamp(min(minimum, 1.0 - maximum) / max(maximum, vec3(1.0 / 256.0)), 0.0, 1.0));\n" \
+	"	vec3 weight = -amount * sharpness / mix(8.0, 5.0, sharpness);\n" \
+	"	vec3 color = (c + weight * (n + s + w + e)) / (1.0 + 4.0 * weight);\n" \
+	"	imageStore(destination[eye], pixel, vec4(clamp(color, 0.0, 1.0), 1.0));\n" \
+	"}\n"
+
+#define FOVEATION_COMPUTE_SHADER \
+	"#version 450\n" \
+	"layout(local_size_x = " QT_STRINGIFY(EYE_COMPUTE_GROUP_SIZE) ", local_size_y = " QT_STRINGIFY(EYE_COMPUTE_GROUP_SIZE) ") in;\n" \
+	"uniform sampler2D source[2];\n" \
+	"layout(rgba8) writeonly uniform image2D destination[2];\n" \
+	"uniform vec4 centre;\n" \
+	"uniform vec4 periphery;\n" \
+	"uniform float fovea;\n" \
+	"uniform float blend;\n" \
+	"vec4 fetchRegion(uint eye, vec4 region, vec2 uv, vec2 packedSize)\n" \
+	"{\n" \
+	"	// stay half a texel inside the region, so the bilinear filter doesn't bleed from the other one\n" \
+	"	vec2 position = clamp(region.xy + uv * region.zw, region.xy + 0.5, region.xy + region.zw - 0.5);\n" \
+	"	return textureLod(source[eye], position / packedSize, 0.0);\n" \
+	"}\n" \
+	"void main()\n" \
+	"{\n" \
+	"	uint eye = gl_WorkGroupID.z;\n" \
+	"	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);\n" \
+	"	ivec2 size = imageSize(destination[eye]);\n" \
+	"	if (any(greaterThanEqual(pixel, size)))\n" \
+	"		return;\n" \
+	"	vec2 packedSize = vec2(textureSize(source[eye], 0));\n" \
+	"	vec2 uv = (vec2(pixel) + 0.5) / vec2(size);\n" \
+	"	vec2 ndc = uv * 2.0 - 1.0;\n" \
+	"	vec4 color = fetchRegion(eye, periphery, uv, packedSize);\n" \
+	"	float distance = max(abs(ndc.x), abs(ndc.y)) / fovea;\n" \
+	"	if (distance < 1.0)\n" \
+	"	{\n" \
+	"		vec4 centreColor = fetchRegion(eye, centre, ndc / fovea * 0.5 + 0.5, packedSize);\n" \
+	"		color = mix(centreColor, color, smoothstep(1.0 - blend, 1.0, distance));\n" \
+	"	}\n" \
+	"	imageStore(destination[eye], pixel, vec4(color.rgb, 1.0));\n" \
+	"}\n"
+
+COpenVROpenGLWidget::CEyeComputePass::CEyeComputePass(const char* i_source) :
+	m_program(new QOpenGLShaderProgram()),
+	m_bValid(false)
+{
+	initializeOpenGLFunctions();
+
+	if (!m_program->addShaderFromSourceCode(QOpenGLShader::Compute, i_source) || !m_program->link())
+	{
+		qDebug() << m_program->log();
+		return;
+	}
+	CGpuMemoryTracker::TrackProgram(m_program);
+
+	// the left eye is on the texture and image units 0, the right eye on the units 1
+	static const GLint units[2] = { 0, 1 };
+	m_program->bind();
+	m_program->setUniformValueArray("source", units, 2);
+	m_program->setUniformValueArray("destination", units, 2);
+	m_program->release();
+
+	m_bValid = true;
+}
+
+COpenVROpenGLWidget::CEyeComputePass::~CEyeComputePass()
+{
+	CGpuMemoryTracker::UntrackProgram(m_program);
+	delete m_program;
+}
+
+COpenVROpenGLWidget::CEyeComputePass* COpenVROpenGLWidget::CEyeComputePass::CreateUpscale()
+{
+	return new CEyeComputePass(UPSCALE_COMPUTE_SHADER);
+}
+
+COpenVROpenGLWidget::CEyeComputePass* COpenVROpenGLWidget::CEyeComputePass::CreateFoveationRecombine()
+{
+	return new CEyeComputePass(FOVEATION_COMPUTE_SHADER);
+}
+
+COpenVROpenGLWidget::CEyeComputePass* COpenVROpenGLWidget::CEyeComputePass::CreateDensityReconstruct()
+{
+	return new CEyeComputePass(DENSITY_RECONSTRUCT_COMPUTE_SHADER);
+}
+
+QOpenGLShaderProgram* COpenVROpenGLWidget::CEyeComputePass::Bind(CGLStateCache* i_glState)
+{
+	i_glState->UseProgram(m_program->programId());
+	return m_program;
+}
+
+void COpenVROpenGLWidget::CEyeComputePass::Dispatch(const GLuint i_sources[2], const GLuint i_destinations[2], const QSize& i_size, CGLStateCache* i_glState)
+{
+	if (!m_bValid)
+		return;
+
+	for (int eye = 0; eye < 2; eye++)
+	{
+		i_glState->ActiveTexture(GL_TEXTURE0 + eye);
+		i_glState->BindTexture(GL_TEXTURE_2D, i_sources[eye]);
+		glBindImageTexture(eye, i_destinations[eye], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	}
+
+	glDispatchCompute((i_size.width() + EYE_COMPUTE_GROUP_SIZE - 1) / EYE_COMPUTE_GROUP_SIZE, (i_size.height() + EYE_COMPUTE_GROUP_SIZE - 1) / EYE_COMPUTE_GROUP_SIZE, 2);
+
+	// the destinations are read by the next pass or by the compositor once submitted
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+}
+
+void COpenVROpenGLWidget::postProcessEyes()
+{
+	GLuint sources[2];
+	GLuint destinations[2];
+
+	// the packed regions to the render size
+	if (m_pFoveationPass)
+	{
+		for (int eye = 0; eye < 2; eye++)
+		{
+			sources[eye] = m_eyeInfos[eye]->PackedTexture();
+			destinations[eye] = m_eyeInfos[eye]->RenderTexture();
+		}
+		m_pFoveationPass->Bind(m_glState);
+		m_pFoveationPass->Dispatch(sources, destinations, m_eyeInfos[Left]->GetRenderSize(), m_glState);
+	}
+
+	// the pixels skipped by the density mask
+	if (m_pDensityReconstructPass)
+	{
+		for (int eye = 0; eye < 2; eye++)
+		{
+			sources[eye] = m_eyeInfos[eye]->MaskedTexture();
+			destinations[eye] = m_eyeInfos[eye]->RenderTexture();
+		}
+		m_pDensityReconstructPass->Bind(m_glState);
+		m_pDensityReconstructPass->Dispatch(sources, destinations, m_eyeInfos[Left]->GetRenderSize(), m_glState);
+	}
+
+	// the render size to the submitted size
+	if (m_pUpscalePass)
+	{
+		for (int eye = 0; eye < 2; eye++)
+		{
+			sources[eye] = m_eyeInfos[eye]->RenderTexture();
+			destinations[eye] = m_eyeInfos[eye]->Texture();
+		}
+		m_pUpscalePass->Bind(m_glState)->setUniformValue("sharpness", m_fUpscaleSharpness);
+		m_pUpscalePass->Dispatch(sources, destinations, m_eyeInfos[Left]->GetSize(), m_glState);
+	}
+}
+
+#define FARFIELD_VERTEX_SHADER \
+	"#version 450\n" \
+	"out vec2 v2Position;\n" \
+	"void main()\n" \
+	"{\n" \
+	"	// full screen triangle on the far plane\n" \
+	"	v2Position = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 4.0 - 1.0;\n" \
+	"	gl_Position = vec4(v2Position, 1.0, 1.0);\n" \
+	"}\n"
+
+#define FARFIELD_FRAGMENT_SHADER \
+	"#version 450 core\n" \
+	"uniform mat4 eyeToCenter;\n" \
+	"uniform sampler2D farField;\n" \
+	"in vec2 v2Position;\n" \
+	"layout(location = 0) out vec4 FragColor;\n" \
+	"void main()\n" \
+	"{\n" \
+	"	vec4 position = eyeToCenter * vec4(v2Position, 1.0, 1.0);\n" \
+	"	FragColor = texture(farField, position.xy / position.w * 0.5 + 0.5);\n" \
+	"}\n"
+
+COpenVROpenGLWidget::CRadialDensityMask::CRadialDensityMask() :
+	m_program(new QOpenGLShaderProgram()),
+	m_iSizeLocation(-1),
+	m_glVertArray(0),
+	m_bValid(false)
+{
+	initializeOpenGLFunctions();
+
+	if (!m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, DENSITY_MASK_VERTEX_SHADER) ||
+		!m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, DENSITY_MASK_FRAGMENT_SHADER) ||
+		!m_program->link())
+	{
+		qDebug() << m_program->log();
+		return;
+	}
+	CGpuMemoryTracker::TrackProgram(m_program);
+
+	m_iSizeLocation = m_program->uniformLocation("size");
+	glCreateVertexArrays(1, &m_glVertArray);
+	m_bValid = true;
+}
+
+COpenVROpenGLWidget::CRadialDensityMask::~CRadialDensityMask()
+{
+	ReleaseContext();
+	CGpuMemoryTracker::UntrackProgram(m_program);
+	delete m_program;
+}
+
+void COpenVROpenGLWidget::CRadialDensityMask::releaseObjects()
+{
+	glDeleteVertexArrays(1, &m_glVertArray);
+	m_glVertArray = 0;
+}
+
+void COpenVROpenGLWidget::CRadialDensityMask::restoreObjects()
+{
+	glCreateVertexArrays(1, &m_glVertArray);
+}
+
+void COpenVROpenGLWidget::CRadialDensityMask::Apply(const QSize& i_size, CGLStateCache* i_glState)
+{
+	if (!m_bValid)
+		return;
+
+	i_glState->UseProgram(m_program->programId());
+	glProgramUniform2i(m_program->programId(), m_iSizeLocation, i_size.width(), i_size.height());
+	i_glState->BindVertexArray(m_glVertArray);
+
+	// only the depth of the masked quads is written
+	i_glState->Enable(GL_DEPTH_TEST);
+	glDepthFunc(GL_ALWAYS);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthFunc(GL_LESS);
+}
+
+COpenVROpenGLWidget::CFarFieldCompositor::CFarFieldCompositor() :
+	m_program(new QOpenGLShaderProgram()),
+	m_iMatrixLocation(-1),
+	m_glVertArray(0),
+	m_bValid(false)
+{
+	initializeOpenGLFunctions();
+
+	if (!m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, FARFIELD_VERTEX_SHADER) ||
+		!m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, FARFIELD_FRAGMENT_SHADER) ||
+		!m_program->link())
+	{
+		qDebug() << m_program->log();
+		return;
+	}
+	CGpuMemoryTracker::TrackProgram(m_program);
+
+	m_iMatrixLocation = m_program->uniformLocation("eyeToCenter");
+	m_program->bind();
+	m_program->setUniformValue("farField", 0);
+	m_program->release();
+
+	glCreateVertexArrays(1, &m_glVertArray);
+	m_bValid = true;
+}
+
+COpenVROpenGLWidget::CFarFieldCompositor::~CFarFieldCompositor()
+{
+	ReleaseContext();
+	CGpuMemoryTracker::UntrackProgram(m_program);
+	delete m_program;
+}
+
+void COpenVROpenGLWidget::CFarFieldCompositor::releaseObjects()
+{
+	glDeleteVertexArrays(1, &m_glVertArray);
+	m_glVertArray = 0;
+}
+
+void COpenVROpenGLWidget::CFarFieldCompositor::restoreObjects()
+{
+	glCreateVertexArrays(1, &m_glVertArray);
+}
+
+void COpenVROpenGLWidget::CFarFieldCompositor::Draw(CEyeInfos* i_farField, const QMatrix4x4& i_view, const QMatrix4x4& i_projection, CGLStateCache* i_glState)
+{
+	if (!m_bValid)
+		return;
+
+	// from the pixels of the eye to the texture of the far field, rotation only
+	QMatrix4x4 eyeToHead = i_view.inverted();
+	eyeToHead.setColumn(3, QVector4D(0.0f, 0.0f, 0.0f, 1.0f));
+	QMatrix4x4 eyeToCenter = i_farField->GetProjectionMatrix() * eyeToHead * i_projection.inverted();
+
+	i_glState->UseProgram(m_program->programId());
+	m_program->setUniformValue(m_iMatrixLocation, eyeToCenter);
+	i_glState->BindVertexArray(m_glVertArray);
+	i_glState->ActiveTexture(GL_TEXTURE0);
+	i_glState->BindTexture(GL_TEXTURE_2D, i_farField->RenderTexture());
+
+	// on the cleared depth, but not on the masked pixels
+	i_glState->Enable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+	glDepthMask(GL_FALSE);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+}
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	EYE INFORMATIONS FOR RENDERING
+//
+
+#define RENDERMODEL_VERTEX_SHADER \
+	"#version 450\n" \
+	"uniform mat4 matrix;\n" \
+	"layout(location = 0) in vec4 position;\n" \
+	"layout(location = 1) in vec3 v3NormalIn;\n" \
+	"layout(location = 2) in vec2 v2TexCoordsIn;\n" \
+	"out vec2 v2TexCoord;\n" \
+	"void main()\n" \
+	"{\n" \
+	"	v2TexCoord = v2TexCoordsIn;\n" \
+	"	gl_Position = matrix * vec4(position.xyz, 1);\n" \
+	"}\n"
+
+#define RENDERMODEL_FRAGMENT_SHADER \
+	"#version 450 core\n" \
+	"uniform sampler2D diffuse;\n" \
+	"in vec2 v2TexCoord;\n" \
+	"layout(location = 0) out vec4 FragColor;\n" \
+	"void main()\n" \
+	"{\n" \
+	"   FragColor = texture( diffuse, v2TexCoord);\n" \
+	"}\n"
+
+COpenVROpenGLWidget::CRenderModel::CRenderModel(const QString& i_sRenderModelName) :
+	m_sModelName(i_sRenderModelName),
+	m_glIndexBuffer(0),
+	m_glVertArray(0),
+	m_glVertBuffer(0),
+	m_glTexture(0),
+	m_iMatrixLocation(-1),
+	m_program(new QOpenGLShaderProgram())
+{
+	initializeOpenGLFunctions();
+
+	bool noError = true;
+
+	// compile vertex shader
+	QString vertexShaderSource(RENDERMODEL_VERTEX_SHADER);
+	noError &= m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource);
+	if (!noError)
+	{
+		qDebug() << m_program->log();
+		return;
+	}
+
+	// compile fragment shader
+	QString fragSahderSource(RENDERMODEL_FRAGMENT_SHADER);
+	noError &= m_program->addShaderFromSourceCode(QOpenGLShader::Fragment,fragSahderSource);
+	if (!noError)
+	{
+		qDebug() << m_program->log();
+		return;
+	}
+
+	// link
+	noError &= m_program->link();
+	if (!noError)
+	{
+		qDebug() << m_program->log();
+		return;
+	}
+	CGpuMemoryTracker::TrackProgram(m_program);
+
+	// the sampler never changes: set it once instead of at each draw
+	m_iMatrixLocation = m_program->uniformLocation("matrix");
+	m_program->bind();
+	m_program->setUniformValue("diffuse", 0);
+	m_program->release();
+}
+
+COpenVROpenGLWidget::CRenderModel::~CRenderModel()
+{
+	Cleanup();
+}
+
+COpenVROpenGLWidget::CRenderModel* COpenVROpenGLWidget::CRenderModel::LoadModel(const QString& i_modelName, QString* o_errorMessage)
+{
+	vr::RenderModel_t *pModel = nullptr;
+	COpenVROpenGLWidget::CRenderModel* pRenderModel = nullptr;
+	while (!LoadModelAsync(i_modelName, &pModel, &pRenderModel, o_errorMessage))
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return pRenderModel;
+}
+
+bool COpenVROpenGLWidget::CRenderModel::LoadModelAsync(const QString& i_modelName, vr::RenderModel_t** io_vrModel, CRenderModel** o_renderModel, QString* o_errorMessage)
+{
+	*o_renderModel = nullptr;
+
+	vr::EVRRenderModelError error;
+	if (*io_vrModel == nullptr)
+	{
+		error = vr::VRRenderModels()->LoadRenderModel_Async(i_modelName.toStdString().c_str(), io_vrModel);
+		if (error == vr::VRRenderModelError_Loading)
+			return false;
+
+		if (error != vr::VRRenderModelError_None)
+		{
+			QString errMessage("Unable to load render model %1 - %2");
+			errMessage = errMessage.arg(i_modelName).arg(vr::VRRenderModels()->GetRenderModelErrorNameFromEnum(error));
+			qDebug() << errMessage;
+			if (o_errorMessage != nullptr)
+				*o_errorMessage = errMessage;
+			*io_vrModel = nullptr;
+			return true;
+		}
+	}
+
+	vr::RenderModel_t *pModel = *io_vrModel;
+	vr::RenderModel_TextureMap_t *pTexture;
+	error = vr::VRRenderModels()->LoadTexture_Async(pModel->diffuseTextureId, &pTexture);
+	if (error == vr::VRRenderModelError_Loading)
+		return false;
+
+	// the vr model is released in any case from here
+	*io_vrModel = nullptr;
+
+	if (error != vr::VRRenderModelError_None)
+	{
+		QString errMessage("Unable to load render texture id:%1 for render model %2");
+		errMessage = errMessage.arg(pModel->diffuseTextureId).arg(i_modelName);
+		qDebug() << errMessage;
+		if (o_errorMessage != nullptr)
+			*o_errorMessage = errMessage;
+		vr::VRRenderModels()->FreeRenderModel(pModel);
+		return true;
+	}
+
+	COpenVROpenGLWidget::CRenderModel* pRenderModel = new CRenderModel(i_modelName);
+	if (!pRenderModel->InitModel(*pModel, *pTexture))
+	{
+		QString errMessage("Unable to create GL model from render model %1");
+		errMessage = errMessage.arg(i_modelName);
+		qDebug() << errMessage;
+		if (o_errorMessage != nullptr)
+			*o_errorMessage = errMessage;
+		delete pRenderModel;
+		pRenderModel = nullptr;
+	}
+	vr::VRRenderModels()->FreeRenderModel(pModel);
+	vr::VRRenderModels()->FreeTexture(pTexture);
+
+	if (o_errorMessage != nullptr && pRenderModel != nullptr)
+		*o_errorMessage = "Success";
+
+	*o_renderModel = pRenderModel;
+	return true;
+}
+
+bool COpenVROpenGLWidget::CRenderModel::InitModel(const vr::RenderModel_t & i_vrModel, const vr::RenderModel_TextureMap_t & i_vrDiffuseTexture)
+{
+	// The buffers and the texture are created without binding them, so the state cache stays valid
+	// Populate a vertex buffer
+	glCreateBuffers(1, &m_glVertBuffer);
+	glNamedBufferData(m_glVertBuffer, sizeof(vr::RenderModel_Vertex_t) * i_vrModel.unVertexCount, i_vrModel.rVertexData, GL_STATIC_DRAW);
+	CGpuMemoryTracker::Track(GpuMemoryRenderModels, GL_BUFFER, m_glVertBuffer, sizeof(vr::RenderModel_Vertex_t) * i_vrModel.unVertexCount);
+
+	// Create and populate the index buffer
+	glCreateBuffers(1, &m_glIndexBuffer);
+	glNamedBufferData(m_glIndexBuffer, sizeof(uint16_t) * i_vrModel.unTriangleCount * 3, i_vrModel.rIndexData, GL_STATIC_DRAW);
+	CGpuMemoryTracker::Track(GpuMemoryRenderModels, GL_BUFFER, m_glIndexBuffer, sizeof(uint16_t) * i_vrModel.unTriangleCount * 3);
+
+	// create a VAO to hold state for this model
+	createVertexArray();
+
+	// create and populate the texture
+	GLsizei levels = 1;
+	for (int size = qMax(i_vrDiffuseTexture.unWidth, i_vrDiffuseTexture.unHeight); size > 1; size /= 2)
+		levels++;
+
+	glCreateTextures(GL_TEXTURE_2D, 1, &m_glTexture);
+	glTextureStorage2D(m_glTexture, levels, GL_RGBA8, i_vrDiffuseTexture.unWidth, i_vrDiffuseTexture.unHeight);
+	CGpuMemoryTracker::Track(GpuMemoryRenderModels, GL_TEXTURE, m_glTexture,
+		CGpuMemoryTracker::TextureBytes(QSize(i_vrDiffuseTexture.unWidth, i_vrDiffuseTexture.unHeight), GL_RGBA8, levels));
+	glTextureSubImage2D(m_glTexture, 0, 0, 0, i_vrDiffuseTexture.unWidth, i_vrDiffuseTexture.unHeight,
+		GL_RGBA, GL_UNSIGNED_BYTE, i_vrDiffuseTexture.rubTextureMapData);
+
+	// If this renders black ask McJohn what's wrong.
+	glGenerateTextureMipmap(m_glTexture);
+
+	glTextureParameteri(m_glTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(m_glTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(m_glTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(m_glTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+	GLfloat fLargest;
+	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &fLargest);
+	glTextureParameterf(m_glTexture, GL_TEXTURE_MAX_ANISOTROPY_EXT, fLargest);
+
+	m_unVertexCount = i_vrModel.unTriangleCount * 3;
+
+	return true;
+}
+
+void COpenVROpenGLWidget::CRenderModel::createVertexArray()
+{
+	glCreateVertexArrays(1, &m_glVertArray);
+	glVertexArrayVertexBuffer(m_glVertArray, 0, m_glVertBuffer, 0, sizeof(vr::RenderModel_Vertex_t));
+	glVertexArrayElementBuffer(m_glVertArray, m_glIndexBuffer);
+
+	// Identify the components in the vertex buffer
+	glEnableVertexArrayAttrib(m_glVertArray, 0);
+	glVertexArrayAttribFormat(m_glVertArray, 0, 3, GL_FLOAT, GL_FALSE, offsetof(vr::RenderModel_Vertex_t, vPosition));
+	glVertexArrayAttribBinding(m_glVertArray, 0, 0);
+	glEnableVertexArrayAttrib(m_glVertArray, 1);
+	glVertexArrayAttribFormat(m_glVertArray, 1, 3, GL_FLOAT, GL_FALSE, offsetof(vr::RenderModel_Vertex_t, vNormal));
+	glVertexArrayAttribBinding(m_glVertArray, 1, 0);
+	glEnableVertexArrayAttrib(m_glVertArray, 2);
+	glVertexArrayAttribFormat(m_glVertArray, 2, 2, GL_FLOAT, GL_FALSE, offsetof(vr::RenderModel_Vertex_t, rfTextureCoord));
+	glVertexArrayAttribBinding(m_glVertArray, 2, 0);
+}
+
+void COpenVROpenGLWidget::CRenderModel::releaseObjects()
+{
+	glDeleteVertexArrays(1, &m_glVertArray);
+	m_glVertArray = 0;
+}
+
+void COpenVROpenGLWidget::CRenderModel::restoreObjects()
+{
+	createVertexArray();
+}
+
+void COpenVROpenGLWidget::CRenderModel::Cleanup()
+{
+	if (m_glVertBuffer)
+	{
+		CGpuMemoryTracker::Untrack(GL_BUFFER, m_glIndexBuffer);
+		CGpuMemoryTracker::Untrack(GL_BUFFER, m_glVertBuffer);
+		glDeleteBuffers(1, &m_glIndexBuffer);
+		glDeleteVertexArrays(1, &m_glVertArray);
+		glDeleteBuffers(1, &m_glVertBuffer);
+		m_glIndexBuffer = 0;
+		m_glVertArray = 0;
+		m_glVertBuffer = 0;
+	}
+
+	if (m_glTexture)
+	{
+		CGpuMemoryTracker::Untrack(GL_TEXTURE, m_glTexture);
+		glDeleteTextures(1, &m_glTexture);
+		m_glTexture = 0;
+	}
+
+	CGpuMemoryTracker::UntrackProgram(m_program);
+	delete m_program;
+}
+
+void COpenVROpenGLWidget::CRenderModel::Draw(const QMatrix4x4& i_mvpMatrix, CGLStateCache* i_glState)
+{
+	i_glState->Enable(GL_CULL_FACE);
+
+	i_glState->UseProgram(m_program->programId());
+	m_program->setUniformValue(m_iMatrixLocation, i_mvpMatrix);
+
+	i_glState->BindVertexArray(m_glVertArray);
+
+	i_glState->ActiveTexture(GL_TEXTURE0);
+	i_glState->BindTexture(GL_TEXTURE_2D, m_glTexture);
+
+	glDrawElements(GL_TRIANGLES, m_unVertexCount, GL_UNSIGNED_SHORT, 0);
+}
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	OPENGL STATE CACHE
+//
+
+COpenVROpenGLWidget::CGLStateCache::CGLStateCache()
+{
+	initializeOpenGLFunctions();
+	Invalidate();
+}
+
+int COpenVROpenGLWidget::CGLStateCache::capabilityIndex(GLenum i_capability)
+{
+	switch (i_capability)
+	{
+	case GL_DEPTH_TEST:		return CapDepthTest;
+	case GL_CULL_FACE:		return CapCullFace;
+	case GL_BLEND:			return CapBlend;
+	case GL_MULTISAMPLE:	return CapMultisample;
+	case GL_SCISSOR_TEST:	return CapScissorTest;
+	case GL_STENCIL_TEST:	return CapStencilTest;
+	default:				return -1;
+	}
+}
+
+bool COpenVROpenGLWidget::CGLStateCache::count(bool i_bChanged)
+{
+	if (i_bChanged)
+		m_currentCounters.m_uiIssued++;
+	else
+		m_currentCounters.m_uiElided++;
+
+	return i_bChanged;
+}
+
+void COpenVROpenGLWidget::CGLStateCache::Invalidate()
+{
+	// GL names are never equal to ~0, so it is used as the "unknown" value
+	for (int cap = 0; cap < CapCount; cap++)
+		m_capabilities[cap] = -1;
+
+	m_program = ~0u;
+	m_vertexArray = ~0u;
+	m_activeTexture = ~0u;
+	for (int unit = 0; unit < s_textureUnitCount; unit++)
+		m_textures2D[unit] = ~0u;
+
+	m_bClearColorKnown = false;
+	m_bViewportKnown = false;
+	m_bBlendFuncKnown = false;
+}
+
+void COpenVROpenGLWidget::CGLStateCache::BeginFrame()
+{
+	m_frameCounters = m_currentCounters;
+	m_currentCounters = SCounters();
+
+	Invalidate();
+}
+
+void COpenVROpenGLWidget::CGLStateCache::Enable(GLenum i_capability)
+{
+	int index = capabilityIndex(i_capability);
+	if (index < 0)
+	{
+		count(true);
+		glEnable(i_capability);
+		return;
+	}
+
+	if (count(m_capabilities[index] != 1))
+	{
+		glEnable(i_capability);
+		m_capabilities[index] = 1;
+	}
+}
+
+void COpenVROpenGLWidget::CGLStateCache::Disable(GLenum i_capability)
+{
+	int index = capabilityIndex(i_capability);
+	if (index < 0)
+	{
+		count(true);
+		glDisable(i_capability);
+		return;
+	}
+
+	if (count(m_capabilities[index] != 0))
+	{
+		glDisable(i_capability);
+		m_capabilities[index] = 0;
+	}
+}
+
+void COpenVROpenGLWidget::CGLStateCache::UseProgram(GLuint i_program)
+{
+	if (count(m_program != i_program))
+	{
+		glUseProgram(i_program);
+		m_program = i_program;
+	}
+}
+
+void COpenVROpenGLWidget::CGLStateCache::BindVertexArray(GLuint i_vertexArray)
+{
+	if (count(m_vertexArray != i_vertexArray))
+	{
+		glBindVertexArray(i_vertexArray);
+		m_vertexArray = i_vertexArray;
+	}
+}
+
+void COpenVROpenGLWidget::CGLStateCache::ActiveTexture(GLenum i_textureUnit)
+{
+	GLuint unit = i_textureUnit - GL_TEXTURE0;
+	if (count(m_activeTexture != unit))
+	{
+		glActiveTexture(i_textureUnit);
+		m_activeTexture = unit;
+	}
+}
+
+void COpenVROpenGLWidget::CGLStateCache::BindTexture(GLenum i_target, GLuint i_texture)
+{
+	// the active unit must be known to know which binding is changed
+	if (i_target != GL_TEXTURE_2D || m_activeTexture >= static_cast<GLuint>(s_textureUnitCount))
+	{
+		count(true);
+		glBindTexture(i_target, i_texture);
+		return;
+	}
+
+	if (count(m_textures2D[m_activeTexture] != i_texture))
+	{
+		glBindTexture(i_target, i_texture);
+		m_textures2D[m_activeTexture] = i_texture;
+	}
+}
+
+void COpenVROpenGLWidget::CGLStateCache::ClearColor(GLfloat i_red, GLfloat i_green, GLfloat i_blue, GLfloat i_alpha)
+{
+	bool changed = !m_bClearColorKnown ||
+		m_clearColor[0] != i_red || m_clearColor[1] != i_green || m_clearColor[2] != i_blue || m_clearColor[3] != i_alpha;
+
+	if (count(changed))
+	{
+		glClearColor(i_red, i_green, i_blue, i_alpha);
+		m_clearColor[0] = i_red;
+		m_clearColor[1] = i_green;
+		m_clearColor[2] = i_blue;
+		m_clearColor[3] = i_alpha;
+		m_bClearColorKnown = true;
+	}
+}
+
+void COpenVROpenGLWidget::CGLStateCache::Viewport(GLint i_x, GLint i_y, GLsizei i_width, GLsizei i_height)
+{
+	bool changed = !m_bViewportKnown ||
+		m_viewport[0] != i_x || m_viewport[1] != i_y || m_viewport[2] != i_width || m_viewport[3] != i_height;
+
+	if (count(changed))
+	{
+		glViewport(i_x, i_y, i_width, i_height);
+		m_viewport[0] = i_x;
+		m_viewport[1] = i_y;
+		m_viewport[2] = i_width;
+		m_viewport[3] = i_height;
+		m_bViewportKnown = true;
+	}
+}
+
+void COpenVROpenGLWidget::CGLStateCache::BlendFunc(GLenum i_sourceFactor, GLenum i_destinationFactor)
+{
+	bool changed = !m_bBlendFuncKnown || m_blendFunc[0] != i_sourceFactor || m_blendFunc[1] != i_destinationFactor;
+
+	if (count(changed))
+	{
+		glBlendFunc(i_sourceFactor, i_destinationFactor);
+		m_blendFunc[0] = i_sourceFactor;
+		m_blendFunc[1] = i_destinationFactor;
+		m_bBlendFuncKnown = true;
+	}
+}
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	OPENGL DEBUG MESSAGES QUEUE
+//
+
+COpenVROpenGLWidget::CDebugMessageQueue::CDebugMessageQueue() :
+	m_uiEnqueuePos(0),
+	m_uiDequeuePos(0),
+	m_uiDropped(0),
+	m_bStop(false)
+{
+	for (unsigned int i = 0; i < s_capacity; i++)
+		m_slots[i].m_uiSequence.store(i, std::memory_order_relaxed);
+
+	for (unsigned int i = 0; i < s_idTableSize; i++)
+	{
+		m_seenKeys[i].store(0, std::memory_order_relaxed);
+		m_repeats[i].store(0, std::memory_order_relaxed);
+	}
+
+	m_thread = std::thread(&CDebugMessageQueue::run, this);
+}
+
+COpenVROpenGLWidget::CDebugMessageQueue::~CDebugMessageQueue()
+{
+	m_bStop.store(true);
+	m_thread.join();
+}
+
+quint64 COpenVROpenGLWidget::CDebugMessageQueue::key(const QOpenGLDebugMessage& i_message)
+{
+	// the sources and the types are single bits below 2^16, the top bit makes the key never 0
+	return (1ull << 63) | (static_cast<quint64>(i_message.source()) << 48) | (static_cast<quint64>(i_message.type()) << 32) | i_message.id();
+}
+
+bool COpenVROpenGLWidget::CDebugMessageQueue::firstOccurrence(quint64 i_uiKey)
+{
+	unsigned int index = static_cast<unsigned int>((i_uiKey * 0x9E3779B97F4A7C15ull) >> 32) & (s_idTableSize - 1);
+
+	// open addressing with linear probing, the entries are only removed all at once by reportRepeats()
+	for (unsigned int probe = 0; probe < s_idTableSize; probe++)
+	{
+		quint64 seen = m_seenKeys[index].load(std::memory_order_acquire);
+		if (seen == 0 && m_seenKeys[index].compare_exchange_strong(seen, i_uiKey, std::memory_order_acq_rel))
+			return true;
+
+		if (seen == i_uiKey)
+		{
+			m_repeats[index].fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		index = (index + 1) & (s_idTableSize - 1);
+	}
+
+	// table full: don't deduplicate any more
+	return true;
+}
+
+void COpenVROpenGLWidget::CDebugMessageQueue::Push(const QOpenGLDebugMessage& i_message)
+{
+	if (!firstOccurrence(key(i_message)))
+		return;
+
+	// bounded multi-producer queue: reserve a slot by moving the enqueue position
+	unsigned int pos = m_uiEnqueuePos.load(std::memory_order_relaxed);
+	SSlot* slot;
+	while (true)
+	{
+		slot = &m_slots[pos & (s_capacity - 1)];
+		unsigned int sequence = slot->m_uiSequence.load(std::memory_order_acquire);
+		int diff = static_cast<int>(sequence - pos);
+		if (diff == 0)
+		{
+			if (m_uiEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			// full
+			m_uiDropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		else
+		{
+			pos = m_uiEnqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	// the message is copied field by field, its reference counted text stays on this thread
+	slot->m_uiId = i_message.id();
+	slot->m_source = i_message.source();
+	slot->m_type = i_message.type();
+	slot->m_severity = i_message.severity();
+	const QString text = i_message.message();
+	const int length = qMin(text.size(), s_textSize - 1);
+	for (int i = 0; i < length; i++)
+	{
+		const ushort c = text.at(i).unicode();
+		slot->m_text[i] = (c < 0x80) ? static_cast<char>(c) : '?';
+	}
+	slot->m_text[length] = '\0';
+	slot->m_uiSequence.store(pos + 1, std::memory_order_release);
+}
+
+void COpenVROpenGLWidget::CDebugMessageQueue::drain()
+{
+	while (true)
+	{
+		SSlot& slot = m_slots[m_uiDequeuePos & (s_capacity - 1)];
+		if (slot.m_uiSequence.load(std::memory_order_acquire) != m_uiDequeuePos + 1)
+			return;
+
+		qDebug() << "OpenGL debug message" << slot.m_uiId << slot.m_source << slot.m_type << slot.m_severity << slot.m_text;
+
+		slot.m_uiSequence.store(m_uiDequeuePos + s_capacity, std::memory_order_release);
+		m_uiDequeuePos++;
+	}
+}
+
+void COpenVROpenGLWidget::CDebugMessageQueue::reportRepeats()
+{
+	// the deduplication starts again each period: the drivers reuse an ID for different messages
+	for (unsigned int i = 0; i < s_idTableSize; i++)
+	{
+		const quint64 seen = m_seenKeys[i].exchange(0, std::memory_order_acq_rel);
+		unsigned int repeats = m_repeats[i].exchange(0, std::memory_order_relaxed);
+		if (seen != 0 && repeats > 0)
+		{
+			qDebug() << "OpenGL debug message" << static_cast<GLuint>(seen & 0xFFFFFFFFull)
+				<< static_cast<QOpenGLDebugMessage::Source>((seen >> 48) & 0xFFFF) << static_cast<QOpenGLDebugMessage::Type>((seen >> 32) & 0xFFFF)
+				<< "repeated" << repeats << "times";
+		}
+	}
+
+	unsigned int dropped = m_uiDropped.exchange(0, std::memory_order_relaxed);
+	if (dropped > 0)
+		qDebug() << dropped << "OpenGL debug messages dropped";
+}
+
+void COpenVROpenGLWidget::CDebugMessageQueue::run()
+{
+	auto lastReport = std::chrono::steady_clock::now();
+	while (!m_bStop.load())
+	{
+		drain();
+
+		if (std::chrono::steady_clock::now() - lastReport > DEBUG_REPEATS_REPORT_PERIOD)
+		{
+			reportRepeats();
+			lastReport = std::chrono::steady_clock::now();
+		}
+
+		std::this_thread::sleep_for(DEBUG_QUEUE_POLL_INTERVAL);
+	}
+
+	drain();
+	reportRepeats();
+}
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	PERSISTENT CONTEXT HOSTING THE SHARED RESOURCES
+//
+
+COpenVROpenGLWidget::CGLResourceHost* COpenVROpenGLWidget::CGLResourceHost::s_instance = nullptr;
+
+COpenVROpenGLWidget::CGLResourceHost::CGLResourceHost() :
+	m_context(new QOpenGLContext()),
+	m_surface(new QOffscreenSurface()),
+	m_iRefCount(0)
+{
+	// the global share context is shared with all the widgets' contexts
+	QOpenGLContext* shareContext = QOpenGLContext::globalShareContext();
+	m_context->setShareContext(shareContext);
+	m_context->setFormat(shareContext->format());
+	m_context->create();
+
+	m_surface->setFormat(m_context->format());
+	m_surface->create();
+}
+
+COpenVROpenGLWidget::CGLResourceHost::~CGLResourceHost()
+{
+	delete m_context;
+	delete m_surface;
+}
+
+COpenVROpenGLWidget::CGLResourceHost* COpenVROpenGLWidget::CGLResourceHost::Acquire()
+{
+	if (!QCoreApplication::testAttribute(Qt::AA_ShareOpenGLContexts) || !QOpenGLContext::globalShareContext())
+		return nullptr;
+
+	if (!s_instance)
+	{
+		s_instance = new CGLResourceHost();
+		if (!s_instance->m_context->isValid() || !s_instance->m_surface->isValid())
+		{
+			qDebug() << "Unable to create the OpenGL resource host context.";
+			delete s_instance;
+			s_instance = nullptr;
+			return nullptr;
+		}
+	}
+
+	s_instance->m_iRefCount++;
+	return s_instance;
+}
+
+void COpenVROpenGLWidget::CGLResourceHost::Release()
+{
+	if (s_instance && --s_instance->m_iRefCount == 0)
+	{
+		delete s_instance;
+		s_instance = nullptr;
+	}
+}
+
+bool COpenVROpenGLWidget::CGLResourceHost::MakeCurrent()
+{
+	return m_context->makeCurrent(m_surface);
+}
+
+void COpenVROpenGLWidget::CGLResourceHost::DoneCurrent()
+{
+	m_context->doneCurrent();
+}
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	QT WIDGETS IN COMPOSITOR OVERLAYS
+//
+
+COpenVROpenGLWidget::COverlayPanel::COverlayPanel(QWidget* i_widget, const QString& i_sKey, float i_fWidthInMeters, const QMatrix4x4& i_transform) :
+	m_scene(new QGraphicsScene(this)),
+	m_widget(i_widget),
+	m_sKey(i_sKey),
+	m_overlayHandle(vr::k_ulOverlayHandleInvalid),
+	m_glTexture(0),
+	m_textureSize(i_widget->size()),
+	m_bGLInitialized(false),
+	m_dirtyRegion(QRect(QPoint(0, 0), i_widget->size())),
+	m_transform(i_transform),
+	m_fWidthInMeters(i_fWidthInMeters),
+	m_bVisible(true)
+{
+	// the scene reports the regions repainted by Qt, it doesn't need any view
+	m_scene->addWidget(m_widget);
+
+	connect(m_scene, &QGraphicsScene::changed, this, [this](const QList<QRectF>& i_regions)
+	{
+		for (const QRectF& region : i_regions)
+			m_dirtyRegion += region.toAlignedRect();
+	});
+}
+
+COpenVROpenGLWidget::COverlayPanel::~COverlayPanel()
+{
+	DestroyOverlay();
+
+	if (m_glTexture)
+	{
+		if (!m_bGLInitialized)
+			initializeOpenGLFunctions();
+		CGpuMemoryTracker::Untrack(GL_TEXTURE, m_glTexture);
+		glDeleteTextures(1, &m_glTexture);
+	}
+
+	// the widget is deleted with the scene
+}
+
+bool COpenVROpenGLWidget::COverlayPanel::CreateOverlay()
+{
+	QString name = m_widget->windowTitle().isEmpty() ? m_sKey : m_widget->windowTitle();
+	vr::EVROverlayError error = vr::VROverlay()->CreateOverlay(m_sKey.toUtf8().constData(), name.toUtf8().constData(), &m_overlayHandle);
+	if (error != vr::VROverlayError_None)
+	{
+		qDebug() << "Unable to create overlay" << m_sKey << "-" << vr::VROverlay()->GetOverlayErrorNameFromEnum(error);
+		m_overlayHandle = vr::k_ulOverlayHandleInvalid;
+		return false;
+	}
+
+	applyProperties();
+
+	// the new overlay has no texture yet
+	m_dirtyRegion = QRect(QPoint(0, 0), m_textureSize);
+
+	return true;
+}
+
+void COpenVROpenGLWidget::COverlayPanel::DestroyOverlay()
+{
+	if (m_overlayHandle == vr::k_ulOverlayHandleInvalid)
+		return;
+
+	vr::VROverlay()->DestroyOverlay(m_overlayHandle);
+	m_overlayHandle = vr::k_ulOverlayHandleInvalid;
+}
+
+void COpenVROpenGLWidget::COverlayPanel::applyProperties()
+{
+	if (m_overlayHandle == vr::k_ulOverlayHandleInvalid)
+		return;
+
+	vr::HmdMatrix34_t transform = COpenVROpenGLWidget::qtMatrixToVr(m_transform);
+	vr::VROverlay()->SetOverlayWidthInMeters(m_overlayHandle, m_fWidthInMeters);
+	vr::VROverlay()->SetOverlayTransformAbsolute(m_overlayHandle, vr::TrackingUniverseStanding, &transform);
+
+	if (m_bVisible)
+		vr::VROverlay()->ShowOverlay(m_overlayHandle);
+	else
+		vr::VROverlay()->HideOverlay(m_overlayHandle);
+}
+
+void COpenVROpenGLWidget::COverlayPanel::Update()
+{
+	if (m_overlayHandle == vr::k_ulOverlayHandleInvalid || !m_bVisible)
+		return;
+
+	if (!m_bGLInitialized)
+	{
+		initializeOpenGLFunctions();
+		m_bGLInitialized = true;
+	}
+
+	// (re)create the texture at the size of the widget
+	if (!m_glTexture || m_widget->size() != m_textureSize)
+	{
+		if (m_glTexture)
+		{
+			CGpuMemoryTracker::Untrack(GL_TEXTURE, m_glTexture);
+			glDeleteTextures(1, &m_glTexture);
+		}
+
+		m_textureSize = m_widget->size();
+		glCreateTextures(GL_TEXTURE_2D, 1, &m_glTexture);
+		glTextureStorage2D(m_glTexture, 1, GL_RGBA8, m_textureSize.width(), m_textureSize.height());
+		CGpuMemoryTracker::Track(GpuMemoryPanels, GL_TEXTURE, m_glTexture, CGpuMemoryTracker::TextureBytes(m_textureSize, GL_RGBA8));
+		glTextureParameteri(m_glTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(m_glTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		m_dirtyRegion = QRect(QPoint(0, 0), m_textureSize);
+	}
+
+	m_dirtyRegion &= QRect(QPoint(0, 0), m_textureSize);
+	if (m_dirtyRegion.isEmpty())
+		return;
+
+	// the bounding rectangle of the repainted regions is rendered and uploaded at once
+	QRect dirtyRect = m_dirtyRegion.boundingRect();
+	m_dirtyRegion = QRegion();
+
+	QImage image(dirtyRect.size(), QImage::Format_RGBA8888);
+	image.fill(Qt::transparent);
+
+	QPainter painter(&image);
+	m_scene->render(&painter, QRectF(QPointF(0, 0), dirtyRect.size()), dirtyRect, Qt::IgnoreAspectRatio);
+	painter.end();
+
+	// the rows of OpenGL textures go bottom-up
+	image = image.mirrored();
+	glTextureSubImage2D(m_glTexture, 0, dirtyRect.x(), m_textureSize.height() - dirtyRect.bottom() - 1,
+		dirtyRect.width(), dirtyRect.height(), GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+
+	vr::Texture_t texture = { reinterpret_cast<void*>(static_cast<uintptr_t>(m_glTexture)), vr::TextureType_OpenGL, vr::ColorSpace_Auto };
+	vr::VROverlay()->SetOverlayTexture(m_overlayHandle, &texture);
+}
+
+void COpenVROpenGLWidget::COverlayPanel::ReleaseContext(bool i_bKeepTexture)
+{
+	if (!i_bKeepTexture && m_glTexture)
+	{
+		CGpuMemoryTracker::Untrack(GL_TEXTURE, m_glTexture);
+		glDeleteTextures(1, &m_glTexture);
+		m_glTexture = 0;
+	}
+
+	// the functions are resolved again in the next context
+	m_bGLInitialized = false;
+}
+
+void COpenVROpenGLWidget::COverlayPanel::SetTransform(const QMatrix4x4& i_transform)
+{
+	m_transform = i_transform;
+	applyProperties();
+}
+
+void COpenVROpenGLWidget::COverlayPanel::SetWidthInMeters(float i_fWidthInMeters)
+{
+	m_fWidthInMeters = i_fWidthInMeters;
+	applyProperties();
+}
+
+void COpenVROpenGLWidget::COverlayPanel::SetVisible(bool i_bVisible)
+{
+	m_bVisible = i_bVisible;
+	applyProperties();
+}
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	QT QUICK PANELS IN THE SCENE
+//
+
+#ifdef QT_QUICK_LIB
+
+#define QUICKPANEL_VERTEX_SHADER \
+	"#version 450\n" \
+	"uniform mat4 matrix;\n" \
+	"out vec2 v2TexCoord;\n" \
+	"void main()\n" \
+	"{\n" \
+	"	// triangle strip of the unit quad centered on the origin\n" \
+	"	v2TexCoord = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n" \
+	"	gl_Position = matrix * vec4(v2TexCoord - 0.5, 0.0, 1.0);\n" \
+	"}\n"
+
+#define QUICKPANEL_FRAGMENT_SHADER \
+	"#version 450 core\n" \
+	"uniform sampler2D diffuse;\n" \
+	"in vec2 v2TexCoord;\n" \
+	"layout(location = 0) out vec4 FragColor;\n" \
+	"void main()\n" \
+	"{\n" \
+	"   FragColor = texture( diffuse, v2TexCoord);\n" \
+	"}\n"
+
+COpenVROpenGLWidget::CQuickPanel::CQuickPanel(QOpenGLContext* i_shareContext, const QUrl& i_qmlSource, const QSize& i_size, float i_fWidthInMeters, const QMatrix4x4& i_transform) :
+	m_context(nullptr),
+	m_surface(nullptr),
+	m_renderControl(nullptr),
+	m_quickWindow(nullptr),
+	m_qmlEngine(nullptr),
+	m_qmlComponent(nullptr),
+	m_rootItem(nullptr),
+	m_frameBuffer(nullptr),
+	m_fence(nullptr),
+	m_size(i_size),
+	m_transform(i_transform),
+	m_fWidthInMeters(i_fWidthInMeters),
+	m_bDirty(true),
+	m_buttons(Qt::NoButton),
+	m_drawProgram(nullptr),
+	m_iMatrixLocation(-1),
+	m_glVertArray(0),
+	m_previousContext(nullptr),
+	m_previousSurface(nullptr),
+	m_iPreviousFramebuffer(0)
+{
+	initializeOpenGLFunctions();
+
+	m_renderControl = new QQuickRenderControl();
+	m_quickWindow = new QQuickWindow(m_renderControl);
+	m_quickWindow->setGeometry(0, 0, m_size.width(), m_size.height());
+
+	m_qmlEngine = new QQmlEngine();
+	if (!m_qmlEngine->incubationController())
+		m_qmlEngine->setIncubationController(m_quickWindow->incubationController());
+
+	// render only when the scene graph changes
+	connect(m_renderControl, &QQuickRenderControl::renderRequested, this, [this]() { m_bDirty = true; });
+	connect(m_renderControl, &QQuickRenderControl::sceneChanged, this, [this]() { m_bDirty = true; });
+
+	initializeRendering(i_shareContext);
+
+	m_qmlComponent = new QQmlComponent(m_qmlEngine, i_qmlSource);
+	if (m_qmlComponent->isLoading())
+		connect(m_qmlComponent, &QQmlComponent::statusChanged, this, [this]() { finishLoading(); });
+	else
+		finishLoading();
+}
+
+COpenVROpenGLWidget::CQuickPanel::~CQuickPanel()
+{
+	ReleaseContext(false);
+	destroyRendering();
+
+	delete m_qmlComponent;
+	delete m_quickWindow;
+	delete m_qmlEngine;
+	delete m_renderControl;
+}
+
+void COpenVROpenGLWidget::CQuickPanel::initializeRendering(QOpenGLContext* i_shareContext)
+{
+	m_context = new QOpenGLContext();
+	m_context->setFormat(i_shareContext->format());
+	m_context->setShareContext(i_shareContext);
+	m_context->create();
+
+	m_surface = new QOffscreenSurface();
+	m_surface->setFormat(m_context->format());
+	m_surface->create();
+
+	makeCurrent();
+	m_renderControl->initialize(m_context);
+	m_frameBuffer = new QOpenGLFramebufferObject(m_size, QOpenGLFramebufferObject::CombinedDepthStencil);
+	CGpuMemoryTracker::Track(GpuMemoryPanels, GL_TEXTURE, m_frameBuffer->texture(),
+		CGpuMemoryTracker::TextureBytes(m_size, GL_RGBA8) + CGpuMemoryTracker::TextureBytes(m_size, GL_DEPTH24_STENCIL8));
+	m_quickWindow->setRenderTarget(m_frameBuffer);
+	doneCurrent();
+
+	m_bDirty = true;
+}
+
+void COpenVROpenGLWidget::CQuickPanel::destroyRendering()
+{
+	if (!m_context)
+		return;
+
+	// the scene graph resources belong to the panel's context
+	makeCurrent();
+	m_renderControl->invalidate();
+	m_quickWindow->setRenderTarget(nullptr);
+	CGpuMemoryTracker::Untrack(GL_TEXTURE, m_frameBuffer->texture());
+	delete m_frameBuffer;
+	m_frameBuffer = nullptr;
+	if (m_fence)
+	{
+		m_context->extraFunctions()->glDeleteSync(m_fence);
+		m_fence = nullptr;
+	}
+	doneCurrent();
+
+	delete m_context;
+	m_context = nullptr;
+	delete m_surface;
+	m_surface = nullptr;
+}
+
+void COpenVROpenGLWidget::CQuickPanel::finishLoading()
+{
+	if (m_qmlComponent->isLoading())
+		return;
+
+	if (m_qmlComponent->isError())
+	{
+		for (const QQmlError& error : m_qmlComponent->errors())
+			qDebug() << error.toString();
+		return;
+	}
+
+	QObject* rootObject = m_qmlComponent->create();
+	m_rootItem = qobject_cast<QQuickItem*>(rootObject);
+	if (!m_rootItem)
+	{
+		qDebug() << "The root object of the QML panel" << m_qmlComponent->url() << "is not an item.";
+		delete rootObject;
+		return;
+	}
+
+	m_rootItem->setParentItem(m_quickWindow->contentItem());
+	m_rootItem->setSize(QSizeF(m_size));
+	m_bDirty = true;
+}
+
+void COpenVROpenGLWidget::CQuickPanel::UpdateTexture()
+{
+	if (!m_bDirty || !m_rootItem || !m_context)
+		return;
+
+	m_bDirty = false;
+
+	makeCurrent();
+
+	m_renderControl->polishItems();
+	m_renderControl->sync();
+	m_renderControl->render();
+	m_quickWindow->resetOpenGLState();
+
+	// the texture is sampled by the widget's context: it waits for this fence
+	if (m_fence)
+		m_context->extraFunctions()->glDeleteSync(m_fence);
+	m_fence = m_context->extraFunctions()->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_context->functions()->glFlush();
+
+	doneCurrent();
+}
+
+void COpenVROpenGLWidget::CQuickPanel::makeCurrent()
+{
+	m_previousContext = QOpenGLContext::currentContext();
+	m_previousSurface = m_previousContext ? m_previousContext->surface() : nullptr;
+	m_iPreviousFramebuffer = 0;
+	if (m_previousContext)
+		m_previousContext->functions()->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &m_iPreviousFramebuffer);
+
+	m_context->makeCurrent(m_surface);
+}
+
+void COpenVROpenGLWidget::CQuickPanel::doneCurrent()
+{
+	m_context->doneCurrent();
+
+	// in paintGL(), the widget renders into its own frame buffer, not the default one of the surface
+	if (m_previousContext)
+	{
+		m_previousContext->makeCurrent(m_previousSurface);
+		m_previousContext->functions()->glBindFramebuffer(GL_FRAMEBUFFER, m_iPreviousFramebuffer);
+	}
+	m_previousContext = nullptr;
+	m_previousSurface = nullptr;
+}
+
+void COpenVROpenGLWidget::CQuickPanel::Draw(const QMatrix4x4& i_viewProjection, CGLStateCache* i_glState)
+{
+	if (!m_rootItem || !m_frameBuffer)
+		return;
+
+	if (!m_drawProgram)
+	{
+		// created lazily, in the widget's context
+		initializeOpenGLFunctions();
+
+		m_drawProgram = new QOpenGLShaderProgram();
+		if (!m_drawProgram->addShaderFromSourceCode(QOpenGLShader::Vertex, QUICKPANEL_VERTEX_SHADER) ||
+			!m_drawProgram->addShaderFromSourceCode(QOpenGLShader::Fragment, QUICKPANEL_FRAGMENT_SHADER) ||
+			!m_drawProgram->link())
+		{
+			qDebug() << m_drawProgram->log();
+		}
+		CGpuMemoryTracker::TrackProgram(m_drawProgram);
+
+		m_iMatrixLocation = m_drawProgram->uniformLocation("matrix");
+		m_drawProgram->bind();
+		m_drawProgram->setUniformValue("diffuse", 0);
+		m_drawProgram->release();
+		i_glState->Invalidate();
+
+		glCreateVertexArrays(1, &m_glVertArray);
+	}
+
+	if (m_fence)
+	{
+		glWaitSync(m_fence, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(m_fence);
+		m_fence = nullptr;
+	}
+
+	const float height = m_fWidthInMeters * m_size.height() / m_size.width();
+	QMatrix4x4 model = m_transform;
+	model.scale(m_fWidthInMeters, height, 1.0f);
+
+	// Qt Quick renders premultiplied colors
+	i_glState->Enable(GL_BLEND);
+	i_glState->BlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	i_glState->Disable(GL_CULL_FACE);
+
+	i_glState->UseProgram(m_drawProgram->programId());
+	m_drawProgram->setUniformValue(m_iMatrixLocation, i_viewProjection * model);
+
+	i_glState->BindVertexArray(m_glVertArray);
+	i_glState->ActiveTexture(GL_TEXTURE0);
+	i_glState->BindTexture(GL_TEXTURE_2D, m_frameBuffer->texture());
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	i_glState->Disable(GL_BLEND);
+}
+
+bool COpenVROpenGLWidget::CQuickPanel::Intersect(const QVector3D& i_origin, const QVector3D& i_direction, float* o_distance, QPointF* o_position) const
+{
+	// in the quad space, the quad is in the plane z = 0
+	QMatrix4x4 sceneToQuad = m_transform.inverted();
+	QVector3D origin = sceneToQuad.map(i_origin);
+	QVector3D direction = sceneToQuad.mapVector(i_direction);
+	if (qFuzzyIsNull(direction.z()))
+		return false;
+
+	float distance = -origin.z() / direction.z();
+	if (distance < 0.0f)
+		return false;
+
+	QVector3D hit = origin + distance * direction;
+	const float height = m_fWidthInMeters * m_size.height() / m_size.width();
+	float u = hit.x() / m_fWidthInMeters + 0.5f;
+	float v = 0.5f - hit.y() / height;
+	if (u < 0.0f || u > 1.0f || v < 0.0f || v > 1.0f)
+		return false;
+
+	*o_distance = distance;
+	*o_position = QPointF(u * m_size.width(), v * m_size.height());
+	return true;
+}
+
+void COpenVROpenGLWidget::CQuickPanel::SendMouseEvent(const QPointF& i_position, Qt::MouseButtons i_buttons)
+{
+	QEvent::Type type = QEvent::MouseMove;
+	Qt::MouseButton button = Qt::NoButton;
+	if (i_buttons != m_buttons)
+	{
+		type = (i_buttons & ~m_buttons) ? QEvent::MouseButtonPress : QEvent::MouseButtonRelease;
+		button = Qt::LeftButton;
+	}
+	m_buttons = i_buttons;
+
+	QMouseEvent event(type, i_position, i_position, i_position, button, i_buttons, Qt::NoModifier);
+	QCoreApplication::sendEvent(m_quickWindow, &event);
+}
+
+void COpenVROpenGLWidget::CQuickPanel::ReleaseContext(bool i_bKeepTexture)
+{
+	if (m_drawProgram)
+	{
+		glDeleteVertexArrays(1, &m_glVertArray);
+		m_glVertArray = 0;
+		CGpuMemoryTracker::UntrackProgram(m_drawProgram);
+		delete m_drawProgram;
+		m_drawProgram = nullptr;
+	}
+
+	// the panel's context shares the dying context's resources: it must be recreated with the new one
+	if (!i_bKeepTexture)
+		destroyRendering();
+}
+
+void COpenVROpenGLWidget::CQuickPanel::RestoreContext(QOpenGLContext* i_shareContext)
+{
+	if (!m_context)
+		initializeRendering(i_shareContext);
+}
+
+#endif // QT_QUICK_LIB
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	GPU PASSES AND TARGETS SHARED BY BOTH EYES
+//
+
+void COpenVROpenGLWidget::AddFramePass(const QString& i_sName, const std::function<void()>& i_pass)
+{
+	AddFramePass(i_sName, i_pass, QStringList(), QStringList());
+}
+
+void COpenVROpenGLWidget::AddFramePass(const QString& i_sName, const std::function<void()>& i_pass, const QStringList& i_inputs, const QStringList& i_outputs)
+{
+	m_bFramePassesDirty = true;
+	for (SFramePass& pass : m_framePasses)
+	{
+		if (pass.m_sName == i_sName)
+		{
+			pass.m_function = i_pass;
+			pass.m_inputs = i_inputs;
+			pass.m_outputs = i_outputs;
+			return;
+		}
+	}
+
+	SFramePass pass;
+	pass.m_sName = i_sName;
+	pass.m_function = i_pass;
+	pass.m_pTimer = new CGpuTimer();
+	pass.m_inputs = i_inputs;
+	pass.m_outputs = i_outputs;
+	m_framePasses.append(pass);
+}
+
+void COpenVROpenGLWidget::RemoveFramePass(const QString& i_sName)
+{
+	for (int i = 0; i < m_framePasses.size(); i++)
+	{
+		if (m_framePasses[i].m_sName == i_sName)
+		{
+			delete m_framePasses[i].m_pTimer;
+			if (m_framePasses[i].m_glFrameBuffer)
+				glDeleteFramebuffers(1, &m_framePasses[i].m_glFrameBuffer);
+			m_framePasses.remove(i);
+			m_bFramePassesDirty = true;
+			return;
+		}
+	}
+}
+
+float COpenVROpenGLWidget::GetFramePassTime(const QString& i_sName) const
+{
+	for (const SFramePass& pass : m_framePasses)
+	{
+		if (pass.m_sName == i_sName)
+			return pass.m_pTimer->GetTime();
+	}
+	return -1.0f;
+}
+
+COpenVROpenGLWidget::CFrameTarget* COpenVROpenGLWidget::AddFrameTarget(const QString& i_sName, const QSize& i_size, GLenum i_glFormat, bool i_bHistory, int i_iLevels)
+{
+	RemoveFrameTarget(i_sName);
+
+	CFrameTarget* target = new CFrameTarget(i_sName, i_size, i_glFormat, i_bHistory, i_iLevels);
+	m_frameTargets.append(target);
+	return target;
+}
+
+COpenVROpenGLWidget::CFrameTarget* COpenVROpenGLWidget::GetFrameTarget(const QString& i_sName) const
+{
+	for (CFrameTarget* target : m_frameTargets)
+	{
+		if (target->GetName() == i_sName)
+			return target;
+	}
+	return nullptr;
+}
+
+void COpenVROpenGLWidget::RemoveFrameTarget(const QString& i_sName)
+{
+	CFrameTarget* target = GetFrameTarget(i_sName);
+	if (!target)
+		return;
+
+	m_frameTargets.removeOne(target);
+	delete target;
+}
+
+void COpenVROpenGLWidget::AddTransientTarget(const QString& i_sName, const QSize& i_size, GLenum i_glFormat)
+{
+	RemoveTransientTarget(i_sName);
+
+	STransientTarget target;
+	target.m_sName = i_sName;
+	target.m_size = i_size;
+	target.m_glFormat = i_glFormat;
+	m_transientTargets.append(target);
+	m_bFramePassesDirty = true;
+}
+
+void COpenVROpenGLWidget::RemoveTransientTarget(const QString& i_sName)
+{
+	int target = findTransientTarget(i_sName);
+	if (target < 0)
+		return;
+
+	m_transientTargets.remove(target);
+	m_bFramePassesDirty = true;
+}
+
+int COpenVROpenGLWidget::findTransientTarget(const QString& i_sName) const
+{
+	for (int i = 0; i < m_transientTargets.size(); i++)
+	{
+		if (m_transientTargets[i].m_sName == i_sName)
+			return i;
+	}
+	return -1;
+}
+
+GLuint COpenVROpenGLWidget::GetTransientTexture(const QString& i_sName) const
+{
+	int target = findTransientTarget(i_sName);
+	if (target < 0 || m_transientTargets[target].m_iTexture < 0)
+		return 0;
+	return m_transientTextures[m_transientTargets[target].m_iTexture].m_glTexture;
+}
+
+qint64 COpenVROpenGLWidget::GetTransientMemory() const
+{
+	qint64 memory = 0;
+	for (const STransientTexture& texture : m_transientTextures)
+		memory += static_cast<qint64>(texture.m_size.width()) * texture.m_size.height() * CFrameTarget::BytesPerPixel(texture.m_glFormat);
+	return memory;
+}
+
+qint64 COpenVROpenGLWidget::GetTransientMemorySaved() const
+{
+	return m_iTransientMemoryNeeded - GetTransientMemory();
+}
+
+void COpenVROpenGLWidget::destroyTransientTextures()
+{
+	for (STransientTexture& texture : m_transientTextures)
+	{
+		CGpuMemoryTracker::Untrack(GL_TEXTURE, texture.m_glTexture);
+		glDeleteTextures(1, &texture.m_glTexture);
+	}
+	m_transientTextures.clear();
+
+	for (STransientTarget& target : m_transientTargets)
+		target.m_iTexture = -1;
+	m_bFramePassesDirty = true;
+}
+
+GLuint COpenVROpenGLWidget::getFramePassTarget(const QString& i_sName, QSize& o_size, GLenum& o_glFormat) const
+{
+	if (CFrameTarget* frameTarget = GetFrameTarget(i_sName))
+	{
+		o_size = frameTarget->GetSize();
+		o_glFormat = frameTarget->GetFormat();
+		return frameTarget->Texture();
+	}
+
+	int target = findTransientTarget(i_sName);
+	if (target < 0 || m_transientTargets[target].m_iTexture < 0)
+		return 0;
+
+	o_size = m_transientTargets[target].m_size;
+	o_glFormat = m_transientTargets[target].m_glFormat;
+	return m_transientTextures[m_transientTargets[target].m_iTexture].m_glTexture;
+}
+
+void COpenVROpenGLWidget::compileFramePasses()
+{
+	m_bFramePassesDirty = false;
+
+	// each pass runs after the passes writing its inputs, in order of registration otherwise
+	QVector<SFramePass> orderedPasses;
+	QVector<bool> ordered(m_framePasses.size(), false);
+	while (orderedPasses.size() < m_framePasses.size())
+	{
+		int next = -1;
+		for (int i = 0; i < m_framePasses.size() && next < 0; i++)
+		{
+			bool ready = !ordered[i];
+			for (int j = 0; j < m_framePasses.size() && ready; j++)
+			{
+				if (ordered[j] || j == i)
+					continue;
+				for (const QString& input : m_framePasses[i].m_inputs)
+					ready &= !m_framePasses[j].m_outputs.contains(input);
+			}
+			if (ready)
+				next = i;
+		}
+
+		// a cycle: the remaining passes keep their order
+		if (next < 0)
+		{
+			qCritical() << "The frame passes depend on each other in a cycle.";
+			next = ordered.indexOf(false);
+		}
+
+		ordered[next] = true;
+		orderedPasses.append(m_framePasses[next]);
+	}
+	m_framePasses = orderedPasses;
+
+	// the lifetime of each transient target, from the first pass writing it to the last pass using it
+	QVector<int> lastPasses(m_transientTargets.size(), -1);
+	for (STransientTarget& target : m_transientTargets)
+	{
+		target.m_iFirstPass = -1;
+		target.m_iTexture = -1;
+	}
+	for (int i = 0; i < m_framePasses.size(); i++)
+	{
+		SFramePass& pass = m_framePasses[i];
+		pass.m_releasedTargets.clear();
+		pass.m_bBarrier = false;
+
+		for (const QString& output : pass.m_outputs)
+		{
+			int target = findTransientTarget(output);
+			if (target < 0)
+				continue;
+			if (m_transientTargets[target].m_iFirstPass < 0)
+				m_transientTargets[target].m_iFirstPass = i;
+			lastPasses[target] = i;
+		}
+
+		for (const QString& input : pass.m_inputs)
+		{
+			int target = findTransientTarget(input);
+			if (target >= 0)
+				lastPasses[target] = qMax(lastPasses[target], i);
+			for (int j = 0; j < i; j++)
+				pass.m_bBarrier |= m_framePasses[j].m_outputs.contains(input);
+		}
+	}
+
+	// the targets whose lifetimes don't overlap share a texture of the same size and format
+	QVector<bool> busy(m_transientTextures.size(), false);
+	QVector<bool> used(m_transientTextures.size(), false);
+	m_iTransientMemoryNeeded = 0;
+	for (int i = 0; i < m_framePasses.size(); i++)
+	{
+		for (int t = 0; t < m_transientTargets.size(); t++)
+		{
+			STransientTarget& target = m_transientTargets[t];
+			if (target.m_iFirstPass != i)
+				continue;
+
+			for (int k = 0; k < m_transientTextures.size() && target.m_iTexture < 0; k++)
+			{
+				if (!busy[k] && m_transientTextures[k].m_size == target.m_size && m_transientTextures[k].m_glFormat == target.m_glFormat)
+					target.m_iTexture = k;
+			}
+
+			if (target.m_iTexture < 0)
+			{
+				STransientTexture texture;
+				texture.m_size = target.m_size;
+				texture.m_glFormat = target.m_glFormat;
+				glCreateTextures(GL_TEXTURE_2D, 1, &texture.m_glTexture);
+				glTextureStorage2D(texture.m_glTexture, 1, texture.m_glFormat, texture.m_size.width(), texture.m_size.height());
+				CGpuMemoryTracker::Track(GpuMemoryFrameTargets, GL_TEXTURE, texture.m_glTexture,
+					CGpuMemoryTracker::TextureBytes(texture.m_size, texture.m_glFormat));
+				glTextureParameteri(texture.m_glTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glTextureParameteri(texture.m_glTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				glTextureParameteri(texture.m_glTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glTextureParameteri(texture.m_glTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				m_transientTextures.append(texture);
+				busy.append(false);
+				used.append(false);
+				target.m_iTexture = m_transientTextures.size() - 1;
+			}
+
+			busy[target.m_iTexture] = true;
+			used[target.m_iTexture] = true;
+			m_iTransientMemoryNeeded += static_cast<qint64>(target.m_size.width()) * target.m_size.height() * CFrameTarget::BytesPerPixel(target.m_glFormat);
+			m_framePasses[lastPasses[t]].m_releasedTargets.append(t);
+		}
+
+		for (int t : m_framePasses[i].m_releasedTargets)
+			busy[m_transientTargets[t].m_iTexture] = false;
+	}
+
+	// the textures no target needs anymore
+	QVector<int> remap(m_transientTextures.size(), -1);
+	QVector<STransientTexture> textures;
+	for (int k = 0; k < m_transientTextures.size(); k++)
+	{
+		if (used[k])
+		{
+			remap[k] = textures.size();
+			textures.append(m_transientTextures[k]);
+		}
+		else
+		{
+			CGpuMemoryTracker::Untrack(GL_TEXTURE, m_transientTextures[k].m_glTexture);
+			glDeleteTextures(1, &m_transientTextures[k].m_glTexture);
+		}
+	}
+	m_transientTextures = textures;
+	for (STransientTarget& target : m_transientTargets)
+	{
+		if (target.m_iTexture >= 0)
+			target.m_iTexture = remap[target.m_iTexture];
+		else
+			qDebug() << "The transient target" << target.m_sName << "isn't written by any frame pass.";
+	}
+
+	// the frame buffers of the outputs
+	for (SFramePass& pass : m_framePasses)
+	{
+		if (!pass.m_outputs.isEmpty() && !pass.m_glFrameBuffer)
+			glCreateFramebuffers(1, &pass.m_glFrameBuffer);
+		else if (pass.m_outputs.isEmpty() && pass.m_glFrameBuffer)
+		{
+			glDeleteFramebuffers(1, &pass.m_glFrameBuffer);
+			pass.m_glFrameBuffer = 0;
+		}
+	}
+}
+
+void COpenVROpenGLWidget::bindFramePassOutputs(int i_iPass)
+{
+	const SFramePass& pass = m_framePasses[i_iPass];
+	QVector<GLenum> drawBuffers;
+	QVector<GLenum> discarded;
+	QSize size;
+
+	for (const QString& output : pass.m_outputs)
+	{
+		QSize targetSize;
+		GLenum format;
+		GLuint texture = getFramePassTarget(output, targetSize, format);
+		if (!texture)
+			continue;
+		if (!size.isValid())
+			size = targetSize;
+
+		GLenum attachment = CFrameTarget::Attachment(format);
+		if (attachment == GL_COLOR_ATTACHMENT0)
+		{
+			attachment = GL_COLOR_ATTACHMENT0 + drawBuffers.size();
+			drawBuffers.append(attachment);
+		}
+		glNamedFramebufferTexture(pass.m_glFrameBuffer, attachment, texture, 0);
+
+		// the content left by the targets sharing the texture is meaningless
+		int target = findTransientTarget(output);
+		if (target >= 0 && m_transientTargets[target].m_iFirstPass == i_iPass)
+			discarded.append(attachment);
+	}
+
+	// none of the outputs exists, there is nothing to bind nor a size for the viewport
+	if (!size.isValid())
+		return;
+
+	if (drawBuffers.isEmpty())
+		glNamedFramebufferDrawBuffer(pass.m_glFrameBuffer, GL_NONE);
+	else
+		glNamedFramebufferDrawBuffers(pass.m_glFrameBuffer, drawBuffers.size(), drawBuffers.constData());
+	if (!discarded.isEmpty())
+		glInvalidateNamedFramebufferData(pass.m_glFrameBuffer, discarded.size(), discarded.constData());
+
+	glBindFramebuffer(GL_FRAMEBUFFER, pass.m_glFrameBuffer);
+	m_glState->Viewport(0, 0, size.width(), size.height());
+}
+
+void COpenVROpenGLWidget::runFramePasses()
+{
+	// the passes and the eyes use the poses of this frame
+	updateFrameUniforms();
+
+	// the targets of the previous frame become the history
+	for (CFrameTarget* target : m_frameTargets)
+		target->Swap();
+
+	if (m_framePasses.isEmpty())
+		return;
+
+	if (m_bFramePassesDirty)
+		compileFramePasses();
+
+	for (int i = 0; i < m_framePasses.size(); i++)
+	{
+		SFramePass& pass = m_framePasses[i];
+
+		// the targets written by the previous passes are read by this one
+		if (pass.m_bBarrier)
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+
+		pass.m_pTimer->Begin();
+		if (pass.m_glFrameBuffer)
+			bindFramePassOutputs(i);
+		pass.m_function();
+		pass.m_pTimer->End();
+
+		// the transient targets not used anymore lend their texture to the next ones
+		for (int target : pass.m_releasedTargets)
+			glInvalidateTexImage(m_transientTextures[m_transientTargets[target].m_iTexture].m_glTexture, 0);
+	}
+
+	// the passes may have changed any state
+	glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+	if (!m_bGLStateCacheExclusive)
+		m_glState->Invalidate();
+}
+
+void COpenVROpenGLWidget::updateFrameUniforms()
+{
+	SFrameUniforms uniforms;
+
+	const QMatrix4x4 sceneToHead = m_hmdPose * GetCameraMatrix();
+	memcpy(uniforms.m_sceneToHead, sceneToHead.constData(), sizeof(uniforms.m_sceneToHead));
+
+	for (int eye = 0; eye < 2; eye++)
+	{
+		m_eyeViewProjections[eye] = m_mirrorProjection * sceneToHead;
+		if (m_eyeInfos[eye])
+			m_eyeViewProjections[eye] = m_eyeInfos[eye]->GetProjectionMatrix() * m_eyeInfos[eye]->GetViewMatrix() * sceneToHead;
+		memcpy(uniforms.m_eyeViewProjection[eye], m_eyeViewProjections[eye].constData(), sizeof(uniforms.m_eyeViewProjection[eye]));
+	}
+
+	// without the vr system, the mirror view is the head
+	if (!m_vrSystem)
+	{
+		m_headTangents[1] = 1.0f / m_mirrorProjection(0, 0);
+		m_headTangents[0] = -m_headTangents[1];
+		m_headTangents[3] = 1.0f / m_mirrorProjection(1, 1);
+		m_headTangents[2] = -m_headTangents[3];
+	}
+	memcpy(uniforms.m_headTangents, m_headTangents, sizeof(uniforms.m_headTangents));
+
+	uniforms.m_clipPlanes[0] = NEAR_CLIP;
+	uniforms.m_clipPlanes[1] = FAR_CLIP;
+	uniforms.m_clipPlanes[2] = uniforms.m_clipPlanes[3] = 0.0f;
+
+	glNamedBufferSubData(m_glFrameUniforms, 0, sizeof(SFrameUniforms), &uniforms);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, m_glFrameUniforms);
+}
+
+COpenVROpenGLWidget::CFrameTarget::CFrameTarget(const QString& i_sName, const QSize& i_size, GLenum i_glFormat, bool i_bHistory, int i_iLevels) :
+	m_sName(i_sName),
+	m_size(i_size),
+	m_glFormat(i_glFormat),
+	m_iLevels(qMax(i_iLevels, 1)),
+	m_bHistory(i_bHistory),
+	m_iCurrent(0)
+{
+	initializeOpenGLFunctions();
+
+	m_glTextures[0] = m_glTextures[1] = 0;
+	m_glFrameBuffers[0] = m_glFrameBuffers[1] = 0;
+
+	for (int i = 0; i < (m_bHistory ? 2 : 1); i++)
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &m_glTextures[i]);
+		glTextureStorage2D(m_glTextures[i], m_iLevels, m_glFormat, m_size.width(), m_size.height());
+		CGpuMemoryTracker::Track(GpuMemoryFrameTargets, GL_TEXTURE, m_glTextures[i],
+			CGpuMemoryTracker::TextureBytes(m_size, m_glFormat, m_iLevels));
+		glTextureParameteri(m_glTextures[i], GL_TEXTURE_MIN_FILTER, (m_iLevels > 1) ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+		glTextureParameteri(m_glTextures[i], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(m_glTextures[i], GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(m_glTextures[i], GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	createFrameBuffers();
+}
+
+COpenVROpenGLWidget::CFrameTarget::~CFrameTarget()
+{
+	destroyFrameBuffers();
+	for (int i = 0; i < (m_bHistory ? 2 : 1); i++)
+		CGpuMemoryTracker::Untrack(GL_TEXTURE, m_glTextures[i]);
+	glDeleteTextures(m_bHistory ? 2 : 1, m_glTextures);
+}
+
+GLenum COpenVROpenGLWidget::CFrameTarget::Attachment(GLenum i_glFormat)
+{
+	switch (i_glFormat)
+	{
+	case GL_DEPTH_COMPONENT16:
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32:
+	case GL_DEPTH_COMPONENT32F:
+		return GL_DEPTH_ATTACHMENT;
+
+	case GL_DEPTH24_STENCIL8:
+	case GL_DEPTH32F_STENCIL8:
+		return GL_DEPTH_STENCIL_ATTACHMENT;
+	}
+	return GL_COLOR_ATTACHMENT0;
+}
+
+int COpenVROpenGLWidget::CFrameTarget::BytesPerPixel(GLenum i_glFormat)
+{
+	switch (i_glFormat)
+	{
+	case GL_R8:
+		return 1;
+
+	case GL_RG8:
+	case GL_R16:
+	case GL_R16F:
+	case GL_DEPTH_COMPONENT16:
+		return 2;
+
+	case GL_RGB8:
+		return 3;
+
+	case GL_RGB16:
+	case GL_RGB16F:
+		return 6;
+
+	case GL_RGBA16:
+	case GL_RGBA16F:
+	case GL_RG32F:
+	case GL_DEPTH32F_STENCIL8:
+		return 8;
+
+	case GL_RGB32F:
+		return 12;
+
+	case GL_RGBA32F:
+		return 16;
+	}
+	return 4;
+}
+
+void COpenVROpenGLWidget::CFrameTarget::createFrameBuffers()
+{
+	const GLenum attachment = Attachment(m_glFormat);
+	for (int i = 0; i < (m_bHistory ? 2 : 1); i++)
+	{
+		glCreateFramebuffers(1, &m_glFrameBuffers[i]);
+		glNamedFramebufferTexture(m_glFrameBuffers[i], attachment, m_glTextures[i], 0);
+		if (attachment != GL_COLOR_ATTACHMENT0)
+			glNamedFramebufferDrawBuffer(m_glFrameBuffers[i], GL_NONE);
+	}
+}
+
+void COpenVROpenGLWidget::CFrameTarget::destroyFrameBuffers()
+{
+	glDeleteFramebuffers(m_bHistory ? 2 : 1, m_glFrameBuffers);
+	m_glFrameBuffers[0] = m_glFrameBuffers[1] = 0;
+}
+
+void COpenVROpenGLWidget::CFrameTarget::Bind(CGLStateCache* i_glState)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_glFrameBuffers[m_iCurrent]);
+	i_glState->Viewport(0, 0, m_size.width(), m_size.height());
+}
+
+void COpenVROpenGLWidget::CFrameTarget::Swap()
+{
+	if (m_bHistory)
+		m_iCurrent = 1 - m_iCurrent;
+}
+
+void COpenVROpenGLWidget::CFrameTarget::releaseObjects()
+{
+	destroyFrameBuffers();
+}
+
+void COpenVROpenGLWidget::CFrameTarget::restoreObjects()
+{
+	createFrameBuffers();
+}
+
+COpenVROpenGLWidget::CGpuTimer::CGpuTimer() :
+	m_uiFrame(0),
+	m_fTime(-1.0f)
+{
+	initializeOpenGLFunctions();
+	glCreateQueries(GL_TIMESTAMP, s_latency * 2, &m_glQueries[0][0]);
+}
+
+COpenVROpenGLWidget::CGpuTimer::~CGpuTimer()
+{
+	ReleaseContext();
+}
+
+void COpenVROpenGLWidget::CGpuTimer::releaseObjects()
+{
+	if (m_glQueries[0][0])
+	{
+		glDeleteQueries(s_latency * 2, &m_glQueries[0][0]);
+		m_glQueries[0][0] = 0;
+	}
+}
+
+void COpenVROpenGLWidget::CGpuTimer::restoreObjects()
+{
+	// the pending measures are lost with the queries
+	glCreateQueries(GL_TIMESTAMP, s_latency * 2, &m_glQueries[0][0]);
+	m_uiFrame = 0;
+}
+
+void COpenVROpenGLWidget::CGpuTimer::Begin()
+{
+	GLuint* queries = m_glQueries[m_uiFrame % s_latency];
+
+	// the queries of this slot were issued s_latency frames ago: read them if the GPU is done, never wait
+	if (m_uiFrame >= s_latency)
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 begin, end;
+			glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+			m_fTime = static_cast<float>(end - begin) / 1000000.0f;
+		}
+	}
+
+	glQueryCounter(queries[0], GL_TIMESTAMP);
+}
+
+void COpenVROpenGLWidget::CGpuTimer::End()
+{
+	glQueryCounter(m_glQueries[m_uiFrame % s_latency][1], GL_TIMESTAMP);
+	m_uiFrame++;
+}
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	CLUSTERED LIGHTING
+//
+
+#define CLUSTER_STRIDE	(CLUSTER_MAX_LIGHTS + 1)
+
+#define FRAME_UNIFORMS_GLSL \
+	"layout(std140, binding = " QT_STRINGIFY(FRAME_UNIFORMS_BINDING) ") uniform FrameUniforms\n" \
+	"{\n" \
+	"	mat4 sceneToHead;\n" \
+	"	mat4 eyeViewProjection[2];\n" \
+	"	vec4 headTangents;\n" \
+	"	vec4 clipPlanes;\n" \
+	"};\n"
+
+#define CLUSTER_COMMON_GLSL \
+	"const uvec3 clusterGrid = uvec3(" QT_STRINGIFY(CLUSTER_GRID_X) ", " QT_STRINGIFY(CLUSTER_GRID_Y) ", " QT_STRINGIFY(CLUSTER_GRID_Z) ");\n" \
+	"const uint clusterStride = " QT_STRINGIFY(CLUSTER_STRIDE) ";\n" \
+	"struct Light\n" \
+	"{\n" \
+	"	vec4 positionRadius;\n" \
+	"	vec4 colorIntensity;\n" \
+	"};\n" \
+	"layout(std430, binding = " QT_STRINGIFY(LIGHTS_BINDING) ") readonly buffer Lights\n" \
+	"{\n" \
+	"	Light lights[];\n" \
+	"};\n"
+
+#define CLUSTER_BUILD_COMPUTE_SHADER \
+	"#version 450\n" \
+	"layout(local_size_x = " QT_STRINGIFY(CLUSTER_BUILD_GROUP_SIZE) ") in;\n" \
+	FRAME_UNIFORMS_GLSL \
+	CLUSTER_COMMON_GLSL \
+	"layout(std430, binding = " QT_STRINGIFY(CLUSTER_LIGHTS_BINDING) ") writeonly buffer ClusterLights\n" \
+	"{\n" \
+	"	uint clusterLights[];\n" \
+	"};\n" \
+	"uniform uint lightCount;\n" \
+	"void main()\n" \
+	"{\n" \
+	"	uint cluster = gl_GlobalInvocationID.x;\n" \
+	"	if (cluster >= clusterGrid.x * clusterGrid.y * clusterGrid.z)\n" \
+	"		return;\n" \
+	"	uvec3 cell = uvec3(cluster % clusterGrid.x, (cluster / clusterGrid.x) % clusterGrid.y, cluster / (clusterGrid.x * clusterGrid.y));\n" \
+	"	// the bounding box of the cluster, in the space of the center of the head\n" \
+	"	vec2 tangentMin = mix(headTangents.xz, headTangents.yw, vec2(cell.xy) / vec2(clusterGrid.xy));\n" \
+	"	vec2 tangentMax = mix(headTangents.xz, headTangents.yw, vec2(cell.xy + 1u) / vec2(clusterGrid.xy));\n" \
+	"	float near = clipPlanes.x * pow(clipPlanes.y / clipPlanes.x, float(cell.z) / float(clusterGrid.z));\n" \
+	"	float far = clipPlanes.x * pow(clipPlanes.y / clipPlanes.x, float(cell.z + 1u) / float(clusterGrid.z));\n" \
+	"	vec3 boxMin = vec3(min(tangentMin * near, tangentMin * far), -far);\n" \
+	"	vec3 boxMax = vec3(max(tangentMax * near, tangentMax * far), -near);\n" \
+	"	uint offset = cluster * clusterStride;\n" \
+	"	uint count = 0u;\n" \
+	"	for (uint i = 0u; i < lightCount && count < clusterStride - 1u; i++)\n" \
+	"	{\n" \
+	"		vec3 center = (sceneToHead * vec4(lights[i].positionRadius.xyz, 1.0)).xyz;\n" \
+	"		vec3 distance = center - clamp(center, boxMin, boxMax);\n" \
+	"		if (dot(distance, distance) <= lights[i].positionRadius.w * lights[i].positionRadius.w)\n" \
+	"		{\n" \
+	"			clusterLights[offset + 1u + count] = i;\n" \
+	"			count++;\n" \
+	"		}\n" \
+	"	}\n" \
+	"	clusterLights[offset] = count;\n" \
+	"}\n"
+
+#define CLUSTER_LOOKUP_GLSL \
+	"layout(std430, binding = " QT_STRINGIFY(CLUSTER_LIGHTS_BINDING) ") readonly buffer ClusterLights\n" \
+	"{\n" \
+	"	uint clusterLights[];\n" \
+	"};\n" \
+	"uint clusterOf(vec3 scenePosition)\n" \
+	"{\n" \
+	"	vec3 position = (sceneToHead * vec4(scenePosition, 1.0)).xyz;\n" \
+	"	float depth = max(-position.z, clipPlanes.x);\n" \
+	"	vec2 tangent = (position.xy / depth - headTangents.xz) / (headTangents.yw - headTangents.xz);\n" \
+	"	uvec2 cell = uvec2(clamp(tangent * vec2(clusterGrid.xy), vec2(0.0), vec2(clusterGrid.xy) - 1.0));\n" \
+	"	float slice = log(depth / clipPlanes.x) / log(clipPlanes.y / clipPlanes.x) * float(clusterGrid.z);\n" \
+	"	return cell.x + clusterGrid.x * (cell.y + clusterGrid.y * uint(clamp(slice, 0.0, float(clusterGrid.z) - 1.0)));\n" \
+	"}\n" \
+	"uint clusterLightCount(uint cluster)\n" \
+	"{\n" \
+	"	return clusterLights[cluster * clusterStride];\n" \
+	"}\n" \
+	"Light clusterLight(uint cluster, uint i)\n" \
+	"{\n" \
+	"	return lights[clusterLights[cluster * clusterStride + 1u + i]];\n" \
+	"}\n"
+
+QString COpenVROpenGLWidget::FrameUniformsShaderInclude()
+{
+	return QString(FRAME_UNIFORMS_GLSL);
+}
+
+COpenVROpenGLWidget::CClusteredLighting* COpenVROpenGLWidget::GetClusteredLighting()
+{
+	if (!m_pClusteredLighting)
+	{
+		m_pClusteredLighting = new CClusteredLighting();
+		AddFramePass("clustered lighting", [this]() { m_pClusteredLighting->Build(m_glState); });
+	}
+	return m_pClusteredLighting;
+}
+
+COpenVROpenGLWidget::CClusteredLighting::CClusteredLighting() :
+	m_glLightBuffer(0),
+	m_iLightCapacity(0),
+	m_glClusterBuffer(0),
+	m_program(new QOpenGLShaderProgram()),
+	m_iLightCountLocation(-1),
+	m_bValid(false)
+{
+	static_assert(sizeof(SLight) == 8 * sizeof(float), "SLight must match the layout of the Light structure of the shaders");
+
+	initializeOpenGLFunctions();
+
+	// the lists of all the clusters, only written by the GPU
+	glCreateBuffers(1, &m_glClusterBuffer);
+	glNamedBufferStorage(m_glClusterBuffer, CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z * CLUSTER_STRIDE * sizeof(GLuint), nullptr, 0);
+	CGpuMemoryTracker::Track(GpuMemoryScene, GL_BUFFER, m_glClusterBuffer, CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z * CLUSTER_STRIDE * sizeof(GLuint));
+
+	if (!m_program->addShaderFromSourceCode(QOpenGLShader::Compute, CLUSTER_BUILD_COMPUTE_SHADER) || !m_program->link())
+	{
+		qDebug() << m_program->log();
+		return;
+	}
+	CGpuMemoryTracker::TrackProgram(m_program);
+
+	m_iLightCountLocation = m_program->uniformLocation("lightCount");
+	m_bValid = true;
+}
+
+COpenVROpenGLWidget::CClusteredLighting::~CClusteredLighting()
+{
+	CGpuMemoryTracker::UntrackProgram(m_program);
+	delete m_program;
+	if (m_glLightBuffer)
+	{
+		CGpuMemoryTracker::Untrack(GL_BUFFER, m_glLightBuffer);
+		glDeleteBuffers(1, &m_glLightBuffer);
+	}
+	CGpuMemoryTracker::Untrack(GL_BUFFER, m_glClusterBuffer);
+	glDeleteBuffers(1, &m_glClusterBuffer);
+}
+
+void COpenVROpenGLWidget::CClusteredLighting::Build(CGLStateCache* i_glState)
+{
+	if (!m_bValid)
+		return;
+
+	// grow the light buffer by doubling its capacity, then upload all the lights at once
+	if (m_lights.size() > m_iLightCapacity)
+	{
+		if (m_glLightBuffer)
+		{
+			CGpuMemoryTracker::Untrack(GL_BUFFER, m_glLightBuffer);
+			glDeleteBuffers(1, &m_glLightBuffer);
+		}
+		m_iLightCapacity = qMax(m_lights.size(), 2 * m_iLightCapacity);
+		glCreateBuffers(1, &m_glLightBuffer);
+		glNamedBufferData(m_glLightBuffer, m_iLightCapacity * sizeof(SLight), nullptr, GL_STREAM_DRAW);
+		CGpuMemoryTracker::Track(GpuMemoryScene, GL_BUFFER, m_glLightBuffer, m_iLightCapacity * sizeof(SLight));
+	}
+	if (!m_lights.isEmpty())
+	{
+		glInvalidateBufferData(m_glLightBuffer);
+		glNamedBufferSubData(m_glLightBuffer, 0, m_lights.size() * sizeof(SLight), m_lights.constData());
+	}
+
+	// the buffers stay bound for the shaders of Render()
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHTS_BINDING, m_glLightBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_LIGHTS_BINDING, m_glClusterBuffer);
+
+	i_glState->UseProgram(m_program->programId());
+	glProgramUniform1ui(m_program->programId(), m_iLightCountLocation, static_cast<GLuint>(m_lights.size()));
+
+	const GLuint clusterCount = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+	glDispatchCompute((clusterCount + CLUSTER_BUILD_GROUP_SIZE - 1) / CLUSTER_BUILD_GROUP_SIZE, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+QString COpenVROpenGLWidget::CClusteredLighting::ShaderInclude()
+{
+	return QString(FRAME_UNIFORMS_GLSL CLUSTER_COMMON_GLSL CLUSTER_LOOKUP_GLSL);
+}
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	OCCLUSION CULLING
+//
+
+#define OCCLUSION_PYRAMID_COMPUTE_SHADER \
+	"#version 450\n" \
+	"layout(local_size_x = " QT_STRINGIFY(EYE_COMPUTE_GROUP_SIZE) ", local_size_y = " QT_STRINGIFY(EYE_COMPUTE_GROUP_SIZE) ") in;\n" \
+	"layout(binding = 0) uniform sampler2D source[2];\n" \
+	"layout(r32f, binding = 0) writeonly uniform image2D destination[2];\n" \
+	"uniform int level;\n" \
+	"void main()\n" \
+	"{\n" \
+	"	uint eye = gl_GlobalInvocationID.z;\n" \
+	"	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);\n" \
+	"	ivec2 size = imageSize(destination[eye]);\n" \
+	"	if (any(greaterThanEqual(texel, size)))\n" \
+	"		return;\n" \
+	"	// the farthest depth of all the source texels covered by the texel\n" \
+	"	int sourceLevel = max(level - 1, 0);\n" \
+	"	ivec2 sourceSize = textureSize(source[eye], sourceLevel);\n" \
+	"	ivec2 first = texel * sourceSize / size;\n" \
+	"	ivec2 last = min(((texel + 1) * sourceSize + size - 1) / size, sourceSize) - 1;\n" \
+	"	float depth = 0.0;\n" \
+	"	for (int y = first.y; y <= last.y; y++)\n" \
+	"	{\n" \
+	"		for (int x = first.x; x <= last.x; x++)\n" \
+	"		{\n" \
+	"			float sourceDepth = texelFetch(source[eye], ivec2(x, y), sourceLevel).r;\n" \
+	"			// the pixels masked at the near plane hide nothing\n" \
+	"			depth = max(depth, (level == 0 && sourceDepth == 0.0) ? 1.0 : sourceDepth);\n" \
+	"		}\n" \
+	"	}\n" \
+	"	imageStore(destination[eye], texel, vec4(depth));\n" \
+	"}\n"
+
+#define OCCLUSION_CULL_COMPUTE_SHADER \
+	"#version 450\n" \
+	"layout(local_size_x = " QT_STRINGIFY(OCCLUSION_GROUP_SIZE) ") in;\n" \
+	"struct Object\n" \
+	"{\n" \
+	"	float boundsMin[3];\n" \
+	"	uint indexCount;\n" \
+	"	float boundsMax[3];\n" \
+	"	uint firstIndex;\n" \
+	"	int baseVertex;\n" \
+	"	uint baseInstance;\n" \
+	"};\n" \
+	"struct Command\n" \
+	"{\n" \
+	"	uint count;\n" \
+	"	uint instanceCount;\n" \
+	"	uint firstIndex;\n" \
+	"	int baseVertex;\n" \
+	"	uint baseInstance;\n" \
+	"};\n" \
+	"layout(std430, binding = " QT_STRINGIFY(OCCLUSION_OBJECTS_BINDING) ") readonly buffer Objects\n" \
+	"{\n" \
+	"	Object objects[];\n" \
+	"};\n" \
+	"layout(std430, binding = " QT_STRINGIFY(OCCLUSION_COMMANDS_BINDING) ") writeonly buffer Commands\n" \
+	"{\n" \
+	"	Command commands[];\n" \
+	"};\n" \
+	"layout(binding = 0) uniform sampler2D pyramid[2];\n" \
+	"uniform uint objectCount;\n" \
+	"uniform mat4 viewProjection[2];\n" \
+	"uniform mat4 previousViewProjection[2];\n" \
+	"uniform bool occlusion;\n" \
+	"vec3 corner(vec3 boundsMin, vec3 boundsMax, int i)\n" \
+	"{\n" \
+	"	return mix(boundsMin, boundsMax, vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));\n" \
+	"}\n" \
+	"bool isVisible(uint eye, vec3 boundsMin, vec3 boundsMax)\n" \
+	"{\n" \
+	"	// out of the frustum of this frame when all the corners are beyond the same plane\n" \
+	"	ivec3 below = ivec3(0);\n" \
+	"	ivec3 above = ivec3(0);\n" \
+	"	for (int i = 0; i < 8; i++)\n" \
+	"	{\n" \
+	"		vec4 position = viewProjection[eye] * vec4(corner(boundsMin, boundsMax, i), 1.0);\n" \
+	"		below += ivec3(lessThan(position.xyz, vec3(-position.w)));\n" \
+	"		above += ivec3(greaterThan(position.xyz, vec3(position.w)));\n" \
+	"	}\n" \
+	"	if (any(equal(below, ivec3(8))) || any(equal(above, ivec3(8))))\n" \
+	"		return false;\n" \
+	"	if (!occlusion)\n" \
+	"		return true;\n" \
+	"	// the footprint of the bounds in the depth of the previous frame\n" \
+	"	vec3 ndcMin = vec3(1.0);\n" \
+	"	vec3 ndcMax = vec3(-1.0);\n" \
+	"	for (int i = 0; i < 8; i++)\n" \
+	"	{\n" \
+	"		vec4 position = previousViewProjection[eye] * vec4(corner(boundsMin, boundsMax, i), 1.0);\n" \
+	"		if (position.w <= 0.0)\n" \
+	"			return true;\n" \
+	"		ndcMin = min(ndcMin, position.xyz / position.w);\n" \
+	"		ndcMax = max(ndcMax, position.xyz / position.w);\n" \
+	"	}\n" \
+	"	vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0);\n" \
+	"	vec2 uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0);\n" \
+	"	// the level where the footprint covers 2 x 2 texels at most\n" \
+	"	vec2 extent = (uvMax - uvMin) * vec2(textureSize(pyramid[eye], 0));\n" \
+	"	int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, textureQueryLevels(pyramid[eye]) - 1);\n" \
+	"	ivec2 levelSize = textureSize(pyramid[eye], level);\n" \
+	"	ivec2 first = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);\n" \
+	"	ivec2 last = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);\n" \
+	"	float depth = max(max(texelFetch(pyramid[eye], first, level).r, texelFetch(pyramid[eye], ivec2(last.x, first.y), level).r),\n" \
+	"		max(texelFetch(pyramid[eye], ivec2(first.x, last.y), level).r, texelFetch(pyramid[eye], last, level).r));\n" \
+	"	return ndcMin.z * 0.5 + 0.5 <= depth;\n" \
+	"}\n" \
+	"void main()\n" \
+	"{\n" \
+	"	uint i = gl_GlobalInvocationID.x;\n" \
+	"	uint view = gl_GlobalInvocationID.y;\n" \
+	"	if (i >= objectCount)\n" \
+	"		return;\n" \
+	"	Object object = objects[i];\n" \
+	"	vec3 boundsMin = vec3(object.boundsMin[0], object.boundsMin[1], object.boundsMin[2]);\n" \
+	"	vec3 boundsMax = vec3(object.boundsMax[0], object.boundsMax[1], object.boundsMax[2]);\n" \
+	"	// the far field draws every object\n" \
+	"	bool visible = (view == 2u) || isVisible(view, boundsMin, boundsMax);\n" \
+	"	uint command = view * objectCount + i;\n" \
+	"	commands[command].count = object.indexCount;\n" \
+	"	commands[command].instanceCount = visible ? 1u : 0u;\n" \
+	"	commands[command].firstIndex = object.firstIndex;\n" \
+	"	commands[command].baseVertex = object.baseVertex;\n" \
+	"	commands[command].baseInstance = object.baseInstance;\n" \
+	"}\n"
+
+COpenVROpenGLWidget::COcclusionCulling* COpenVROpenGLWidget::GetOcclusionCulling()
+{
+	if (!m_pOcclusionCulling)
+	{
+		m_pOcclusionCulling = new COcclusionCulling();
+		AddFramePass("occlusion culling", [this]()
+		{
+			GLuint depthTextures[2];
+			QSize depthSize;
+			getEyesDepth(depthTextures, depthSize);
+			m_pOcclusionCulling->Cull(depthTextures, depthSize, m_eyeViewProjections, m_glState);
+		});
+
+		// the eyes keep their depth from now on
+		m_bEyesOutdated = true;
+	}
+	return m_pOcclusionCulling;
+}
+
+void COpenVROpenGLWidget::getEyesDepth(GLuint o_depthTextures[2], QSize& o_size) const
+{
+	o_size = QSize();
+	for (int eye = 0; eye < 2; eye++)
+	{
+		o_depthTextures[eye] = m_eyeInfos[eye] ? m_eyeInfos[eye]->DepthTexture() : 0;
+		if (m_eyeInfos[eye])
+			o_size = m_eyeInfos[eye]->GetTargetSize();
+	}
+}
+
+COpenVROpenGLWidget::COcclusionCulling::COcclusionCulling() :
+	m_bObjectsDirty(false),
+	m_iDirtyFirst(0),
+	m_iDirtyLast(-1),
+	m_glObjectBuffer(0),
+	m_glCommandBuffer(0),
+	m_iCapacity(0),
+	m_iCommandCount(0),
+	m_iPyramidLevels(0),
+	m_bPreviousFrame(false),
+	m_pyramidProgram(new QOpenGLShaderProgram()),
+	m_cullProgram(new QOpenGLShaderProgram()),
+	m_bValid(false)
+{
+	static_assert(sizeof(SObject) == 10 * sizeof(GLuint), "SObject must match the layout of the Object structure of the shaders");
+
+	initializeOpenGLFunctions();
+	m_glPyramids[Left] = m_glPyramids[Right] = 0;
+
+	if (!m_pyramidProgram->addShaderFromSourceCode(QOpenGLShader::Compute, OCCLUSION_PYRAMID_COMPUTE_SHADER) || !m_pyramidProgram->link())
+	{
+		qDebug() << m_pyramidProgram->log();
+		return;
+	}
+	CGpuMemoryTracker::TrackProgram(m_pyramidProgram);
+
+	if (!m_cullProgram->addShaderFromSourceCode(QOpenGLShader::Compute, OCCLUSION_CULL_COMPUTE_SHADER) || !m_cullProgram->link())
+	{
+		qDebug() << m_cullProgram->log();
+		return;
+	}
+	CGpuMemoryTracker::TrackProgram(m_cullProgram);
+
+	m_bValid = true;
+}
+
+COpenVROpenGLWidget::COcclusionCulling::~COcclusionCulling()
+{
+	destroyPyramids();
+	CGpuMemoryTracker::UntrackProgram(m_cullProgram);
+	CGpuMemoryTracker::UntrackProgram(m_pyramidProgram);
+	delete m_cullProgram;
+	delete m_pyramidProgram;
+	if (m_glObjectBuffer)
+	{
+		CGpuMemoryTracker::Untrack(GL_BUFFER, m_glCommandBuffer);
+		CGpuMemoryTracker::Untrack(GL_BUFFER, m_glObjectBuffer);
+		glDeleteBuffers(1, &m_glCommandBuffer);
+		glDeleteBuffers(1, &m_glObjectBuffer);
+	}
+}
+
+void COpenVROpenGLWidget::COcclusionCulling::createPyramids(const QSize& i_depthSize)
+{
+	destroyPyramids();
+
+	// a power of two size, so each level exactly halves the previous one
+	m_depthSize = i_depthSize;
+	m_pyramidSize = QSize(1, 1);
+	while (m_pyramidSize.width() * 2 <= i_depthSize.width())
+		m_pyramidSize.rwidth() *= 2;
+	while (m_pyramidSize.height() * 2 <= i_depthSize.height())
+		m_pyramidSize.rheight() *= 2;
+
+	m_iPyramidLevels = 1;
+	while ((qMax(m_pyramidSize.width(), m_pyramidSize.height()) >> m_iPyramidLevels) > 0)
+		m_iPyramidLevels++;
+
+	for (int eye = 0; eye < 2; eye++)
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &m_glPyramids[eye]);
+		glTextureStorage2D(m_glPyramids[eye], m_iPyramidLevels, GL_R32F, m_pyramidSize.width(), m_pyramidSize.height());
+		CGpuMemoryTracker::Track(GpuMemoryScene, GL_TEXTURE, m_glPyramids[eye],
+			CGpuMemoryTracker::TextureBytes(m_pyramidSize, GL_R32F, m_iPyramidLevels));
+		glTextureParameteri(m_glPyramids[eye], GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTextureParameteri(m_glPyramids[eye], GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+}
+
+void COpenVROpenGLWidget::COcclusionCulling::destroyPyramids()
+{
+	if (m_glPyramids[Left])
+	{
+		CGpuMemoryTracker::Untrack(GL_TEXTURE, m_glPyramids[Left]);
+		CGpuMemoryTracker::Untrack(GL_TEXTURE, m_glPyramids[Right]);
+		glDeleteTextures(2, m_glPyramids);
+	}
+	m_glPyramids[Left] = m_glPyramids[Right] = 0;
+	m_depthSize = m_pyramidSize = QSize();
+	m_iPyramidLevels = 0;
+}
+
+void COpenVROpenGLWidget::COcclusionCulling::Cull(const GLuint i_depthTextures[2], const QSize& i_depthSize, const QMatrix4x4 i_viewProjections[2], CGLStateCache* i_glState)
+{
+	if (!m_bValid)
+		return;
+
+	// grow the buffers by doubling their capacity
+	if (m_objects.size() > m_iCapacity)
+	{
+		if (m_glObjectBuffer)
+		{
+			CGpuMemoryTracker::Untrack(GL_BUFFER, m_glCommandBuffer);
+			CGpuMemoryTracker::Untrack(GL_BUFFER, m_glObjectBuffer);
+			glDeleteBuffers(1, &m_glCommandBuffer);
+			glDeleteBuffers(1, &m_glObjectBuffer);
+		}
+		m_iCapacity = qMax(m_objects.size(), 2 * m_iCapacity);
+		glCreateBuffers(1, &m_glObjectBuffer);
+		glNamedBufferStorage(m_glObjectBuffer, m_iCapacity * sizeof(SObject), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		glCreateBuffers(1, &m_glCommandBuffer);
+		glNamedBufferStorage(m_glCommandBuffer, 3 * m_iCapacity * 5 * sizeof(GLuint), nullptr, 0);
+		CGpuMemoryTracker::Track(GpuMemoryScene, GL_BUFFER, m_glObjectBuffer, m_iCapacity * sizeof(SObject));
+		CGpuMemoryTracker::Track(GpuMemoryScene, GL_BUFFER, m_glCommandBuffer, 3 * m_iCapacity * 5 * sizeof(GLuint));
+		m_bObjectsDirty = true;
+	}
+
+	// the objects are only uploaded when they changed, all of them or the range given to SetObject()
+	m_iCommandCount = m_objects.size();
+	if (m_bObjectsDirty && m_iCommandCount > 0)
+		glNamedBufferSubData(m_glObjectBuffer, 0, m_iCommandCount * sizeof(SObject), m_objects.constData());
+	else if (m_iDirtyFirst <= m_iDirtyLast)
+		glNamedBufferSubData(m_glObjectBuffer, m_iDirtyFirst * sizeof(SObject), (m_iDirtyLast - m_iDirtyFirst + 1) * sizeof(SObject), m_objects.constData() + m_iDirtyFirst);
+	m_bObjectsDirty = false;
+	m_iDirtyFirst = 0;
+	m_iDirtyLast = -1;
+
+	// the depth of the previous frame is only meaningful with its view
+	const bool occlusion = m_bPreviousFrame && i_depthTextures[Left] && i_depthTextures[Right];
+	if (m_iCommandCount > 0 && occlusion)
+	{
+		if (i_depthSize != m_depthSize)
+			createPyramids(i_depthSize);
+
+		// the first level reads the depth, the next ones the previous level
+		i_glState->UseProgram(m_pyramidProgram->programId());
+		for (int level = 0; level < m_iPyramidLevels; level++)
+		{
+			for (int eye = 0; eye < 2; eye++)
+			{
+				i_glState->ActiveTexture(GL_TEXTURE0 + eye);
+				i_glState->BindTexture(GL_TEXTURE_2D, level ? m_glPyramids[eye] : i_depthTextures[eye]);
+				glBindImageTexture(eye, m_glPyramids[eye], level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+			}
+			m_pyramidProgram->setUniformValue("level", level);
+
+			const int width = qMax(m_pyramidSize.width() >> level, 1);
+			const int height = qMax(m_pyramidSize.height() >> level, 1);
+			glDispatchCompute((width + EYE_COMPUTE_GROUP_SIZE - 1) / EYE_COMPUTE_GROUP_SIZE, (height + EYE_COMPUTE_GROUP_SIZE - 1) / EYE_COMPUTE_GROUP_SIZE, 2);
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		}
+	}
+
+	if (m_iCommandCount > 0)
+	{
+		i_glState->UseProgram(m_cullProgram->programId());
+		if (occlusion)
+		{
+			for (int eye = 0; eye < 2; eye++)
+			{
+				i_glState->ActiveTexture(GL_TEXTURE0 + eye);
+				i_glState->BindTexture(GL_TEXTURE_2D, m_glPyramids[eye]);
+			}
+		}
+		m_cullProgram->setUniformValue("objectCount", static_cast<GLuint>(m_iCommandCount));
+		m_cullProgram->setUniformValueArray("viewProjection", i_viewProjections, 2);
+		m_cullProgram->setUniformValueArray("previousViewProjection", m_previousViewProjections, 2);
+		m_cullProgram->setUniformValue("occlusion", static_cast<GLint>(occlusion));
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OCCLUSION_OBJECTS_BINDING, m_glObjectBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OCCLUSION_COMMANDS_BINDING, m_glCommandBuffer);
+		glDispatchCompute((m_iCommandCount + OCCLUSION_GROUP_SIZE - 1) / OCCLUSION_GROUP_SIZE, 3, 1);
+
+		// the commands are read by the draws of the eyes
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+	}
+
+	// the depth rendered during this frame is seen from these views
+	m_previousViewProjections[Left] = i_viewProjections[Left];
+	m_previousViewProjections[Right] = i_viewProjections[Right];
+	m_bPreviousFrame = true;
+}
+
+void COpenVROpenGLWidget::COcclusionCulling::SetObject(int i_index, const SObject& i_object)
+{
+	m_objects[i_index] = i_object;
+	m_iDirtyFirst = (m_iDirtyFirst <= m_iDirtyLast) ? qMin(m_iDirtyFirst, i_index) : i_index;
+	m_iDirtyLast = qMax(m_iDirtyLast, i_index);
+}
+
+void COpenVROpenGLWidget::COcclusionCulling::Draw(int i_eye, GLenum i_mode, int i_iFirst, int i_iCount)
+{
+	if (i_iCount < 0)
+		i_iCount = m_iCommandCount - i_iFirst;
+	if (i_iCount <= 0 || i_iFirst + i_iCount > m_iCommandCount)
+		return;
+
+	const GLintptr offset = (i_eye * m_iCommandCount + i_iFirst) * 5 * sizeof(GLuint);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_glCommandBuffer);
+	glMultiDrawElementsIndirect(i_mode, GL_UNSIGNED_INT, reinterpret_cast<const void*>(offset), i_iCount, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	SCENE RENDERER
+//
+
+#define SCENE_GLSL \
+	"struct SceneObject\n" \
+	"{\n" \
+	"	mat4 transform;\n" \
+	"	uint material;\n" \
+	"	int mesh;\n" \
+	"};\n" \
+	"layout(std430, binding = " QT_STRINGIFY(SCENE_OBJECTS_BINDING) ") readonly buffer SceneObjects\n" \
+	"{\n" \
+	"	SceneObject sceneObjects[];\n" \
+	"};\n" \
+	"struct Material\n" \
+	"{\n" \
+	"	vec4 color;\n" \
+	"	vec4 parameters;\n" \
+	"};\n" \
+	"layout(std430, binding = " QT_STRINGIFY(SCENE_MATERIALS_BINDING) ") readonly buffer SceneMaterials\n" \
+	"{\n" \
+	"	Material sceneMaterials[];\n" \
+	"};\n" \
+	"uniform mat4 viewProjection;\n"
+
+#define SCENE_VERTEX_GLSL \
+	"layout(location = 0) in vec3 vertexPosition;\n" \
+	"layout(location = 1) in vec3 vertexNormal;\n" \
+	"layout(location = 2) in vec2 vertexTexCoord;\n" \
+	"layout(location = 3) in uint objectIndex;\n" \
+	SCENE_GLSL \
+	"mat4 objectTransform()\n" \
+	"{\n" \
+	"	return sceneObjects[objectIndex].transform;\n" \
+	"}\n" \
+	"Material objectMaterial()\n" \
+	"{\n" \
+	"	return sceneMaterials[sceneObjects[objectIndex].material];\n" \
+	"}\n"
+
+QString COpenVROpenGLWidget::CSceneRenderer::VertexShaderInclude()
+{
+	return QString(SCENE_VERTEX_GLSL);
+}
+
+QString COpenVROpenGLWidget::CSceneRenderer::ShaderInclude()
+{
+	return QString(SCENE_GLSL);
+}
+
+COpenVROpenGLWidget::CSceneRenderer* COpenVROpenGLWidget::GetSceneRenderer()
+{
+	if (!m_pSceneRenderer)
+	{
+		m_pSceneRenderer = new CSceneRenderer();
+		AddFramePass("scene renderer", [this]()
+		{
+			GLuint depthTextures[2];
+			QSize depthSize;
+			getEyesDepth(depthTextures, depthSize);
+			m_pSceneRenderer->Update(depthTextures, depthSize, m_eyeViewProjections, m_glState);
+		});
+
+		// the eyes keep their depth from now on
+		m_bEyesOutdated = true;
+	}
+	return m_pSceneRenderer;
+}
+
+COpenVROpenGLWidget::CSceneRenderer::CSceneRenderer() :
+	m_bMaterialsDirty(false),
+	m_iDirtyFirst(0),
+	m_iDirtyLast(-1),
+	m_bCullingOrderDirty(false),
+	m_glVertexArena(0),
+	m_iVertexCount(0),
+	m_iVertexCapacity(0),
+	m_glIndexArena(0),
+	m_iIndexCount(0),
+	m_iIndexCapacity(0),
+	m_glObjectBuffer(0),
+	m_iObjectCapacity(0),
+	m_glObjectIndexBuffer(0),
+	m_glMaterialBuffer(0),
+	m_iMaterialCapacity(0),
+	m_glVertexArray(0),
+	m_pCulling(new COcclusionCulling())
 {
-	m_cameraTranslation = INITIAL_TRANSLATION;
+	static_assert(sizeof(SVertex) == 8 * sizeof(float), "SVertex must be tightly packed");
+	static_assert(sizeof(SMaterial) == 8 * sizeof(float), "SMaterial must match the layout of the Material structure of the shaders");
+	static_assert(sizeof(SObjectData) == 20 * sizeof(GLuint), "SObjectData must match the layout of the SceneObject structure of the shaders");
+
+	initializeOpenGLFunctions();
+	createVertexArray();
 }
 
-QVector3D COpenVROpenGLWidget::GetTranslations()
+COpenVROpenGLWidget::CSceneRenderer::~CSceneRenderer()
 {
-	return m_cameraTranslation;
+	ReleaseContext();
+	delete m_pCulling;
+
+	GLuint buffers[] = { m_glVertexArena, m_glIndexArena, m_glObjectBuffer, m_glObjectIndexBuffer, m_glMaterialBuffer };
+	for (GLuint buffer : buffers)
+	{
+		if (buffer)
+		{
+			CGpuMemoryTracker::Untrack(GL_BUFFER, buffer);
+			glDeleteBuffers(1, &buffer);
+		}
+	}
 }
 
-void COpenVROpenGLWidget::RotateEyes(float i_yaw, float i_pitch, float i_roll)
+void COpenVROpenGLWidget::CSceneRenderer::createVertexArray()
 {
-	m_cameraRotations += QVector3D(i_yaw, i_pitch, i_roll);
+	glCreateVertexArrays(1, &m_glVertexArray);
+
+	// the vertices of the arena
+	glVertexArrayAttribFormat(m_glVertexArray, 0, 3, GL_FLOAT, GL_FALSE, offsetof(SVertex, m_position));
+	glVertexArrayAttribFormat(m_glVertexArray, 1, 3, GL_FLOAT, GL_FALSE, offsetof(SVertex, m_normal));
+	glVertexArrayAttribFormat(m_glVertexArray, 2, 2, GL_FLOAT, GL_FALSE, offsetof(SVertex, m_texCoord));
+	for (GLuint attrib = 0; attrib < 3; attrib++)
+	{
+		glVertexArrayAttribBinding(m_glVertexArray, attrib, 0);
+		glEnableVertexArrayAttrib(m_glVertexArray, attrib);
+	}
+
+	// the index of the object, read once per instance from the base instance of the draw
+	glVertexArrayAttribIFormat(m_glVertexArray, 3, 1, GL_UNSIGNED_INT, 0);
+	glVertexArrayAttribBinding(m_glVertexArray, 3, 1);
+	glVertexArrayBindingDivisor(m_glVertexArray, 1, 1);
+	glEnableVertexArrayAttrib(m_glVertexArray, 3);
+
+	glVertexArrayVertexBuffer(m_glVertexArray, 0, m_glVertexArena, 0, sizeof(SVertex));
+	glVertexArrayVertexBuffer(m_glVertexArray, 1, m_glObjectIndexBuffer, 0, sizeof(GLuint));
+	glVertexArrayElementBuffer(m_glVertexArray, m_glIndexArena);
 }
 
-void COpenVROpenGLWidget::ResetEyesRotations()
+void COpenVROpenGLWidget::CSceneRenderer::releaseObjects()
 {
-	m_cameraRotations = INITIAL_ROTATION;
+	if (m_glVertexArray)
+		glDeleteVertexArrays(1, &m_glVertexArray);
+	m_glVertexArray = 0;
 }
 
-QVector3D COpenVROpenGLWidget::GetRotations()
+void COpenVROpenGLWidget::CSceneRenderer::restoreObjects()
 {
-	return m_cameraRotations;
+	m_pCulling->RestoreContext();
+	createVertexArray();
+}
+
+bool COpenVROpenGLWidget::CSceneRenderer::growBuffer(GLuint& io_buffer, int& io_iCapacity, int i_iSize, int i_iStride, int i_iKept)
+{
+	if (i_iSize <= io_iCapacity)
+		return false;
+
+	io_iCapacity = qMax(i_iSize, 2 * io_iCapacity);
+	GLuint buffer;
+	glCreateBuffers(1, &buffer);
+	glNamedBufferStorage(buffer, io_iCapacity * i_iStride, nullptr, GL_DYNAMIC_STORAGE_BIT);
+	CGpuMemoryTracker::Track(GpuMemoryScene, GL_BUFFER, buffer, static_cast<qint64>(io_iCapacity) * i_iStride);
+	if (io_buffer)
+	{
+		if (i_iKept > 0)
+			glCopyNamedBufferSubData(io_buffer, buffer, 0, 0, i_iKept * i_iStride);
+		CGpuMemoryTracker::Untrack(GL_BUFFER, io_buffer);
+		glDeleteBuffers(1, &io_buffer);
+	}
+	io_buffer = buffer;
+	return true;
+}
+
+int COpenVROpenGLWidget::CSceneRenderer::AddMesh(const QVector<SVertex>& i_vertices, const QVector<GLuint>& i_indices)
+{
+	SMesh mesh;
+	mesh.m_uiFirstIndex = static_cast<GLuint>(m_iIndexCount);
+	mesh.m_uiIndexCount = static_cast<GLuint>(i_indices.size());
+	mesh.m_iBaseVertex = m_iVertexCount;
+	mesh.m_boundsMin = i_vertices.isEmpty() ? QVector3D() : i_vertices.first().m_position;
+	mesh.m_boundsMax = mesh.m_boundsMin;
+	for (const SVertex& vertex : i_vertices)
+	{
+		mesh.m_boundsMin = QVector3D(qMin(mesh.m_boundsMin.x(), vertex.m_position.x()), qMin(mesh.m_boundsMin.y(), vertex.m_position.y()), qMin(mesh.m_boundsMin.z(), vertex.m_position.z()));
+		mesh.m_boundsMax = QVector3D(qMax(mesh.m_boundsMax.x(), vertex.m_position.x()), qMax(mesh.m_boundsMax.y(), vertex.m_position.y()), qMax(mesh.m_boundsMax.z(), vertex.m_position.z()));
+	}
+
+	// the arenas grow by doubling, the vertex array follows them
+	bool rebind = growBuffer(m_glVertexArena, m_iVertexCapacity, m_iVertexCount + i_vertices.size(), sizeof(SVertex), m_iVertexCount);
+	rebind |= growBuffer(m_glIndexArena, m_iIndexCapacity, m_iIndexCount + i_indices.size(), sizeof(GLuint), m_iIndexCount);
+	if (rebind && m_glVertexArray)
+	{
+		glVertexArrayVertexBuffer(m_glVertexArray, 0, m_glVertexArena, 0, sizeof(SVertex));
+		glVertexArrayElementBuffer(m_glVertexArray, m_glIndexArena);
+	}
+
+	if (!i_vertices.isEmpty())
+		glNamedBufferSubData(m_glVertexArena, m_iVertexCount * sizeof(SVertex), i_vertices.size() * sizeof(SVertex), i_vertices.constData());
+	if (!i_indices.isEmpty())
+		glNamedBufferSubData(m_glIndexArena, m_iIndexCount * sizeof(GLuint), i_indices.size() * sizeof(GLuint), i_indices.constData());
+	m_iVertexCount += i_vertices.size();
+	m_iIndexCount += i_indices.size();
+
+	m_meshes.append(mesh);
+	return m_meshes.size() - 1;
+}
+
+int COpenVROpenGLWidget::CSceneRenderer::AddMaterial(QOpenGLShaderProgram* i_program, const SMaterial& i_material)
+{
+	m_materials.append(i_material);
+	m_materialPrograms.append(i_program);
+	m_bMaterialsDirty = true;
+	return m_materials.size() - 1;
+}
+
+void COpenVROpenGLWidget::CSceneRenderer::SetMaterial(int i_material, const SMaterial& i_material)
+{
+	m_materials[i_material] = i_material;
+	m_bMaterialsDirty = true;
+}
+
+void COpenVROpenGLWidget::CSceneRenderer::setObjectDirty(int i_object)
+{
+	m_iDirtyFirst = (m_iDirtyFirst <= m_iDirtyLast) ? qMin(m_iDirtyFirst, i_object) : i_object;
+	m_iDirtyLast = qMax(m_iDirtyLast, i_object);
+}
+
+int COpenVROpenGLWidget::CSceneRenderer::AddObject(int i_mesh, int i_material, const QMatrix4x4& i_transform)
+{
+	// the slots of the removed objects are reused first
+	int object = m_objects.size();
+	if (!m_freeObjects.isEmpty())
+		object = m_freeObjects.takeLast();
+	else
+		m_objects.append(SObjectData());
+
+	SObjectData& data = m_objects[object];
+	memcpy(data.m_transform, i_transform.constData(), sizeof(data.m_transform));
+	data.m_uiMaterial = static_cast<GLuint>(i_material);
+	data.m_iMesh = i_mesh;
+	data.m_uiPadding[0] = data.m_uiPadding[1] = 0;
+	setObjectDirty(object);
+	m_bCullingOrderDirty = true;
+	return object;
+}
+
+void COpenVROpenGLWidget::CSceneRenderer::SetObjectTransform(int i_object, const QMatrix4x4& i_transform)
+{
+	memcpy(m_objects[i_object].m_transform, i_transform.constData(), sizeof(m_objects[i_object].m_transform));
+	setObjectDirty(i_object);
+}
+
+void COpenVROpenGLWidget::CSceneRenderer::RemoveObject(int i_object)
+{
+	m_objects[i_object].m_iMesh = -1;
+	m_freeObjects.append(i_object);
+	setObjectDirty(i_object);
+	m_bCullingOrderDirty = true;
+}
+
+void COpenVROpenGLWidget::CSceneRenderer::culledObject(int i_object, COcclusionCulling::SObject& o_culledObject) const
+{
+	// the bounds of the mesh in the scene
+	const SObjectData& data = m_objects[i_object];
+	const SMesh& mesh = m_meshes[data.m_iMesh];
+	const QMatrix4x4 transform = QMatrix4x4(data.m_transform).transposed();
+	const QVector3D center = transform.map((mesh.m_boundsMin + mesh.m_boundsMax) * 0.5f);
+	const QVector3D extent = (mesh.m_boundsMax - mesh.m_boundsMin) * 0.5f;
+	QVector3D sceneExtent;
+	for (int row = 0; row < 3; row++)
+		sceneExtent[row] = qAbs(transform(row, 0)) * extent.x() + qAbs(transform(row, 1)) * extent.y() + qAbs(transform(row, 2)) * extent.z();
+
+	o_culledObject.m_boundsMin = center - sceneExtent;
+	o_culledObject.m_boundsMax = center + sceneExtent;
+	o_culledObject.m_uiIndexCount = mesh.m_uiIndexCount;
+	o_culledObject.m_uiFirstIndex = mesh.m_uiFirstIndex;
+	o_culledObject.m_iBaseVertex = mesh.m_iBaseVertex;
+	o_culledObject.m_uiBaseInstance = static_cast<GLuint>(i_object);
+}
+
+void COpenVROpenGLWidget::CSceneRenderer::Update(const GLuint i_depthTextures[2], const QSize& i_depthSize, const QMatrix4x4 i_viewProjections[2], CGLStateCache* i_glState)
+{
+	if (!IsValid())
+		return;
+
+	if (m_bMaterialsDirty && !m_materials.isEmpty())
+	{
+		growBuffer(m_glMaterialBuffer, m_iMaterialCapacity, m_materials.size(), sizeof(SMaterial), 0);
+		glNamedBufferSubData(m_glMaterialBuffer, 0, m_materials.size() * sizeof(SMaterial), m_materials.constData());
+	}
+	m_bMaterialsDirty = false;
+
+	// only the range of objects which changed is uploaded, unless the buffers grow
+	const int dirtyFirst = m_iDirtyFirst;
+	const int dirtyLast = m_iDirtyLast;
+	if (growBuffer(m_glObjectBuffer, m_iObjectCapacity, m_objects.size(), sizeof(SObjectData), 0))
+	{
+		QVector<GLuint> indices(m_iObjectCapacity);
+		for (int i = 0; i < m_iObjectCapacity; i++)
+			indices[i] = static_cast<GLuint>(i);
+
+		if (m_glObjectIndexBuffer)
+		{
+			CGpuMemoryTracker::Untrack(GL_BUFFER, m_glObjectIndexBuffer);
+			glDeleteBuffers(1, &m_glObjectIndexBuffer);
+		}
+		glCreateBuffers(1, &m_glObjectIndexBuffer);
+		glNamedBufferStorage(m_glObjectIndexBuffer, m_iObjectCapacity * sizeof(GLuint), indices.constData(), 0);
+		CGpuMemoryTracker::Track(GpuMemoryScene, GL_BUFFER, m_glObjectIndexBuffer, m_iObjectCapacity * sizeof(GLuint));
+		if (m_glVertexArray)
+			glVertexArrayVertexBuffer(m_glVertexArray, 1, m_glObjectIndexBuffer, 0, sizeof(GLuint));
+
+		m_iDirtyFirst = 0;
+		m_iDirtyLast = m_objects.size() - 1;
+	}
+	if (m_iDirtyFirst <= m_iDirtyLast)
+	{
+		glNamedBufferSubData(m_glObjectBuffer, m_iDirtyFirst * sizeof(SObjectData), (m_iDirtyLast - m_iDirtyFirst + 1) * sizeof(SObjectData), m_objects.constData() + m_iDirtyFirst);
+		m_iDirtyFirst = 0;
+		m_iDirtyLast = -1;
+	}
+
+	// the culled objects are sorted by material, so the draws of each material are contiguous
+	if (m_bCullingOrderDirty)
+	{
+		QVector<COcclusionCulling::SObject>& culledObjects = m_pCulling->Objects();
+		culledObjects.clear();
+		m_materialDraws.fill(0, m_materials.size() + 1);
+		for (const SObjectData& data : m_objects)
+		{
+			if (data.m_iMesh >= 0)
+				m_materialDraws[data.m_uiMaterial + 1]++;
+		}
+		for (int material = 0; material < m_materials.size(); material++)
+			m_materialDraws[material + 1] += m_materialDraws[material];
+		culledObjects.resize(m_materialDraws.last());
+
+		QVector<int> draws = m_materialDraws;
+		m_culledSlots.fill(-1, m_objects.size());
+		for (int object = 0; object < m_objects.size(); object++)
+		{
+			const SObjectData& data = m_objects[object];
+			if (data.m_iMesh < 0)
+				continue;
+
+			m_culledSlots[object] = draws[data.m_uiMaterial]++;
+			culledObject(object, culledObjects[m_culledSlots[object]]);
+		}
+		m_bCullingOrderDirty = false;
+	}
+	else
+	{
+		// the objects which only moved keep their slot
+		COcclusionCulling::SObject moved;
+		for (int object = dirtyFirst; object <= dirtyLast; object++)
+		{
+			if (m_culledSlots[object] < 0)
+				continue;
+
+			culledObject(object, moved);
+			m_pCulling->SetObject(m_culledSlots[object], moved);
+		}
+	}
+
+	m_pCulling->Cull(i_depthTextures, i_depthSize, i_viewProjections, i_glState);
+}
+
+void COpenVROpenGLWidget::CSceneRenderer::Draw(int i_eye, const QMatrix4x4& i_viewProjection, CGLStateCache* i_glState)
+{
+	if (!IsValid() || m_materialDraws.isEmpty())
+		return;
+
+	i_glState->BindVertexArray(m_glVertexArray);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_OBJECTS_BINDING, m_glObjectBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_MATERIALS_BINDING, m_glMaterialBuffer);
+
+	// one indirect draw per material
+	for (int material = 0; material + 1 < m_materialDraws.size(); material++)
+	{
+		const int count = m_materialDraws[material + 1] - m_materialDraws[material];
+		if (count == 0)
+			continue;
+
+		QOpenGLShaderProgram* program = m_materialPrograms[material];
+		i_glState->UseProgram(program->programId());
+		program->setUniformValue("viewProjection", i_viewProjection);
+		m_pCulling->Draw(i_eye, GL_TRIANGLES, m_materialDraws[material], count);
+	}
+}
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	STREAMING BUFFER
+//
+
+COpenVROpenGLWidget::CStreamBuffer* COpenVROpenGLWidget::GetStreamBuffer()
+{
+	if (!m_pStreamBuffer)
+	{
+		m_pStreamBuffer = new CStreamBuffer(m_streamBufferFrameSize);
+		if (!m_pStreamBuffer->IsValid())
+			qCritical() << "Unable to map the streaming buffer.";
+	}
+	return m_pStreamBuffer;
+}
+
+void COpenVROpenGLWidget::SetStreamBufferFrameSize(GLsizeiptr i_size)
+{
+	if (i_size == m_streamBufferFrameSize)
+		return;
+
+	// the previous buffer is only freed by the driver once the GPU is done with it
+	m_streamBufferFrameSize = i_size;
+	delete m_pStreamBuffer;
+	m_pStreamBuffer = nullptr;
+}
+
+COpenVROpenGLWidget::CStreamBuffer::CStreamBuffer(GLsizeiptr i_regionSize) :
+	m_glBuffer(0),
+	m_pMapped(nullptr),
+	m_regionSize((i_regionSize + 255) & ~static_cast<GLsizeiptr>(255)),
+	m_iRegion(0),
+	m_head(0),
+	m_lastFrameUsage(0),
+	m_highWaterMark(0),
+	m_iFailedAllocations(0),
+	m_iStalls(0)
+{
+	initializeOpenGLFunctions();
+	for (int region = 0; region < s_frames; region++)
+		m_fences[region] = nullptr;
+
+	// the buffer is written by the CPU while the GPU reads the previous regions
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &m_glBuffer);
+	glNamedBufferStorage(m_glBuffer, s_frames * m_regionSize, nullptr, flags);
+	CGpuMemoryTracker::Track(GpuMemoryScene, GL_BUFFER, m_glBuffer, s_frames * m_regionSize);
+	m_pMapped = static_cast<char*>(glMapNamedBufferRange(m_glBuffer, 0, s_frames * m_regionSize, flags));
+}
+
+COpenVROpenGLWidget::CStreamBuffer::~CStreamBuffer()
+{
+	for (int region = 0; region < s_frames; region++)
+	{
+		if (m_fences[region])
+			glDeleteSync(m_fences[region]);
+	}
+
+	if (m_pMapped)
+		glUnmapNamedBuffer(m_glBuffer);
+	CGpuMemoryTracker::Untrack(GL_BUFFER, m_glBuffer);
+	glDeleteBuffers(1, &m_glBuffer);
+}
+
+COpenVROpenGLWidget::CStreamBuffer::SAllocation COpenVROpenGLWidget::CStreamBuffer::Allocate(GLsizeiptr i_size, GLsizeiptr i_alignment)
+{
+	SAllocation allocation;
+	i_alignment = qMax(i_alignment, static_cast<GLsizeiptr>(1));
+	const GLsizeiptr offset = ((m_head + i_alignment - 1) / i_alignment) * i_alignment;
+	m_highWaterMark = qMax(m_highWaterMark, offset + i_size);
+	if (!m_pMapped || offset + i_size > m_regionSize)
+	{
+		m_iFailedAllocations++;
+		return allocation;
+	}
+
+	m_head = offset + i_size;
+	allocation.m_glBuffer = m_glBuffer;
+	allocation.m_offset = m_iRegion * m_regionSize + offset;
+	allocation.m_size = i_size;
+	allocation.m_pData = m_pMapped + allocation.m_offset;
+	return allocation;
+}
+
+void COpenVROpenGLWidget::CStreamBuffer::BeginFrame()
+{
+	m_lastFrameUsage = m_head;
+	m_head = 0;
+	m_iRegion = (m_iRegion + 1) % s_frames;
+
+	// the region was written s_frames frames ago, the GPU has usually read it already
+	GLsync& fence = m_fences[m_iRegion];
+	if (!fence)
+		return;
+
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+	{
+		m_iStalls++;
+		status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_BUFFER_WAIT_TIMEOUT_NS);
+	}
+	if (status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED)
+		qDebug() << "The GPU didn't release the region" << m_iRegion << "of the streaming buffer.";
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void COpenVROpenGLWidget::CStreamBuffer::EndFrame()
+{
+	if (m_head == 0)
+		return;
+
+	GLsync& fence = m_fences[m_iRegion];
+	if (fence)
+		glDeleteSync(fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void COpenVROpenGLWidget::CStreamBuffer::ResetStatistics()
+{
+	m_highWaterMark = 0;
+	m_iFailedAllocations = 0;
+	m_iStalls = 0;
+}
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	GPU MEMORY
+//
+
+qint64 COpenVROpenGLWidget::GetGpuMemory(GpuMemoryCategory i_category) const
+{
+	return CGpuMemoryTracker::Total(context() ? context()->shareGroup() : nullptr, i_category);
+}
+
+qint64 COpenVROpenGLWidget::GetGpuMemoryTotal() const
+{
+	return CGpuMemoryTracker::Total(context() ? context()->shareGroup() : nullptr);
+}
+
+void COpenVROpenGLWidget::SetGpuMemoryBudget(qint64 i_iBytes)
+{
+	m_iGpuMemoryBudget = i_iBytes;
+	m_bGpuMemoryOverBudget = false;
+}
+
+void COpenVROpenGLWidget::checkGpuMemory()
+{
+	// the driver counts the memory of all the processes; the query may stall, so it isn't done every frame
+	if (--m_iGpuMemoryQueryCountdown <= 0)
+	{
+		m_iGpuMemoryQueryCountdown = GPU_MEMORY_QUERY_INTERVAL;
+
+		GLint kiloBytes[4] = { -1, -1, -1, -1 };
+		if (context()->hasExtension("GL_NVX_gpu_memory_info"))
+			glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, kiloBytes);
+		else if (context()->hasExtension("GL_ATI_meminfo"))
+			glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, kiloBytes);
+		m_iGpuMemoryAvailable = (kiloBytes[0] >= 0) ? static_cast<qint64>(kiloBytes[0]) * 1024 : -1;
+	}
+
+	if (m_iGpuMemoryBudget <= 0)
+		return;
+
+	qint64 used = GetGpuMemoryTotal();
+	bool overBudget = used > m_iGpuMemoryBudget || (m_iGpuMemoryAvailable >= 0 && m_iGpuMemoryAvailable < GPU_MEMORY_MIN_AVAILABLE);
+	if (overBudget && !m_bGpuMemoryOverBudget)
+	{
+		qDebug() << "GPU memory over budget:" << used << "bytes used," << m_iGpuMemoryAvailable << "bytes available.";
+		emit gpuMemoryBudgetExceeded(used, m_iGpuMemoryAvailable);
+	}
+	m_bGpuMemoryOverBudget = overBudget;
+}
+
+QHash<QOpenGLContextGroup*, QHash<quint64, COpenVROpenGLWidget::CGpuMemoryTracker::SAllocation>> COpenVROpenGLWidget::CGpuMemoryTracker::s_allocations;
+
+void COpenVROpenGLWidget::CGpuMemoryTracker::Track(GpuMemoryCategory i_category, GLenum i_glType, GLuint i_glObject, qint64 i_iBytes)
+{
+	QOpenGLContextGroup* group = QOpenGLContextGroup::currentContextGroup();
+	if (!group || !i_glObject)
+		return;
+
+	SAllocation allocation = { i_category, i_iBytes };
+	s_allocations[group].insert(key(i_glType, i_glObject), allocation);
+}
+
+void COpenVROpenGLWidget::CGpuMemoryTracker::Untrack(GLenum i_glType, GLuint i_glObject)
+{
+	auto group = s_allocations.find(QOpenGLContextGroup::currentContextGroup());
+	if (group == s_allocations.end())
+		return;
+
+	// a group without objects is forgotten, its address may be reused by a new one
+	group->remove(key(i_glType, i_glObject));
+	if (group->isEmpty())
+		s_allocations.erase(group);
+}
+
+void COpenVROpenGLWidget::CGpuMemoryTracker::TrackProgram(QOpenGLShaderProgram* i_program)
+{
+	QOpenGLContext* context = QOpenGLContext::currentContext();
+	if (!context || !i_program || !i_program->isLinked())
+		return;
+
+	// the size of the binary is the closest the API gives to the memory of the program
+	GLint length = 0;
+	context->functions()->glGetProgramiv(i_program->programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+	Track(GpuMemoryPrograms, GL_PROGRAM, i_program->programId(), length);
+}
+
+void COpenVROpenGLWidget::CGpuMemoryTracker::UntrackProgram(QOpenGLShaderProgram* i_program)
+{
+	if (i_program && i_program->isLinked())
+		Untrack(GL_PROGRAM, i_program->programId());
+}
+
+qint64 COpenVROpenGLWidget::CGpuMemoryTracker::TextureBytes(const QSize& i_size, GLenum i_glFormat, int i_iLevels, int i_iSamples)
+{
+	qint64 pixels = 0;
+	for (int level = 0; level < i_iLevels; level++)
+		pixels += static_cast<qint64>(qMax(1, i_size.width() >> level)) * qMax(1, i_size.height() >> level);
+	return pixels * CFrameTarget::BytesPerPixel(i_glFormat) * qMax(1, i_iSamples);
+}
+
+qint64 COpenVROpenGLWidget::CGpuMemoryTracker::Total(QOpenGLContextGroup* i_group, int i_iCategory)
+{
+	auto group = s_allocations.constFind(i_group);
+	if (group == s_allocations.constEnd())
+		return 0;
+
+	qint64 bytes = 0;
+	for (const SAllocation& allocation : *group)
+	{
+		if (i_iCategory < 0 || allocation.m_category == i_iCategory)
+			bytes += allocation.m_iBytes;
+	}
+	return bytes;
+}
+
+
+
+
+
+
+
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	INPUT ACTIONS
+//
+
+bool COpenVROpenGLWidget::SetInputActions(const QStringList& i_actionSets, const QVector<SInputAction>& i_actions)
+{
+	stopInputSampler();
+	m_inputActionSets.clear();
+	m_activeActionSets.clear();
+	m_inputActionHandles.clear();
+	m_inputActionTypes.clear();
+
+	// the bits of the snapshot hold one action each
+	if (i_actions.size() > 64)
+	{
+		qDebug() << "Too many input actions:" << i_actions.size() << "for 64 at most.";
+		return false;
+	}
+
+	bool noErr = true;
+	for (const QString& path : i_actionSets)
+	{
+		vr::VRActionSetHandle_t handle = vr::k_ulInvalidActionSetHandle;
+		vr::EVRInputError error = vr::VRInput()->GetActionSetHandle(path.toUtf8().constData(), &handle);
+		if (error != vr::VRInputError_None)
+		{
+			qDebug() << "Unknown action set" << path << "- error" << error;
+			noErr = false;
+		}
+		m_inputActionSets.append(handle);
+
+		vr::VRActiveActionSet_t activeSet = {};
+		activeSet.ulActionSet = handle;
+		m_activeActionSets.append(activeSet);
+	}
+
+	for (const SInputAction& action : i_actions)
+	{
+		vr::VRActionHandle_t handle = vr::k_ulInvalidActionHandle;
+		vr::EVRInputError error = vr::VRInput()->GetActionHandle(action.m_sPath, &handle);
+		if (error != vr::VRInputError_None)
+		{
+			qDebug() << "Unknown action" << action.m_sPath << "- error" << error;
+			noErr = false;
+		}
+		m_inputActionHandles.append(handle);
+		m_inputActionTypes.append(action.m_type);
+	}
+
+	// the snapshot is sized once, then only written
+	m_inputSnapshot.m_uiActive = m_inputSnapshot.m_uiDown = m_inputSnapshot.m_uiPressed = m_inputSnapshot.m_uiReleased = 0;
+	m_inputSnapshot.m_analog.fill(QVector3D(), i_actions.size());
+	m_inputSnapshot.m_analogDelta.fill(QVector3D(), i_actions.size());
+	m_inputSnapshot.m_poses.fill(QMatrix4x4(), i_actions.size());
+	m_inputSnapshot.m_velocities.fill(QVector3D(), i_actions.size());
+
+	startInputSampler();
+	return noErr;
 }
 
-const QMatrix4x4& COpenVROpenGLWidget::GetControllerPose(int i_hand)
-{
-	return m_controllers[i_hand].m_rmat4Pose;
-}
+void COpenVROpenGLWidget::SetInputActionSetActive(int i_iSet, bool i_bActive)
+{
+	if (i_iSet < 0 || i_iSet >= m_inputActionSets.size())
+	{
+		qDebug() << "Unknown action set" << i_iSet << "of" << m_inputActionSets.size();
+		return;
+	}
+
+	const vr::VRActionSetHandle_t handle = m_inputActionSets[i_iSet];
+	int active = -1;
+	for (int i = 0; i < m_activeActionSets.size(); i++)
+	{
+		if (m_activeActionSets[i].ulActionSet == handle)
+			active = i;
+	}
+	if ((active >= 0) == i_bActive)
+		return;
+
+	if (i_bActive)
+	{
+		vr::VRActiveActionSet_t activeSet = {};
+		activeSet.ulActionSet = handle;
+		m_activeActionSets.append(activeSet);
+	}
+	else
+		m_activeActionSets.remove(active);
 
-QMatrix4x4 COpenVROpenGLWidget::GetCameraMatrix()
-{
-	QMatrix4x4 cameraTransform;
-	cameraTransform.rotate(QQuaternion::fromEulerAngles(m_cameraRotations));
-	cameraTransform.translate(m_cameraTranslation);
-	return cameraTransform;
+	// the sampling thread has its own copy of the sets, it keeps running
+	if (m_pInputSampler)
+		m_pInputSampler->SetActionSets(m_activeActionSets);
 }
 
+void COpenVROpenGLWidget::updateInputSnapshot()
+{
+	if (m_inputActionHandles.isEmpty())
+		return;
 
+	SInputSnapshot& snapshot = m_inputSnapshot;
+	const quint64 wasDown = snapshot.m_uiDown;
+	snapshot.m_uiPressed = snapshot.m_uiReleased = 0;
 
+	if (m_pInputSampler)
+	{
+		// the changes captured since the previous frame, in order
+		m_inputSamples.clear();
+		for (QVector3D& delta : snapshot.m_analogDelta)
+			delta = QVector3D();
 
+		SInputSample sample;
+		while (m_pInputSampler->PopSample(sample))
+		{
+			const quint64 bit = static_cast<quint64>(1) << sample.m_iAction;
+			snapshot.m_uiActive = sample.m_bActive ? (snapshot.m_uiActive | bit) : (snapshot.m_uiActive & ~bit);
+			if (m_inputActionTypes[sample.m_iAction] == InputDigital)
+			{
+				if (sample.m_bState && !(snapshot.m_uiDown & bit))
+					snapshot.m_uiPressed |= bit;
+				else if (!sample.m_bState && (snapshot.m_uiDown & bit))
+					snapshot.m_uiReleased |= bit;
+				snapshot.m_uiDown = sample.m_bState ? (snapshot.m_uiDown | bit) : (snapshot.m_uiDown & ~bit);
+			}
+			else
+			{
+				if (sample.m_bActive)
+					snapshot.m_analogDelta[sample.m_iAction] += sample.m_value - snapshot.m_analog[sample.m_iAction];
+				snapshot.m_analog[sample.m_iAction] = sample.m_value;
+			}
+			m_inputSamples.append(sample);
+		}
+	}
+	else
+	{
+		// one update for all the sets, then each action is read into the arrays of its kind
+		if (!m_activeActionSets.isEmpty())
+			vr::VRInput()->UpdateActionState(m_activeActionSets.data(), sizeof(vr::VRActiveActionSet_t), m_activeActionSets.size());
+		snapshot.m_uiActive = snapshot.m_uiDown = 0;
+	}
 
+	for (int action = 0; action < m_inputActionHandles.size(); action++)
+	{
+		const quint64 bit = static_cast<quint64>(1) << action;
+		switch (m_inputActionTypes[action])
+		{
+		case InputDigital:
+		{
+			// already drained from the sampling thread
+			if (m_pInputSampler)
+				break;
 
+			vr::InputDigitalActionData_t data;
+			if (vr::VRInput()->GetDigitalActionData(m_inputActionHandles[action], &data, sizeof(data), vr::k_ulInvalidInputValueHandle) != vr::VRInputError_None || !data.bActive)
+				break;
 
+			snapshot.m_uiActive |= bit;
+			if (data.bState)
+				snapshot.m_uiDown |= bit;
+			break;
+		}
 
+		case InputAnalog:
+		{
+			if (m_pInputSampler)
+				break;
 
-// ////////////////////////////////////////////////////////////////////////////////////////////////
-//
-//	EYE INFORMATIONS FOR RENDERING
-//
+			vr::InputAnalogActionData_t data;
+			if (vr::VRInput()->GetAnalogActionData(m_inputActionHandles[action], &data, sizeof(data), vr::k_ulInvalidInputValueHandle) != vr::VRInputError_None || !data.bActive)
+			{
+				snapshot.m_analog[action] = snapshot.m_analogDelta[action] = QVector3D();
+				break;
+			}
 
-COpenVROpenGLWidget::CEyeInfos::CEyeInfos(const QSize& i_eyeSize) :
-	m_size(i_eyeSize),
-	m_frameBuffer(nullptr),
-	m_resolveBuffer(nullptr)
-{
-	initializeOpenGLFunctions();
+			snapshot.m_uiActive |= bit;
+			snapshot.m_analog[action] = QVector3D(data.x, data.y, data.z);
+			snapshot.m_analogDelta[action] = QVector3D(data.deltaX, data.deltaY, data.deltaZ);
+			break;
+		}
 
-	QOpenGLFramebufferObjectFormat buffFormat;
-	buffFormat.setAttachment(QOpenGLFramebufferObject::Depth);
-	buffFormat.setInternalTextureFormat(GL_RGBA8);
-	buffFormat.setSamples(4);
+		case InputPose:
+		{
+			snapshot.m_uiActive &= ~bit;
 
-	m_frameBuffer = new QOpenGLFramebufferObject(m_size.width(), m_size.height(), buffFormat);
+			vr::InputPoseActionData_t data;
+			if (vr::VRInput()->GetPoseActionDataForNextFrame(m_inputActionHandles[action], vr::TrackingUniverseStanding, &data, sizeof(data), vr::k_ulInvalidInputValueHandle) != vr::VRInputError_None ||
+				!data.bActive || !data.pose.bPoseIsValid)
+				break;
 
-	QOpenGLFramebufferObjectFormat resolveFormat;
-	resolveFormat.setInternalTextureFormat(GL_RGBA8);
-	resolveFormat.setSamples(0);
+			snapshot.m_uiActive |= bit;
+			snapshot.m_poses[action] = vrMatrixToQt(data.pose.mDeviceToAbsoluteTracking);
+			snapshot.m_velocities[action] = QVector3D(data.pose.vVelocity.v[0], data.pose.vVelocity.v[1], data.pose.vVelocity.v[2]);
+			break;
+		}
+		}
+	}
 
-	m_resolveBuffer = new QOpenGLFramebufferObject(m_size.width(), m_size.height(), resolveFormat);
+	// the edges of the states which changed once
+	snapshot.m_uiPressed |= snapshot.m_uiDown & ~wasDown;
+	snapshot.m_uiReleased |= wasDown & ~snapshot.m_uiDown;
 }
 
-COpenVROpenGLWidget::CEyeInfos::~CEyeInfos()
+void COpenVROpenGLWidget::SetInputSamplingRate(int i_iHz)
 {
-	delete m_resolveBuffer;
-	delete m_frameBuffer;
+	m_iInputSamplingRate = qMax(0, i_iHz);
+	if (m_pInputSampler && m_iInputSamplingRate > 0)
+	{
+		m_pInputSampler->SetRate(m_iInputSamplingRate);
+		return;
+	}
+
+	stopInputSampler();
+	startInputSampler();
 }
 
-void COpenVROpenGLWidget::CEyeInfos::SetSurface()
+void COpenVROpenGLWidget::startInputSampler()
 {
-	glViewport(0, 0, m_size.width(), m_size.height());
+	if (m_pInputSampler || m_iInputSamplingRate <= 0 || !m_vrSystem || m_inputActionHandles.isEmpty())
+		return;
 
-	glEnable(GL_MULTISAMPLE);
-	m_frameBuffer->bind();
+	m_pInputSampler = new CInputSampler(m_activeActionSets, m_inputActionHandles, m_inputActionTypes, m_inputSnapshot, m_runtimeMutex, m_iInputSamplingRate);
 }
 
-void COpenVROpenGLWidget::CEyeInfos::UnsetSurface()
+void COpenVROpenGLWidget::stopInputSampler()
 {
-	m_frameBuffer->release();
+	// the samples are outdated by the new table or the reads of each frame, not the events
+	if (m_pInputSampler)
+	{
+		m_pInputSampler->Stop();
+		vr::VREvent_t event;
+		while (m_pInputSampler->PopEvent(event))
+			m_pendingVREvents.append(event);
+	}
 
-	QRect sourceAndTargetRect(0, 0, m_size.width(), m_size.height());
-	QOpenGLFramebufferObject::blitFramebuffer(m_resolveBuffer, sourceAndTargetRect, m_frameBuffer, sourceAndTargetRect);
+	delete m_pInputSampler;
+	m_pInputSampler = nullptr;
+	m_inputSamples.clear();
 }
 
-GLuint COpenVROpenGLWidget::CEyeInfos::Texture()
+COpenVROpenGLWidget::CInputSampler::CInputSampler(const QVector<vr::VRActiveActionSet_t>& i_actionSets, const QVector<vr::VRActionHandle_t>& i_actionHandles,
+	const QVector<InputActionType>& i_actionTypes, const SInputSnapshot& i_snapshot, std::recursive_mutex& i_runtimeMutex, int i_iHz) :
+	m_actionSets(i_actionSets),
+	m_runtimeMutex(i_runtimeMutex),
+	m_actionHandles(i_actionHandles),
+	m_actionTypes(i_actionTypes),
+	m_actives(i_actionHandles.size()),
+	m_states(i_actionHandles.size()),
+	m_values(i_snapshot.m_analog),
+	m_iPeriod(1000000 / i_iHz),
+	m_uiDropped(0),
+	m_bStop(false)
 {
-	return m_resolveBuffer->texture();
-}
+	// the thread starts from the states of the snapshot, so the changes made while it was stopped are queued
+	for (int action = 0; action < m_actives.size(); action++)
+	{
+		m_actives[action] = i_snapshot.IsActive(action);
+		m_states[action] = i_snapshot.IsDown(action);
+	}
 
-void COpenVROpenGLWidget::CEyeInfos::SetTransformMatrix(const QMatrix4x4& i_view, const QMatrix4x4& i_projection)
-{
-	m_view = i_view;
-	m_projection = i_projection;
+	// the copies are only read by the thread, the sets are replaced under the lock
+	m_thread = std::thread(&CInputSampler::run, this);
 }
 
-const QMatrix4x4&  COpenVROpenGLWidget::CEyeInfos::GetProjectionMatrix()
+COpenVROpenGLWidget::CInputSampler::~CInputSampler()
 {
-	return m_projection;
+	Stop();
+
+	if (m_uiDropped)
+		qDebug() << m_uiDropped << "input samples waited for the ring, the GUI thread didn't drain it in time.";
 }
 
-const QMatrix4x4&  COpenVROpenGLWidget::CEyeInfos::GetViewMatrix()
+void COpenVROpenGLWidget::CInputSampler::Stop()
 {
-	return m_view;
+	if (!m_thread.joinable())
+		return;
+
+	m_bStop = true;
+	m_thread.join();
 }
 
-bool COpenVROpenGLWidget::CEyeInfos::IsValid()
+void COpenVROpenGLWidget::CInputSampler::SetActionSets(const QVector<vr::VRActiveActionSet_t>& i_actionSets)
 {
-	return (m_frameBuffer != nullptr) && (m_resolveBuffer != nullptr) && m_frameBuffer->isValid() && m_resolveBuffer->isValid();
+	std::lock_guard<std::recursive_mutex> lock(m_runtimeMutex);
+	m_actionSets = i_actionSets;
 }
 
+void COpenVROpenGLWidget::CInputSampler::run()
+{
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	while (!m_bStop)
+	{
+		// a fixed rate, without drifting when a pass is late
+		next += std::chrono::microseconds(m_iPeriod);
+		std::this_thread::sleep_until(next);
 
+		// the pass is skipped while the GUI thread calls the runtime, so it can stop the thread with the lock held
+		std::unique_lock<std::recursive_mutex> lock(m_runtimeMutex, std::try_to_lock);
+		if (!lock.owns_lock())
+			continue;
 
+		if (!m_actionSets.isEmpty())
+			vr::VRInput()->UpdateActionState(m_actionSets.data(), sizeof(vr::VRActiveActionSet_t), m_actionSets.size());
 
+		SInputSample sample;
+		vr::VRSystem()->GetTimeSinceLastVsync(&sample.m_fSecondsSinceVsync, &sample.m_ulVsyncFrame);
 
+		// only the changes are queued: an inactive action is released, with a null value
+		for (int action = 0; action < m_actionHandles.size(); action++)
+		{
+			sample.m_iAction = action;
+			sample.m_bActive = false;
+			sample.m_bState = false;
+			sample.m_value = QVector3D();
+			if (m_actionTypes[action] == InputDigital)
+			{
+				vr::InputDigitalActionData_t data;
+				if (vr::VRInput()->GetDigitalActionData(m_actionHandles[action], &data, sizeof(data), vr::k_ulInvalidInputValueHandle) == vr::VRInputError_None &&
+					data.bActive)
+				{
+					sample.m_bActive = true;
+					sample.m_bState = data.bState;
+				}
+				if (sample.m_bActive == m_actives[action] && sample.m_bState == m_states[action])
+					continue;
+			}
+			else if (m_actionTypes[action] == InputAnalog)
+			{
+				vr::InputAnalogActionData_t data;
+				if (vr::VRInput()->GetAnalogActionData(m_actionHandles[action], &data, sizeof(data), vr::k_ulInvalidInputValueHandle) == vr::VRInputError_None &&
+					data.bActive)
+				{
+					sample.m_bActive = true;
+					sample.m_value = QVector3D(data.x, data.y, data.z);
+				}
+				if (sample.m_bActive == m_actives[action] && sample.m_value == m_values[action])
+					continue;
+			}
+			else
+				continue;
 
+			// the change is kept only once queued, otherwise it is queued again at the next pass
+			if (!m_samples.Push(sample))
+			{
+				m_uiDropped++;
+				continue;
+			}
+			m_actives[action] = sample.m_bActive;
+			m_states[action] = sample.m_bState;
+			m_values[action] = sample.m_value;
+		}
 
+		// the events stay in the runtime while the ring is full, e.g. when the widget is hidden and doesn't paint
+		vr::VREvent_t event;
+		while (!m_events.IsFull() && vr::VRSystem()->PollNextEvent(&event, sizeof(event)))
+			m_events.Push(event);
+	}
+}
 
-// ////////////////////////////////////////////////////////////////////////////////////////////////
-//
-//	EYE INFORMATIONS FOR RENDERING
-//
 
-#define RENDERMODEL_VERTEX_SHADER \
-	"#version 450\n" \
-	"uniform mat4 matrix;\n" \
-	"layout(location = 0) in vec4 position;\n" \
-	"layout(location = 1) in vec3 v3NormalIn;\n" \
-	"layout(location = 2) in vec2 v2TexCoordsIn;\n" \
-	"out vec2 v2TexCoord;\n" \
-	"void main()\n" \
-	"{\n" \
-	"	v2TexCoord = v2TexCoordsIn;\n" \
-	"	gl_Position = matrix * vec4(position.xyz, 1);\n" \
-	"}\n"
 
-#define RENDERMODEL_FRAGMENT_SHADER \
-	"#version 450 core\n" \
-	"uniform sampler2D diffuse;\n" \
-	"in vec2 v2TexCoord;\n" \
-	"layout(location = 0) out vec4 FragColor;\n" \
-	"void main()\n" \
-	"{\n" \
-	"   FragColor = texture( diffuse, v2TexCoord);\n" \
-	"}\n"
 
-COpenVROpenGLWidget::CRenderModel::CRenderModel(const QString& i_sRenderModelName) :
-	m_sModelName(i_sRenderModelName),
-	m_glIndexBuffer(0),
-	m_glVertArray(0),
-	m_glVertBuffer(0),
-	m_glTexture(0),
-	m_program(new QOpenGLShaderProgram())
-{
-	initializeOpenGLFunctions();
 
-	bool noError = true;
 
-	// compile vertex shader
-	QString vertexShaderSource(RENDERMODEL_VERTEX_SHADER);
-	noError &= m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource);
-	if (!noError)
-	{
-		qDebug() << m_program->log();
-		return;
-	}
+// ////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	DEVICE PROPERTIES
+//
 
-	// compile fragment shader
-	QString fragSahderSource(RENDERMODEL_FRAGMENT_SHADER);
-	noError &= m_program->addShaderFromSourceCode(QOpenGLShader::Fragment,fragSahderSource);
-	if (!noError)
-	{
-		qDebug() << m_program->log();
-		return;
-	}
+const vr::TrackedDeviceProperty COpenVROpenGLWidget::CDevicePropertyCache::s_stringProperties[s_iStringCount] = {
+	vr::Prop_TrackingSystemName_String,
+	vr::Prop_ModelNumber_String,
+	vr::Prop_SerialNumber_String,
+	vr::Prop_RenderModelName_String,
+	vr::Prop_ManufacturerName_String,
+	vr::Prop_TrackingFirmwareVersion_String,
+	vr::Prop_HardwareRevision_String,
+	vr::Prop_ControllerType_String,
+	vr::Prop_InputProfilePath_String,
+	vr::Prop_RegisteredDeviceType_String
+};
+
+const vr::TrackedDeviceProperty COpenVROpenGLWidget::CDevicePropertyCache::s_intProperties[s_iIntCount] = {
+	vr::Prop_DeviceClass_Int32,
+	vr::Prop_ControllerRoleHint_Int32,
+	vr::Prop_Axis0Type_Int32,
+	vr::Prop_Axis1Type_Int32,
+	vr::Prop_Axis2Type_Int32,
+	vr::Prop_DisplayMCType_Int32
+};
+
+const vr::TrackedDeviceProperty COpenVROpenGLWidget::CDevicePropertyCache::s_floatProperties[s_iFloatCount] = {
+	vr::Prop_DisplayFrequency_Float,
+	vr::Prop_UserIpdMeters_Float,
+	vr::Prop_DeviceBatteryPercentage_Float,
+	vr::Prop_SecondsFromVsyncToPhotons_Float,
+	vr::Prop_UserHeadToEyeDepthMeters_Float
+};
+
+const vr::TrackedDeviceProperty COpenVROpenGLWidget::CDevicePropertyCache::s_boolProperties[s_iBoolCount] = {
+	vr::Prop_DeviceProvidesBatteryStatus_Bool,
+	vr::Prop_DeviceIsCharging_Bool,
+	vr::Prop_DeviceIsWireless_Bool,
+	vr::Prop_WillDriftInYaw_Bool,
+	vr::Prop_ContainsProximitySensor_Bool
+};
+
+COpenVROpenGLWidget::CDevicePropertyCache::CDevicePropertyCache() :
+	m_bOverflowReported(false)
+{
+	for (vr::TrackedDeviceIndex_t device = 0; device < vr::k_unMaxTrackedDeviceCount; device++)
+		Clear(device);
+}
 
-	// link
-	noError &= m_program->link();
-	if (!noError)
+int COpenVROpenGLWidget::CDevicePropertyCache::find(const vr::TrackedDeviceProperty* i_table, int i_iCount, vr::TrackedDeviceProperty i_prop)
+{
+	for (int i = 0; i < i_iCount; i++)
 	{
-		qDebug() << m_program->log();
-		return;
+		if (i_table[i] == i_prop)
+			return i;
 	}
+	return -1;
 }
 
-COpenVROpenGLWidget::CRenderModel::~CRenderModel()
+void COpenVROpenGLWidget::CDevicePropertyCache::Read(vr::IVRSystem* i_vrSystem, vr::TrackedDeviceIndex_t i_device)
 {
-	Cleanup();
+	readStrings(i_vrSystem, i_device);
+	for (vr::TrackedDeviceProperty prop : s_intProperties)
+		readValue(i_vrSystem, i_device, prop);
+	for (vr::TrackedDeviceProperty prop : s_floatProperties)
+		readValue(i_vrSystem, i_device, prop);
+	for (vr::TrackedDeviceProperty prop : s_boolProperties)
+		readValue(i_vrSystem, i_device, prop);
 }
 
-COpenVROpenGLWidget::CRenderModel* COpenVROpenGLWidget::CRenderModel::LoadModel(const QString& i_modelName, QString* o_errorMessage)
+void COpenVROpenGLWidget::CDevicePropertyCache::readStrings(vr::IVRSystem* i_vrSystem, vr::TrackedDeviceIndex_t i_device)
 {
-	COpenVROpenGLWidget::CRenderModel* pRenderModel;
-	vr::RenderModel_t *pModel;
-	vr::EVRRenderModelError error;
-	while (true)
+	// each string is read straight into the free end of the arena, with a single call to the runtime
+	SDevice& device = m_devices[i_device];
+	uint32_t used = 0;
+	for (int i = 0; i < s_iStringCount; i++)
 	{
-		error = vr::VRRenderModels()->LoadRenderModel_Async(i_modelName.toStdString().c_str(), &pModel);
-		if (error != vr::VRRenderModelError_Loading)
-			break;
+		device.m_stringOffsets[i] = s_uiMissing;
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(10));
-	}
+		vr::TrackedPropertyError error = vr::TrackedProp_Success;
+		uint32_t len = i_vrSystem->GetStringTrackedDeviceProperty(i_device, s_stringProperties[i], device.m_strings + used, s_iStringArenaSize - used, &error);
 
-	if (error != vr::VRRenderModelError_None)
-	{
-		QString errMessage("Unable to load render model %1 - %2");
-		errMessage = errMessage.arg(i_modelName).arg(vr::VRRenderModels()->GetRenderModelErrorNameFromEnum(error));
-		qDebug() << errMessage;
-		if (o_errorMessage != nullptr)
-			*o_errorMessage = errMessage;
-		return nullptr; 
+		// reported once: the string is missing from the cache as if the device didn't have it
+		if (error == vr::TrackedProp_BufferTooSmall && !m_bOverflowReported)
+		{
+			qDebug() << "Property" << s_stringProperties[i] << "of device" << i_device << "too long to be cached:" << len << "bytes";
+			m_bOverflowReported = true;
+		}
+		if (error != vr::TrackedProp_Success || len == 0)
+			continue;
+
+		device.m_stringOffsets[i] = static_cast<quint16>(used);
+		used += len;
 	}
+}
 
-	vr::RenderModel_TextureMap_t *pTexture;
-	while (1)
-	{
-		error = vr::VRRenderModels()->LoadTexture_Async(pModel->diffuseTextureId, &pTexture);
-		if (error != vr::VRRenderModelError_Loading)
-			break;
+void COpenVROpenGLWidget::CDevicePropertyCache::readValue(vr::IVRSystem* i_vrSystem, vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop)
+{
+	SDevice& device = m_devices[i_device];
+	vr::TrackedPropertyError error = vr::TrackedProp_Success;
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	int index = find(s_intProperties, s_iIntCount, i_prop);
+	if (index >= 0)
+	{
+		device.m_ints[index] = i_vrSystem->GetInt32TrackedDeviceProperty(i_device, i_prop, &error);
+		device.m_uiValidInts = (error == vr::TrackedProp_Success) ? (device.m_uiValidInts | (1u << index)) : (device.m_uiValidInts & ~(1u << index));
+		return;
 	}
 
-	if (error != vr::VRRenderModelError_None)
+	index = find(s_floatProperties, s_iFloatCount, i_prop);
+	if (index >= 0)
 	{
-		QString errMessage("Unable to load render texture id:%1 for render model %2");
-		errMessage = errMessage.arg(pModel->diffuseTextureId).arg(i_modelName);
-		qDebug() << errMessage;
-		if (o_errorMessage != nullptr)
-			*o_errorMessage = errMessage;
-		vr::VRRenderModels()->FreeRenderModel(pModel);
-		return nullptr;
+		device.m_floats[index] = i_vrSystem->GetFloatTrackedDeviceProperty(i_device, i_prop, &error);
+		device.m_uiValidFloats = (error == vr::TrackedProp_Success) ? (device.m_uiValidFloats | (1u << index)) : (device.m_uiValidFloats & ~(1u << index));
+		return;
 	}
 
-	pRenderModel = new CRenderModel(i_modelName);
-	if (!pRenderModel->InitModel(*pModel, *pTexture))
+	index = find(s_boolProperties, s_iBoolCount, i_prop);
+	if (index >= 0)
 	{
-		QString errMessage("Unable to create GL model from render model %1");
-		errMessage = errMessage.arg(i_modelName);
-		qDebug() << errMessage;
-		if (o_errorMessage != nullptr)
-			*o_errorMessage = errMessage;
-		delete pRenderModel;
-		pRenderModel = nullptr;
+		device.m_bools[index] = i_vrSystem->GetBoolTrackedDeviceProperty(i_device, i_prop, &error);
+		device.m_uiValidBools = (error == vr::TrackedProp_Success) ? (device.m_uiValidBools | (1u << index)) : (device.m_uiValidBools & ~(1u << index));
 	}
-	vr::VRRenderModels()->FreeRenderModel(pModel);
-	vr::VRRenderModels()->FreeTexture(pTexture);
-
-	if (o_errorMessage != nullptr && pRenderModel != nullptr)
-		*o_errorMessage = "Success";
-
-	return pRenderModel;
 }
 
-bool COpenVROpenGLWidget::CRenderModel::InitModel(const vr::RenderModel_t & i_vrModel, const vr::RenderModel_TextureMap_t & i_vrDiffuseTexture)
+void COpenVROpenGLWidget::CDevicePropertyCache::Update(vr::IVRSystem* i_vrSystem, vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop)
 {
-	// create and bind a VAO to hold state for this model
-	glGenVertexArrays(1, &m_glVertArray);
-	glBindVertexArray(m_glVertArray);
-
-	// Populate a vertex buffer
-	glGenBuffers(1, &m_glVertBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, m_glVertBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vr::RenderModel_Vertex_t) * i_vrModel.unVertexCount, i_vrModel.rVertexData, GL_STATIC_DRAW);
-
-	// Identify the components in the vertex buffer
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vr::RenderModel_Vertex_t), (void *)offsetof(vr::RenderModel_Vertex_t, vPosition));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vr::RenderModel_Vertex_t), (void *)offsetof(vr::RenderModel_Vertex_t, vNormal));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vr::RenderModel_Vertex_t), (void *)offsetof(vr::RenderModel_Vertex_t, rfTextureCoord));
-
-	// Create and populate the index buffer
-	glGenBuffers(1, &m_glIndexBuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_glIndexBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * i_vrModel.unTriangleCount * 3, i_vrModel.rIndexData, GL_STATIC_DRAW);
-
-	glBindVertexArray(0);
-
-	// create and populate the texture
-	glGenTextures(1, &m_glTexture);
-	glBindTexture(GL_TEXTURE_2D, m_glTexture);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, i_vrDiffuseTexture.unWidth, i_vrDiffuseTexture.unHeight,
-		0, GL_RGBA, GL_UNSIGNED_BYTE, i_vrDiffuseTexture.rubTextureMapData);
-
-	// If this renders black ask McJohn what's wrong.
-	glGenerateMipmap(GL_TEXTURE_2D);
+	// the length of a string may change, the arena is packed again
+	if (find(s_stringProperties, s_iStringCount, i_prop) >= 0)
+		readStrings(i_vrSystem, i_device);
+	else
+		readValue(i_vrSystem, i_device, i_prop);
+}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+void COpenVROpenGLWidget::CDevicePropertyCache::Clear(vr::TrackedDeviceIndex_t i_device)
+{
+	SDevice& device = m_devices[i_device];
+	for (int i = 0; i < s_iStringCount; i++)
+		device.m_stringOffsets[i] = s_uiMissing;
+	device.m_uiValidInts = 0;
+	device.m_uiValidFloats = 0;
+	device.m_uiValidBools = 0;
+}
 
-	GLfloat fLargest;
-	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &fLargest);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, fLargest);
+const char* COpenVROpenGLWidget::CDevicePropertyCache::GetString(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop) const
+{
+	int index = find(s_stringProperties, s_iStringCount, i_prop);
+	if (i_device >= vr::k_unMaxTrackedDeviceCount || index < 0 || m_devices[i_device].m_stringOffsets[index] == s_uiMissing)
+		return nullptr;
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	return m_devices[i_device].m_strings + m_devices[i_device].m_stringOffsets[index];
+}
 
-	m_unVertexCount = i_vrModel.unTriangleCount * 3;
+bool COpenVROpenGLWidget::CDevicePropertyCache::GetInt(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, int32_t& o_iValue) const
+{
+	int index = find(s_intProperties, s_iIntCount, i_prop);
+	if (i_device >= vr::k_unMaxTrackedDeviceCount || index < 0 || !(m_devices[i_device].m_uiValidInts & (1u << index)))
+		return false;
 
+	o_iValue = m_devices[i_device].m_ints[index];
 	return true;
 }
 
-void COpenVROpenGLWidget::CRenderModel::Cleanup()
+bool COpenVROpenGLWidget::CDevicePropertyCache::GetFloat(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, float& o_fValue) const
 {
-	if (m_glVertBuffer)
-	{
-		glDeleteBuffers(1, &m_glIndexBuffer);
-		glDeleteVertexArrays(1, &m_glVertArray);
-		glDeleteBuffers(1, &m_glVertBuffer);
-		m_glIndexBuffer = 0;
-		m_glVertArray = 0;
-		m_glVertBuffer = 0;
-	}
+	int index = find(s_floatProperties, s_iFloatCount, i_prop);
+	if (i_device >= vr::k_unMaxTrackedDeviceCount || index < 0 || !(m_devices[i_device].m_uiValidFloats & (1u << index)))
+		return false;
 
-	delete m_program;
+	o_fValue = m_devices[i_device].m_floats[index];
+	return true;
 }
 
-void COpenVROpenGLWidget::CRenderModel::Draw(const QMatrix4x4& i_mvpMatrix)
+bool COpenVROpenGLWidget::CDevicePropertyCache::GetBool(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, bool& o_bValue) const
 {
-	glEnable(GL_CULL_FACE);
+	int index = find(s_boolProperties, s_iBoolCount, i_prop);
+	if (i_device >= vr::k_unMaxTrackedDeviceCount || index < 0 || !(m_devices[i_device].m_uiValidBools & (1u << index)))
+		return false;
 
-	QMatrix4x4 scale;
-	scale.scale(1.0, 1.0, -1.0);
+	o_bValue = m_devices[i_device].m_bools[index];
+	return true;
+}
 
-	glUseProgram(m_program->programId());
-	m_program->setUniformValue("matrix", i_mvpMatrix);
-	m_program->setUniformValue("diffuse", GL_TEXTURE0);
+const char* COpenVROpenGLWidget::GetDeviceString(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop) const
+{
+	return m_deviceProperties.GetString(i_device, i_prop);
+}
 
-	glBindVertexArray(m_glVertArray);
+int32_t COpenVROpenGLWidget::GetDeviceInt(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, int32_t i_iDefault) const
+{
+	m_deviceProperties.GetInt(i_device, i_prop, i_iDefault);
+	return i_iDefault;
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, m_glTexture);
+float COpenVROpenGLWidget::GetDeviceFloat(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, float i_fDefault) const
+{
+	m_deviceProperties.GetFloat(i_device, i_prop, i_fDefault);
+	return i_fDefault;
+}
 
-	glDrawElements(GL_TRIANGLES, m_unVertexCount, GL_UNSIGNED_SHORT, 0);
+bool COpenVROpenGLWidget::GetDeviceBool(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, bool i_bDefault) const
+{
+	m_deviceProperties.GetBool(i_device, i_prop, i_bDefault);
+	return i_bDefault;
+}
 
-	glBindVertexArray(0);
+void COpenVROpenGLWidget::handleVRPropertyChanged(const vr::VREvent_t& i_event)
+{
+	vr::TrackedDeviceIndex_t device = i_event.trackedDeviceIndex;
+	if (device >= vr::k_unMaxTrackedDeviceCount || m_deviceClasses[device] == vr::TrackedDeviceClass_Invalid)
+		return;
 
-	glUseProgram(0);
+	vr::TrackedDeviceProperty prop = i_event.data.property.prop;
+	m_deviceProperties.Update(m_vrSystem, device, prop);
 
-	glDisable(GL_CULL_FACE);
-}
\ No newline at end of file
+	// the properties the widget depends on
+	if (prop == vr::Prop_RenderModelName_String && m_deviceClasses[device] == vr::TrackedDeviceClass_Controller)
+		queueControllerModel(device);
+	else if (prop == vr::Prop_DisplayFrequency_Float && device == vr::k_unTrackedDeviceIndex_Hmd)
+	{
+		m_fDisplayFrequency = GetDeviceFloat(device, prop);
+		if (m_fDisplayFrequency <= 0.0f)
+			m_fDisplayFrequency = DEFAULT_DISPLAY_FREQUENCY;
+	}
+}
@@ -10,25 +10,1236 @@
 // Qt OpenGL includes
 #include <QOpenGLFunctions_4_5_core>
 #include <QOpenGLWidget>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
 #include <QOpenGLFramebufferObject>
 #include <QOpenGLShaderProgram>
-#ifdef _DEBUG
 #include <QOpenGLDebugMessage>
 #include <QOpenGLDebugLogger>
+
+// Qt includes
+#include <QGraphicsScene>
+#include <QVector>
+#include <QHash>
+#include <QStringList>
+#include <QMatrix4x4>
+#include <QVector2D>
+#include <QVector3D>
+#include <QVector4D>
+#include <QElapsedTimer>
+
+// Qt Quick includes, for in-scene panels
+#ifdef QT_QUICK_LIB
+#include <QQuickRenderControl>
+#include <QQuickWindow>
+#include <QQuickItem>
+#include <QQmlEngine>
+#include <QQmlComponent>
+#include <QUrl>
 #endif
 
-// Qt includes
-#include <QMatrix4x4>
-#include <QVector3D>
+// STL includes
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+/// \class	COpenVROpenGLWidget
+/// \brief	Define a widget which renders a scene in a virtual reality headset and in the widget.
+///			It is mostly inspired by samples from OpenVR SDK.
+class COpenVROpenGLWidget : public QOpenGLWidget, protected QOpenGLFunctions_4_5_Core
+{
+	Q_OBJECT
+
+public:
+
+	/// \class		CGLStateCache
+	/// \brief		A shadow copy of the OpenGL states changed by the widget, to skip redundant state changes.
+	///	\details	Each setter compares the requested value with the last one sent to the driver and only calls
+	///				OpenGL when they differ. The cache only knows about the calls made through it: any code which
+	///				changes the same states directly must call \c Invalidate() afterwards.
+	///				The widget calls \c BeginFrame() at the beginning of each \c paintGL(), so the counters returned by
+	///				\c GetFrameCounters() are those of the last complete frame.
+	class CGLStateCache : protected QOpenGLFunctions_4_5_Core
+	{
+	public:
+
+		/// \struct	SCounters
+		/// \brief	Number of state changes sent to the driver and skipped by the cache.
+		struct SCounters
+		{
+			/// State changes sent to the OpenGL driver.
+			unsigned int m_uiIssued = 0;
+
+			/// Redundant state changes skipped by the cache.
+			unsigned int m_uiElided = 0;
+		};
+
+	private:
+
+		/// \enum	Capability
+		/// \brief	Index of the capabilities tracked by the cache. The other ones are always sent to the driver.
+		enum Capability {
+			CapDepthTest,
+			CapCullFace,
+			CapBlend,
+			CapMultisample,
+			CapScissorTest,
+			CapStencilTest,
+			CapCount
+		};
+
+		/// The number of texture units tracked for \c GL_TEXTURE_2D bindings.
+		static const int s_textureUnitCount = 16;
+
+		/// The state of each capability: -1 unknown, 0 disabled, 1 enabled.
+		int m_capabilities[CapCount];
+
+		/// The program in use.
+		GLuint m_program;
+
+		/// The vertex array object bound.
+		GLuint m_vertexArray;
+
+		/// The active texture unit, as an offset from \c GL_TEXTURE0.
+		GLuint m_activeTexture;
+
+		/// The \c GL_TEXTURE_2D binding of each texture unit.
+		GLuint m_textures2D[s_textureUnitCount];
+
+		/// The clear color and whether it is known.
+		GLfloat m_clearColor[4];
+		bool m_bClearColorKnown;
+
+		/// The viewport rectangle and whether it is known.
+		GLint m_viewport[4];
+		bool m_bViewportKnown;
+
+		/// The source and destination blend factors and whether they are known.
+		GLenum m_blendFunc[2];
+		bool m_bBlendFuncKnown;
+
+		/// The counters of the frame being rendered.
+		SCounters m_currentCounters;
+
+		/// The counters of the last complete frame.
+		SCounters m_frameCounters;
+
+		/// \brief	Give the index in \c m_capabilities of an OpenGL capability.
+		/// \return	The index or -1 if the capability isn't tracked.
+		static int capabilityIndex(GLenum i_capability);
+
+		/// \brief	Count a state change and tell if it must be sent to the driver.
+		/// \param	i_bChanged	\c true if the requested value differs from the cached one.
+		/// \return	\c i_bChanged.
+		bool count(bool i_bChanged);
+
+	public:
+
+		/// \brief	Constructor: all the states are unknown until they are set through the cache.
+		/// \note	An OpenGL context must be current.
+		CGLStateCache();
+
+		/// \brief	Forget all the cached states: the next call of each setter will be sent to the driver.
+		void Invalidate();
+
+		/// \brief	Start a new frame: store the counters of the previous one and invalidate the cache.
+		void BeginFrame();
+
+		/// \brief	Cached version of \c glEnable().
+		void Enable(GLenum i_capability);
+
+		/// \brief	Cached version of \c glDisable().
+		void Disable(GLenum i_capability);
+
+		/// \brief	Cached version of \c glUseProgram().
+		void UseProgram(GLuint i_program);
+
+		/// \brief	Cached version of \c glBindVertexArray().
+		void BindVertexArray(GLuint i_vertexArray);
+
+		/// \brief	Cached version of \c glActiveTexture().
+		void ActiveTexture(GLenum i_textureUnit);
+
+		/// \brief	Cached version of \c glBindTexture(). Only \c GL_TEXTURE_2D bindings are cached.
+		void BindTexture(GLenum i_target, GLuint i_texture);
+
+		/// \brief	Cached version of \c glClearColor().
+		void ClearColor(GLfloat i_red, GLfloat i_green, GLfloat i_blue, GLfloat i_alpha);
+
+		/// \brief	Cached version of \c glViewport().
+		void Viewport(GLint i_x, GLint i_y, GLsizei i_width, GLsizei i_height);
+
+		/// \brief	Cached version of \c glBlendFunc().
+		void BlendFunc(GLenum i_sourceFactor, GLenum i_destinationFactor);
+
+		/// \brief	Accessor to the counters of the last complete frame.
+		const SCounters& GetFrameCounters() const { return m_frameCounters; }
+
+		/// \brief	Accessor to the counters of the frame being rendered.
+		const SCounters& GetCurrentCounters() const { return m_currentCounters; }
+	};
+
+
+	/// \class		CContextObjects
+	/// \brief		The base of the helpers which keep their OpenGL resources when the widget's context is recreated.
+	///	\details	When the widget is reparented, Qt destroys its context and creates a new one. With
+	///				\c Qt::AA_ShareOpenGLContexts, the buffers, the textures, the programs and the fences are shared
+	///				with the new context; the container objects (vertex arrays, frame buffers) and the queries are not,
+	///				and the OpenGL functions are resolved for each context. The widget calls \c ReleaseContext() on
+	///				each helper before the old context is destroyed, and \c RestoreContext() once the new one is current.
+	class CContextObjects : protected QOpenGLFunctions_4_5_Core
+	{
+	protected:
+
+		/// \brief	Delete the objects bound to the current context, none by default.
+		virtual void releaseObjects() {}
+
+		/// \brief	Create the objects of \c releaseObjects() again in the new context, none by default.
+		virtual void restoreObjects() {}
+
+	public:
+
+		/// \brief	Destructor.
+		virtual ~CContextObjects() {}
+
+		/// \brief	Delete the objects bound to the current context. Must be called before it is destroyed.
+		void ReleaseContext() { releaseObjects(); }
+
+		/// \brief	Resolve the functions in the new context and recreate its objects, after \c ReleaseContext() in the previous one.
+		void RestoreContext()
+		{
+			initializeOpenGLFunctions();
+			restoreObjects();
+		}
+	};
+
+
+	/// \class		CFrameTarget
+	/// \brief		A render target computed once per frame and sampled by both eyes: shadow map, light clusters...
+	///	\details	The target is a 2D texture with its frame buffer, attached as depth if its format is a depth format, as
+	///				color otherwise. With history, two textures are swapped at the beginning of each frame, so the one
+	///				written during the previous frame stays available.
+	///				Targets are created by \c COpenVROpenGLWidget::AddFrameTarget().
+	class CFrameTarget : public CContextObjects
+	{
+		/// The name of the target in the registry.
+		QString m_sName;
+
+		/// The size in pixels of the textures.
+		QSize m_size;
+
+		/// The internal format of the textures.
+		GLenum m_glFormat;
+
+		/// The number of mipmap levels of the textures.
+		int m_iLevels;
+
+		/// Determine if the texture of the previous frame is kept.
+		bool m_bHistory;
+
+		/// The textures, the second one is only created with history.
+		GLuint m_glTextures[2];
+
+		/// The frame buffers of the textures, bound to the context.
+		GLuint m_glFrameBuffers[2];
+
+		/// The index of the texture written during the current frame.
+		int m_iCurrent;
+
+		/// \brief	Create the frame buffers and attach the textures to them.
+		void createFrameBuffers();
+
+		/// \brief	Delete the frame buffers.
+		void destroyFrameBuffers();
+
+	public:
+
+		/// \brief	Constructor: create the textures and the frame buffers in the current context.
+		/// \param	i_sName			The name of the target in the registry.
+		/// \param	i_size			The size in pixels of the textures.
+		/// \param	i_glFormat		The sized internal format of the textures.
+		/// \param	i_bHistory		\c true to keep the texture of the previous frame.
+		/// \param	i_iLevels		The number of mipmap levels of the textures.
+		CFrameTarget(const QString& i_sName, const QSize& i_size, GLenum i_glFormat, bool i_bHistory, int i_iLevels);
+
+		/// \brief	Destructor: delete the textures and the frame buffers.
+		~CFrameTarget();
+
+		/// \brief	Accessor to the name of the target.
+		const QString& GetName() const { return m_sName; }
+
+		/// \brief	Accessor to the size of the textures.
+		const QSize& GetSize() const { return m_size; }
+
+		/// \brief	Accessor to the number of mipmap levels of the textures.
+		int GetLevels() const { return m_iLevels; }
+
+		/// \brief	Accessor to the internal format of the textures.
+		GLenum GetFormat() const { return m_glFormat; }
+
+		/// \brief	Accessor to the texture written during the current frame.
+		GLuint Texture() const { return m_glTextures[m_iCurrent]; }
+
+		/// \brief	Accessor to the texture written during the previous frame, the current one without history.
+		GLuint PreviousTexture() const { return m_glTextures[m_bHistory ? 1 - m_iCurrent : m_iCurrent]; }
+
+		/// \brief	Accessor to the frame buffer of the current texture, level 0.
+		GLuint FrameBuffer() const { return m_glFrameBuffers[m_iCurrent]; }
+
+		/// \brief	Bind the frame buffer of the current texture and set the viewport to its size.
+		/// \param	i_glState	The state cache used to set the viewport.
+		void Bind(CGLStateCache* i_glState);
+
+		/// \brief	Swap the current and the previous textures. Called by the widget at the beginning of each frame.
+		void Swap();
+
+		/// \brief	The frame buffer attachment of a format: depth, depth and stencil, or color.
+		static GLenum Attachment(GLenum i_glFormat);
+
+		/// \brief	The size in bytes of a pixel of a format, 4 for the unknown ones.
+		static int BytesPerPixel(GLenum i_glFormat);
+
+	protected:
+
+		/// \brief	Delete the frame buffers. Called by \c ReleaseContext().
+		void releaseObjects() override;
+
+		/// \brief	Create the frame buffers again in the new context. Called by \c RestoreContext().
+		void restoreObjects() override;
+	};
+
+
+	/// \class		CClusteredLighting
+	/// \brief		Assign the lights of the scene to clusters of the view, once per frame for both eyes.
+	///	\details	The view of the center of the head, enclosing both eyes, is split in a grid of clusters, with
+	///				exponential depth slices. Each frame, the lights are uploaded to a shader storage buffer and a compute
+	///				dispatch lists the lights whose range intersects each cluster. The shaders of \c Render() include
+	///				\c ShaderInclude() and only loop over the lights of the cluster of their fragment:
+	///				\code
+	///				uint cluster = clusterOf(scenePosition);
+	///				for (uint i = 0u; i < clusterLightCount(cluster); i++)
+	///				{
+	///					Light light = clusterLight(cluster, i);
+	///					...
+	///				}
+	///				\endcode
+	///				The module is created by \c COpenVROpenGLWidget::GetClusteredLighting().
+	class CClusteredLighting : public CContextObjects
+	{
+	public:
+
+		/// \struct	SLight
+		/// \brief	A point light, with the layout of the \c Light structure of the shaders.
+		struct SLight
+		{
+			/// The position of the light in the scene.
+			QVector3D m_position;
+
+			/// The range of the light in meters.
+			float m_fRadius = 1.0f;
+
+			/// The color of the light.
+			QVector3D m_color = QVector3D(1.0f, 1.0f, 1.0f);
+
+			/// The intensity of the light.
+			float m_fIntensity = 1.0f;
+		};
+
+	private:
+
+		/// The lights of the scene.
+		QVector<SLight> m_lights;
+
+		/// The shader storage buffer of the lights.
+		GLuint m_glLightBuffer;
+
+		/// The number of lights \c m_glLightBuffer can hold.
+		int m_iLightCapacity;
+
+		/// The shader storage buffer of the lights of each cluster.
+		GLuint m_glClusterBuffer;
+
+		///	The compute program building the clusters.
+		QOpenGLShaderProgram* m_program;
+
+		/// The location of the \c lightCount uniform in the program.
+		int m_iLightCountLocation;
+
+		/// Determine if the program was built.
+		bool m_bValid;
+
+	public:
+
+		/// \brief	Constructor: create the buffers and the program in the current context.
+		CClusteredLighting();
+
+		/// \brief	Destructor: delete the buffers and the program.
+		~CClusteredLighting();
+
+		/// \brief	Determine if the program was built.
+		bool IsValid() const { return m_bValid; }
+
+		/// \brief	Accessor to the lights of the scene, to update them in \c UpdateRendering().
+		QVector<SLight>& Lights() { return m_lights; }
+
+		/// \brief	Upload the lights and build the clusters. Called by the widget once per frame.
+		/// \param	i_glState	The state cache used to bind the program.
+		/// \note	The frame uniforms must be bound.
+		void Build(CGLStateCache* i_glState);
+
+		/// \brief	The GLSL declarations to include in the shaders after their \c #version: the frame uniforms
+		///			(see \c COpenVROpenGLWidget::FrameUniformsShaderInclude()), the \c Light structure, and the
+		///			\c clusterOf(), \c clusterLightCount() and \c clusterLight() functions.
+		static QString ShaderInclude();
+	};
+
+
+	/// \class		COcclusionCulling
+	/// \brief		Cull the objects of the scene on the GPU, against the depth of the previous frame.
+	///	\details	The depth of each eye is kept after the multisample resolve and reduced into a hierarchical depth
+	///				pyramid at the beginning of the next frame. A compute dispatch then tests the bounds of each object
+	///				against the frustum of the eye and against the pyramid, seen from the previous pose, and writes the
+	///				indirect draw commands of the eye: the occluded objects get no instance and never reach the vertex
+	///				stage. In \c Render(), bind the vertex array and the program of the objects, then call \c Draw().
+	///				The objects share one vertex array with 32 bits indices; the base instance of each object can index
+	///				its own data through an instanced attribute.
+	///				With fixed foveation, the depth of the packed regions isn't kept and only the frustum test is done.
+	///				The module is created by \c COpenVROpenGLWidget::GetOcclusionCulling().
+	class COcclusionCulling : public CContextObjects
+	{
+	public:
+
+		/// \struct	SObject
+		/// \brief	An object of the scene: its bounds and the parameters of its indirect draw command.
+		struct SObject
+		{
+			/// The minimum corner of the bounding box of the object in the scene.
+			QVector3D m_boundsMin;
+
+			/// The number of indices of the object.
+			GLuint m_uiIndexCount = 0;
+
+			/// The maximum corner of the bounding box of the object in the scene.
+			QVector3D m_boundsMax;
+
+			/// The first index of the object in the element buffer.
+			GLuint m_uiFirstIndex = 0;
+
+			/// The value added to each index of the object.
+			GLint m_iBaseVertex = 0;
+
+			/// The base instance of the object, to index its data.
+			GLuint m_uiBaseInstance = 0;
+		};
+
+	private:
+
+		/// The objects of the scene.
+		QVector<SObject> m_objects;
+
+		/// Determine if the objects changed since they were uploaded.
+		bool m_bObjectsDirty;
+
+		/// The first object changed by \c SetObject() since the objects were uploaded.
+		int m_iDirtyFirst;
+
+		/// The last object changed by \c SetObject() since the objects were uploaded, lower than \c m_iDirtyFirst if none.
+		int m_iDirtyLast;
+
+		/// The shader storage buffer of the objects.
+		GLuint m_glObjectBuffer;
+
+		/// The indirect draw commands of the left eye, the right eye, then the far field.
+		GLuint m_glCommandBuffer;
+
+		/// The number of objects the buffers can hold.
+		int m_iCapacity;
+
+		/// The number of draw commands of each eye written by the last \c Cull().
+		int m_iCommandCount;
+
+		/// The hierarchical depth pyramid of each eye.
+		GLuint m_glPyramids[2];
+
+		/// The size of the depth the pyramids were created for.
+		QSize m_depthSize;
+
+		/// The size of the first level of the pyramids, the power of two below the depth size.
+		QSize m_pyramidSize;
+
+		/// The number of levels of the pyramids.
+		int m_iPyramidLevels;
+
+		/// The view projection matrices of the eyes during the previous frame, when their depth was rendered.
+		QMatrix4x4 m_previousViewProjections[2];
+
+		/// Determine if \c m_previousViewProjections were set by the previous frame.
+		bool m_bPreviousFrame;
+
+		/// The compute program building each level of the pyramids.
+		QOpenGLShaderProgram* m_pyramidProgram;
+
+		/// The compute program testing the objects and writing the draw commands.
+		QOpenGLShaderProgram* m_cullProgram;
+
+		/// Determine if the programs were built.
+		bool m_bValid;
+
+		/// \brief	Create the pyramids for a new depth size.
+		void createPyramids(const QSize& i_depthSize);
+
+		/// \brief	Delete the pyramids.
+		void destroyPyramids();
+
+	public:
+
+		/// \brief	Constructor: create the buffers and the programs in the current context.
+		COcclusionCulling();
+
+		/// \brief	Destructor: delete the buffers, the pyramids and the programs.
+		~COcclusionCulling();
+
+		/// \brief	Determine if the programs were built.
+		bool IsValid() const { return m_bValid; }
+
+		/// \brief	Accessor to the objects of the scene, to update them in \c UpdateRendering(). They are uploaded again
+		///			at the next frame.
+		QVector<SObject>& Objects() { m_bObjectsDirty = true; return m_objects; }
+
+		/// \brief	Accessor to the objects of the scene, without uploading them again.
+		const QVector<SObject>& GetObjects() const { return m_objects; }
+
+		/// \brief	Change an object of the scene: only the range of the changed objects is uploaded at the next frame.
+		void SetObject(int i_index, const SObject& i_object);
+
+		/// \brief	Build the pyramids from the depth of the previous frame and write the draw commands of this frame.
+		///			Called by the widget once per frame, before the eyes are rendered.
+		/// \param	i_depthTextures		The depth of each eye rendered during the previous frame, \c 0 to only test the frustum.
+		/// \param	i_depthSize			The size of the depth textures.
+		/// \param	i_viewProjections	The transform from the scene to the clip space of each eye for this frame.
+		/// \param	i_glState			The state cache used to bind the programs and the textures.
+		void Cull(const GLuint i_depthTextures[2], const QSize& i_depthSize, const QMatrix4x4 i_viewProjections[2], CGLStateCache* i_glState);
+
+		/// \brief	Draw the visible objects with the vertex array and the program bound.
+		/// \param	i_eye		The eye given to \c Render(): \c Left, \c Right or \c Center. The far field draws every object.
+		/// \param	i_mode		The primitives of the objects.
+		/// \param	i_iFirst	The index of the first object to draw.
+		/// \param	i_iCount	The number of objects to draw, all the objects after \c i_iFirst if negative.
+		void Draw(int i_eye, GLenum i_mode = GL_TRIANGLES, int i_iFirst = 0, int i_iCount = -1);
+	};
+
+
+	/// \class		CSceneRenderer
+	/// \brief		A retained scene drawn with one indirect draw per material, whatever the number of objects.
+	///	\details	The meshes are packed into a vertex arena and an index arena shared by a single vertex array. The
+	///				transform and the material of each object are kept in shader storage buffers, uploaded only when they
+	///				change, and the objects of each material are culled by a \c COcclusionCulling and drawn with one
+	///				\c glMultiDrawElementsIndirect per eye. The CPU cost of a frame doesn't depend on the number of objects:
+	///				moving objects only updates their range, the objects are sorted again when some are added or removed.
+	///				The programs of the materials include \c VertexShaderInclude() in their vertex shader and
+	///				\c ShaderInclude() in the other stages, and receive the \c viewProjection uniform:
+	///				\code
+	///				gl_Position = viewProjection * objectTransform() * vec4(vertexPosition, 1.0);
+	///				\endcode
+	///				The module is created by \c COpenVROpenGLWidget::GetSceneRenderer().
+	class CSceneRenderer : public CContextObjects
+	{
+	public:
+
+		/// \struct	SVertex
+		/// \brief	A vertex of a mesh.
+		struct SVertex
+		{
+			/// The position of the vertex in the mesh.
+			QVector3D m_position;
+
+			/// The normal of the vertex.
+			QVector3D m_normal;
+
+			/// The texture coordinates of the vertex.
+			QVector2D m_texCoord;
+		};
+
+		/// \struct	SMaterial
+		/// \brief	The parameters of a material, with the layout of the \c Material structure of the shaders.
+		struct SMaterial
+		{
+			/// The base color of the material.
+			QVector4D m_color = QVector4D(1.0f, 1.0f, 1.0f, 1.0f);
+
+			/// Four parameters for the program of the material.
+			QVector4D m_parameters;
+		};
+
+	private:
+
+		/// \struct	SMesh
+		/// \brief	The location of a mesh in the arenas.
+		struct SMesh
+		{
+			/// The first index of the mesh in the index arena.
+			GLuint m_uiFirstIndex;
+
+			/// The number of indices of the mesh.
+			GLuint m_uiIndexCount;
+
+			/// The first vertex of the mesh in the vertex arena.
+			GLint m_iBaseVertex;
+
+			/// The minimum corner of the bounding box of the mesh.
+			QVector3D m_boundsMin;
+
+			/// The maximum corner of the bounding box of the mesh.
+			QVector3D m_boundsMax;
+		};
+
+		/// \struct	SObjectData
+		/// \brief	An object, with the layout of the \c SceneObject structure of the shaders.
+		struct SObjectData
+		{
+			/// The transform from the object to the scene.
+			GLfloat m_transform[16];
+
+			/// The index of the material of the object.
+			GLuint m_uiMaterial;
+
+			/// The index of the mesh of the object, \c -1 once removed.
+			GLint m_iMesh;
+
+			/// The padding of the structure to a multiple of 16 bytes.
+			GLuint m_uiPadding[2];
+		};
+
+		/// The meshes packed in the arenas.
+		QVector<SMesh> m_meshes;
+
+		/// The parameters of the materials.
+		QVector<SMaterial> m_materials;
+
+		/// The program of each material.
+		QVector<QOpenGLShaderProgram*> m_materialPrograms;
+
+		/// Determine if the materials changed since they were uploaded.
+		bool m_bMaterialsDirty;
+
+		/// The objects, including the removed ones until their slot is reused.
+		QVector<SObjectData> m_objects;
+
+		/// The slots of the removed objects.
+		QVector<int> m_freeObjects;
+
+		/// The first object changed since the objects were uploaded.
+		int m_iDirtyFirst;
+
+		/// The last object changed since the objects were uploaded, lower than \c m_iDirtyFirst if none.
+		int m_iDirtyLast;
+
+		/// Determine if objects were added or removed since they were sorted by material for the culling.
+		bool m_bCullingOrderDirty;
+
+		/// The index of each object in the culled objects, \c -1 once removed.
+		QVector<int> m_culledSlots;
+
+		/// The first draw of each material in the culled objects, followed by the number of draws.
+		QVector<int> m_materialDraws;
+
+		/// The vertex buffer of all the meshes.
+		GLuint m_glVertexArena;
+
+		/// The number of vertices in the vertex arena.
+		int m_iVertexCount;
+
+		/// The number of vertices the vertex arena can hold.
+		int m_iVertexCapacity;
+
+		/// The element buffer of all the meshes.
+		GLuint m_glIndexArena;
+
+		/// The number of indices in the index arena.
+		int m_iIndexCount;
+
+		/// The number of indices the index arena can hold.
+		int m_iIndexCapacity;
+
+		/// The shader storage buffer of the objects.
+		GLuint m_glObjectBuffer;
+
+		/// The number of objects the object buffers can hold.
+		int m_iObjectCapacity;
+
+		/// The instanced attribute buffer giving the index of the object from the base instance of its draw.
+		GLuint m_glObjectIndexBuffer;
+
+		/// The shader storage buffer of the materials.
+		GLuint m_glMaterialBuffer;
+
+		/// The number of materials the material buffer can hold.
+		int m_iMaterialCapacity;
+
+		/// The vertex array of the arenas, bound to the context.
+		GLuint m_glVertexArray;
+
+		/// The culling of the objects, in the order of their materials.
+		COcclusionCulling* m_pCulling;
+
+		/// \brief	Grow a buffer by doubling its capacity, keeping its content.
+		/// \param	io_buffer		The buffer, replaced by a larger one.
+		/// \param	io_iCapacity	The number of elements of the buffer, updated.
+		/// \param	i_iSize			The number of elements needed.
+		/// \param	i_iStride		The size in bytes of an element.
+		/// \param	i_iKept			The number of elements to copy into the new buffer.
+		/// \return	\c true if the buffer was replaced.
+		bool growBuffer(GLuint& io_buffer, int& io_iCapacity, int i_iSize, int i_iStride, int i_iKept);
+
+		/// \brief	Create the vertex array and bind the arenas to it.
+		void createVertexArray();
+
+		/// \brief	Extend the range of the objects to upload.
+		void setObjectDirty(int i_object);
+
+		/// \brief	Fill the culled object of an object: its bounds in the scene and its draw command.
+		void culledObject(int i_object, COcclusionCulling::SObject& o_culledObject) const;
+
+	public:
+
+		/// \brief	Constructor: create the culling and the vertex array in the current context.
+		CSceneRenderer();
+
+		/// \brief	Destructor: delete the buffers and the vertex array. The programs of the materials are not deleted.
+		~CSceneRenderer();
+
+		/// \brief	Determine if the culling programs were built.
+		bool IsValid() const { return m_pCulling->IsValid(); }
+
+		/// \brief	Append a mesh to the arenas.
+		/// \param	i_vertices	The vertices of the mesh.
+		/// \param	i_indices	The triangles of the mesh, indexing \c i_vertices.
+		/// \return	The index of the mesh.
+		/// \note	The widget's context must be current.
+		int AddMesh(const QVector<SVertex>& i_vertices, const QVector<GLuint>& i_indices);
+
+		/// \brief	Add a material.
+		/// \param	i_program	The program drawing the objects of the material, owned by the application.
+		/// \param	i_material	The parameters of the material.
+		/// \return	The index of the material.
+		int AddMaterial(QOpenGLShaderProgram* i_program, const SMaterial& i_material = SMaterial());
+
+		/// \brief	Change the parameters of a material.
+		void SetMaterial(int i_material, const SMaterial& i_material);
+
+		/// \brief	Add an object.
+		/// \param	i_mesh		The index of the mesh of the object.
+		/// \param	i_material	The index of the material of the object.
+		/// \param	i_transform	The transform from the object to the scene.
+		/// \return	The index of the object, valid until it is removed.
+		int AddObject(int i_mesh, int i_material, const QMatrix4x4& i_transform);
+
+		/// \brief	Move an object.
+		void SetObjectTransform(int i_object, const QMatrix4x4& i_transform);
+
+		/// \brief	Remove an object. Its index can be given to a new object.
+		void RemoveObject(int i_object);
+
+		/// \brief	Upload what changed and cull the objects. Called by the widget once per frame.
+		/// \param	i_depthTextures		The depth of each eye rendered during the previous frame, \c 0 to only test the frustum.
+		/// \param	i_depthSize			The size of the depth textures.
+		/// \param	i_viewProjections	The transform from the scene to the clip space of each eye for this frame.
+		/// \param	i_glState			The state cache used to bind the programs and the textures.
+		void Update(const GLuint i_depthTextures[2], const QSize& i_depthSize, const QMatrix4x4 i_viewProjections[2], CGLStateCache* i_glState);
+
+		/// \brief	Draw the visible objects, in \c Render().
+		/// \param	i_eye				The eye given to \c Render().
+		/// \param	i_viewProjection	The transform from the scene to the clip space, given to the programs.
+		/// \param	i_glState			The state cache used to bind the programs and the vertex array.
+		void Draw(int i_eye, const QMatrix4x4& i_viewProjection, CGLStateCache* i_glState);
+
+		/// \brief	The GLSL declarations of the objects and the materials, and the \c objectTransform() and
+		///			\c objectMaterial() functions, for the vertex shader: the \c vertexPosition, \c vertexNormal and
+		///			\c vertexTexCoord inputs are declared too.
+		static QString VertexShaderInclude();
+
+		/// \brief	The GLSL declarations of the objects and the materials, for the other stages. The vertex shader can
+		///			pass the index of the object with a flat output.
+		static QString ShaderInclude();
+
+	protected:
+
+		/// \brief	Delete the vertex array. Called by \c ReleaseContext().
+		void releaseObjects() override;
+
+		/// \brief	Create the vertex array again in the new context. Called by \c RestoreContext().
+		void restoreObjects() override;
+	};
+
+
+	/// \class		CStreamBuffer
+	/// \brief		A ring of per-frame regions in a persistently mapped buffer, for the data streamed every frame.
+	///	\details	The buffer stays mapped, coherent, for its whole life: \c Allocate() returns a pointer to write the data
+	///				into and the offset to bind in the buffer, with a bump pointer reset at each frame. Each frame writes its
+	///				own region, guarded by a fence, so the driver never waits for the GPU to read a previous frame, and the
+	///				CPU only waits if the GPU is more than \c s_frames frames late. An allocation which doesn't fit in the
+	///				region fails: size the regions from \c GetHighWaterMark().
+	///				The buffer is created by \c COpenVROpenGLWidget::GetStreamBuffer().
+	class CStreamBuffer : public CContextObjects
+	{
+	public:
+
+		/// \struct	SAllocation
+		/// \brief	A range of the buffer, valid until the end of the frame.
+		struct SAllocation
+		{
+			/// The mapped memory to write into, \c nullptr if the allocation failed.
+			void* m_pData = nullptr;
+
+			/// The buffer to bind.
+			GLuint m_glBuffer = 0;
+
+			/// The offset of the range in the buffer.
+			GLintptr m_offset = 0;
+
+			/// The size in bytes of the range.
+			GLsizeiptr m_size = 0;
+		};
+
+	private:
+
+		/// The number of regions of the ring, the number of frames the GPU can be late.
+		static const int s_frames = 3;
+
+		/// The buffer of all the regions.
+		GLuint m_glBuffer;
+
+		/// The mapped memory of the buffer.
+		char* m_pMapped;
+
+		/// The size in bytes of a region.
+		GLsizeiptr m_regionSize;
+
+		/// The region of the current frame.
+		int m_iRegion;
+
+		/// The bump pointer in the region of the current frame.
+		GLsizeiptr m_head;
+
+		/// The fence of the last frame which wrote each region, \c nullptr once passed.
+		GLsync m_fences[s_frames];
+
+		/// The bytes allocated during the last complete frame.
+		GLsizeiptr m_lastFrameUsage;
+
+		/// The highest number of bytes allocated during a frame.
+		GLsizeiptr m_highWaterMark;
+
+		/// The number of allocations which didn't fit in their region.
+		int m_iFailedAllocations;
+
+		/// The number of frames which waited for the GPU before reusing a region.
+		int m_iStalls;
+
+	public:
+
+		/// \brief	Constructor: create and map the buffer in the current context.
+		/// \param	i_regionSize	The size in bytes of the region of each frame.
+		explicit CStreamBuffer(GLsizeiptr i_regionSize);
+
+		/// \brief	Destructor: unmap and delete the buffer, and the fences.
+		~CStreamBuffer();
+
+		/// \brief	Determine if the buffer was mapped.
+		bool IsValid() const { return m_pMapped != nullptr; }
+
+		/// \brief	Allocate a range in the region of the current frame.
+		/// \param	i_size		The size in bytes of the range.
+		/// \param	i_alignment	The alignment of the offset, e.g. \c GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT for a uniform block,
+		///						\c 0 or \c 1 for none.
+		/// \return	The range, with a \c nullptr \c m_pData if the region is full.
+		SAllocation Allocate(GLsizeiptr i_size, GLsizeiptr i_alignment = 256);
+
+		/// \brief	Accessor to the buffer.
+		GLuint Buffer() const { return m_glBuffer; }
+
+		/// \brief	Wait for the region of the new frame to be read by the GPU, and reset the bump pointer. Called by the
+		///			widget at the beginning of each frame.
+		void BeginFrame();
+
+		/// \brief	Fence the region of the frame. Called by the widget once the frame is submitted.
+		void EndFrame();
+
+		/// \brief	Accessor to the size in bytes of the region of each frame.
+		GLsizeiptr GetRegionSize() const { return m_regionSize; }
+
+		/// \brief	Accessor to the bytes allocated during the last complete frame.
+		GLsizeiptr GetFrameUsage() const { return m_lastFrameUsage; }
+
+		/// \brief	Accessor to the highest number of bytes allocated during a frame, including the failed allocations.
+		GLsizeiptr GetHighWaterMark() const { return m_highWaterMark; }
+
+		/// \brief	Accessor to the number of allocations which didn't fit in their region.
+		int GetFailedAllocations() const { return m_iFailedAllocations; }
+
+		/// \brief	Accessor to the number of frames which waited for the GPU before reusing a region.
+		int GetStalls() const { return m_iStalls; }
+
+		/// \brief	Reset the high-water mark and the counters.
+		void ResetStatistics();
+	};
+
+
+	/// \class		COverlayPanel
+	/// \brief		A Qt widget displayed in the headset as a compositor overlay.
+	///	\details	The widget is put in a \c QGraphicsScene which reports the regions repainted by Qt. Only these regions
+	///				are rendered and uploaded to the overlay texture, in \c paintGL(), and the texture is only handed to
+	///				the compositor when it changed. The compositor composes the overlay at its own rate, so a static
+	///				panel costs nothing per frame.
+	///				Panels are created by \c COpenVROpenGLWidget::AddOverlayPanel().
+	class COverlayPanel : public QObject, protected QOpenGLFunctions_4_5_Core
+	{
+		/// The scene holding the widget and reporting its changes.
+		QGraphicsScene* m_scene;
+
+		/// The widget displayed in the overlay.
+		QWidget* m_widget;
+
+		/// The key of the overlay, unique in the vr system.
+		QString m_sKey;
+
+		/// The overlay handle, \c k_ulOverlayHandleInvalid when the overlay doesn't exist.
+		vr::VROverlayHandle_t m_overlayHandle;
+
+		/// The texture the widget is rendered into.
+		GLuint m_glTexture;
+
+		/// The size of the texture.
+		QSize m_textureSize;
+
+		/// Determine if the OpenGL functions are resolved for the current context.
+		bool m_bGLInitialized;
+
+		/// The region of the widget repainted since the last upload.
+		QRegion m_dirtyRegion;
+
+		/// The transform of the overlay in the standing tracking space.
+		QMatrix4x4 m_transform;
+
+		/// The width of the overlay in meters.
+		float m_fWidthInMeters;
+
+		/// Determine if the overlay is shown.
+		bool m_bVisible;
+
+		/// \brief	Apply the transform, the width and the visibility to the overlay.
+		void applyProperties();
+
+	public:
+
+		/// \brief	Constructor: put the widget in a scene and track its changes.
+		/// \param	i_widget			The widget to display, without parent. The panel takes its ownership.
+		/// \param	i_sKey				The key of the overlay, unique in the vr system.
+		/// \param	i_fWidthInMeters	The width of the overlay in meters.
+		/// \param	i_transform			The transform of the overlay in the standing tracking space.
+		COverlayPanel(QWidget* i_widget, const QString& i_sKey, float i_fWidthInMeters, const QMatrix4x4& i_transform);
+
+		/// \brief	Destructor: destroy the overlay, the texture and the widget.
+		/// \note	The widget's context or the resource host context must be current.
+		~COverlayPanel();
+
+		/// \brief	Create the overlay in the vr system and mark the whole widget to upload.
+		/// \return	\c true on success.
+		bool CreateOverlay();
+
+		/// \brief	Destroy the overlay in the vr system. Must be called before the vr system is shut down.
+		void DestroyOverlay();
+
+		/// \brief	Render and upload the repainted regions of the widget, then hand the texture to the compositor.
+		/// \note	Called by \c paintGL(), the widget's context is current.
+		void Update();
+
+		/// \brief	Forget the OpenGL functions of the context being destroyed.
+		/// \param	i_bKeepTexture	\c true if the texture is shared and survives the context, \c false otherwise.
+		void ReleaseContext(bool i_bKeepTexture);
+
+		/// \brief	Set the transform of the overlay in the standing tracking space.
+		void SetTransform(const QMatrix4x4& i_transform);
+
+		/// \brief	Set the width of the overlay in meters.
+		void SetWidthInMeters(float i_fWidthInMeters);
+
+		/// \brief	Show or hide the overlay.
+		void SetVisible(bool i_bVisible);
+
+		/// \brief	Accessor to the widget displayed in the overlay.
+		QWidget* GetWidget() const { return m_widget; }
+	};
+
+#ifdef QT_QUICK_LIB
+
+	/// \class		CQuickPanel
+	/// \brief		A Qt Quick scene displayed as a textured quad in the 3D scene.
+	///	\details	The QML scene is rendered by a \c QQuickRenderControl in its own context, sharing its resources with
+	///				the widget's context, into a frame buffer whose texture is drawn in each eye. It is only rendered
+	///				again when the scene graph signals a change.
+	///				The quad is centered on the origin of its transform, in the XY plane, facing +Z.
+	///				Panels are created by \c COpenVROpenGLWidget::AddQuickPanel().
+	class CQuickPanel : public QObject, protected QOpenGLFunctions_4_5_Core
+	{
+		/// The context the QML scene is rendered with.
+		QOpenGLContext* m_context;
+
+		/// The surface \c m_context is made current on.
+		QOffscreenSurface* m_surface;
+
+		/// The render control driving the Qt Quick rendering.
+		QQuickRenderControl* m_renderControl;
 
+		/// The window holding the QML scene, never shown.
+		QQuickWindow* m_quickWindow;
 
-/// \class	COpenVROpenGLWidget
-/// \brief	Define a widget which renders a scene in a virtual reality headset and in the widget.
-///			It is mostly inspired by samples from OpenVR SDK.
-class COpenVROpenGLWidget : public QOpenGLWidget, protected QOpenGLFunctions_4_5_Core
-{
-	Q_OBJECT
+		/// The QML engine.
+		QQmlEngine* m_qmlEngine;
+
+		/// The component loaded from the QML source.
+		QQmlComponent* m_qmlComponent;
+
+		/// The root item of the QML scene.
+		QQuickItem* m_rootItem;
+
+		/// The frame buffer the QML scene is rendered into, created in \c m_context.
+		QOpenGLFramebufferObject* m_frameBuffer;
+
+		/// The fence signaled when the rendering of the QML scene is done.
+		GLsync m_fence;
+
+		/// The size in pixels of the QML scene.
+		QSize m_size;
+
+		/// The transform of the quad in the scene.
+		QMatrix4x4 m_transform;
+
+		/// The width of the quad in meters.
+		float m_fWidthInMeters;
+
+		/// Determine if the scene graph changed since the last rendering.
+		bool m_bDirty;
+
+		/// The buttons pressed at the last mouse event sent to the scene.
+		Qt::MouseButtons m_buttons;
+
+		///	The program drawing the quad in the widget's context.
+		QOpenGLShaderProgram* m_drawProgram;
+
+		/// The location of the \c matrix uniform in \c m_drawProgram.
+		int m_iMatrixLocation;
+
+		/// The vertex array object used to draw the quad, bound to the widget's context.
+		GLuint m_glVertArray;
+
+		/// The context, surface and frame buffer saved by \c makeCurrent().
+		QOpenGLContext* m_previousContext;
+		QSurface* m_previousSurface;
+		GLint m_iPreviousFramebuffer;
+
+		/// \brief	Make \c m_context current, after saving the current context and its bound frame buffer.
+		void makeCurrent();
+
+		/// \brief	Make the context saved by \c makeCurrent() current again, and bind its frame buffer again: switching
+		///			contexts doesn't restore the frame buffer of a \c QOpenGLWidget.
+		void doneCurrent();
+
+		/// \brief	Create the context, initialize the render control and create the frame buffer.
+		/// \param	i_shareContext	The context to share the texture with.
+		void initializeRendering(QOpenGLContext* i_shareContext);
+
+		/// \brief	Release the render control resources, the frame buffer and the context.
+		void destroyRendering();
+
+		/// \brief	Create the root item once the QML component is loaded.
+		void finishLoading();
+
+	public:
+
+		/// \brief	Constructor: load the QML scene and prepare its rendering.
+		/// \param	i_shareContext		The context to share the texture with.
+		/// \param	i_qmlSource			The URL of the QML file to display.
+		/// \param	i_size				The size in pixels of the QML scene.
+		/// \param	i_fWidthInMeters	The width of the quad in meters.
+		/// \param	i_transform			The transform of the quad in the scene.
+		CQuickPanel(QOpenGLContext* i_shareContext, const QUrl& i_qmlSource, const QSize& i_size, float i_fWidthInMeters, const QMatrix4x4& i_transform);
+
+		/// \brief	Destructor: delete the QML scene and the OpenGL resources.
+		/// \note	The widget's context must be current.
+		~CQuickPanel();
+
+		/// \brief	Render the QML scene into the texture if the scene graph changed.
+		/// \note	Switches to the panel's context: the previous context and its frame buffer are bound again afterwards.
+		void UpdateTexture();
+
+		/// \brief	Draw the quad.
+		/// \param	i_viewProjection	The view and projection matrix of the scene.
+		/// \param	i_glState			The state cache of the widget.
+		void Draw(const QMatrix4x4& i_viewProjection, CGLStateCache* i_glState);
+
+		/// \brief	Intersect a ray, in scene coordinates, with the quad.
+		/// \param	i_origin		The origin of the ray.
+		/// \param	i_direction		The direction of the ray.
+		/// \param	o_distance		The distance from the origin to the intersection, in direction units.
+		/// \param	o_position		The intersection in pixels in the QML scene.
+		/// \return	\c true if the ray hits the quad.
+		bool Intersect(const QVector3D& i_origin, const QVector3D& i_direction, float* o_distance, QPointF* o_position) const;
+
+		/// \brief	Send a mouse event to the QML scene: a press or a release if the buttons changed, a move otherwise.
+		/// \param	i_position	The position in pixels in the QML scene.
+		/// \param	i_buttons	The pressed buttons.
+		void SendMouseEvent(const QPointF& i_position, Qt::MouseButtons i_buttons);
+
+		/// \brief	Delete the objects bound to the widget's context. Must be called before it is destroyed.
+		/// \param	i_bKeepTexture	\c true if the texture survives the widget's context, \c false otherwise.
+		void ReleaseContext(bool i_bKeepTexture);
+
+		/// \brief	Share the texture with a new widget's context, when it wasn't kept by \c ReleaseContext().
+		void RestoreContext(QOpenGLContext* i_shareContext);
+
+		/// \brief	Set the transform of the quad in the scene.
+		void SetTransform(const QMatrix4x4& i_transform) { m_transform = i_transform; }
+
+		/// \brief	Accessor to the root item of the QML scene, \c nullptr until it is loaded.
+		QQuickItem* GetRootItem() const { return m_rootItem; }
+	};
+
+#endif // QT_QUICK_LIB
+
+private:
+
+	/// \class		CGLResourceHost
+	/// \brief		A persistent OpenGL context which keeps the widgets' OpenGL resources alive when their context is destroyed.
+	///	\details	\c QOpenGLWidget destroys its context when it is reparented or moved to another top-level window. When
+	///				the application sets \c Qt::AA_ShareOpenGLContexts, all the widgets' contexts share their resources
+	///				with the host context, so textures, buffers, render buffers and programs survive: only the container
+	///				objects (frame buffers, vertex arrays) have to be recreated in the new context.
+	///				The host is shared by all the widgets and destroyed with the last one. It is also made current to
+	///				release the resources when a widget has no context any more.
+	class CGLResourceHost
+	{
+		/// The persistent context.
+		QOpenGLContext* m_context;
+
+		/// The surface the context is made current on.
+		QOffscreenSurface* m_surface;
+
+		/// The number of widgets using the host.
+		int m_iRefCount;
+
+		/// The host shared by all the widgets.
+		static CGLResourceHost* s_instance;
+
+		/// \brief	Constructor: create the context and its surface.
+		CGLResourceHost();
+
+		/// \brief	Destructor: destroy the context and its surface.
+		~CGLResourceHost();
+
+	public:
+
+		/// \brief	Get the host, create it if needed.
+		/// \return	The host, \c nullptr if \c Qt::AA_ShareOpenGLContexts is not set or the context couldn't be created.
+		/// \note	Must be called from the GUI thread.
+		static CGLResourceHost* Acquire();
+
+		/// \brief	Release the host got from \c Acquire(). The last call destroys it.
+		static void Release();
+
+		/// \brief	Make the host context current.
+		/// \return	\c true on success.
+		bool MakeCurrent();
+
+		/// \brief	Release the host context.
+		void DoneCurrent();
+	};
+
+
+	/// \class		CRenderTargetPool
+	/// \brief		Recycle the render buffers and the textures of the eyes, by size, format and samples.
+	///	\details	A released object is kept a few frames, until the GPU and the compositor are done with it, then given
+	///				to the next request with the same size, format and samples. The objects unused for a while are
+	///				deleted. Switching back and forth between render sizes or sample counts costs no allocation.
+	///				The objects are shared between contexts.
+	class CRenderTargetPool : public CContextObjects
+	{
+		/// \struct	SEntry
+		/// \brief	An object of the pool with its key.
+		struct SEntry
+		{
+			/// The render buffer or the texture.
+			GLuint m_glObject;
+
+			/// Determine if the object is a texture, a render buffer otherwise.
+			bool m_bTexture;
+
+			/// The size in pixels of the object.
+			QSize m_size;
+
+			/// The internal format of the object.
+			GLenum m_glFormat;
+
+			/// The number of samples of a render buffer, 0 for a texture.
+			int m_iSamples;
+
+			/// The frame the object was released at.
+			unsigned int m_uiFrame;
+		};
+
+		/// The number of frames a released object waits before being given again.
+		static const unsigned int s_recycleDelay = 3;
+
+		/// The number of frames a released object is kept before being deleted.
+		static const unsigned int s_idleFrames = 300;
+
+		/// The objects given to the eyes.
+		QVector<SEntry> m_acquired;
+
+		/// The released objects, from the oldest to the newest.
+		QVector<SEntry> m_released;
+
+		/// The number of frames since the pool was created.
+		unsigned int m_uiFrame;
 
+		/// \brief	Give a released object with this key, or create one.
+		GLuint acquire(bool i_bTexture, const QSize& i_size, GLenum i_glFormat, int i_iSamples);
+
+		/// \brief	Move an acquired object to the released ones.
+		void release(bool i_bTexture, GLuint i_glObject);
+
+		/// \brief	Delete an object.
+		void destroy(const SEntry& i_entry);
+
+	public:
+
+		/// \brief	Constructor: the pool is empty.
+		CRenderTargetPool();
+
+		/// \brief	Destructor: delete all the objects, acquired or not.
+		~CRenderTargetPool();
+
+		/// \brief	Accessor to a multisampled render buffer.
+		GLuint AcquireRenderbuffer(const QSize& i_size, GLenum i_glFormat, int i_iSamples);
+
+		/// \brief	Accessor to a 2D texture of one level. Its parameters are those left by its previous user.
+		GLuint AcquireTexture(const QSize& i_size, GLenum i_glFormat);
+
+		/// \brief	Give back a render buffer of \c AcquireRenderbuffer().
+		void ReleaseRenderbuffer(GLuint i_glRenderbuffer) { release(false, i_glRenderbuffer); }
+
+		/// \brief	Give back a texture of \c AcquireTexture().
+		void ReleaseTexture(GLuint i_glTexture) { release(true, i_glTexture); }
+
+		/// \brief	Start a new frame: the objects released long enough ago are deleted. Called by the widget.
+		void BeginFrame();
+	};
+
+
+	class CRadialDensityMask;
 
 	/// \class		CEyesInfos
 	/// \brief		A usefull class to deal with display, framebuffers and transformations of eyes in the head mounted display.
@@ -38,7 +1249,9 @@ class COpenVROpenGLWidget : public QOpenGLWidget, protected QOpenGLFunctions_4_5
 	///				To render in HMD, first call \c SetSurface(), render your scene and then, call \c UnsetSurface(). This will
 	///				populate the frame buffers to commit to the vr system.
 	///				It is developer's responsaibility to know witch instance of \c CEyeInfos refers to witch eye (right or left).
-	class CEyeInfos : protected QOpenGLFunctions_4_5_Core
+	///				The render buffers and the texture can be shared between contexts, the frame buffers can't: when the
+	///				context changes, call \c ReleaseContext() in the old one and \c RestoreContext() in the new one.
+	class CEyeInfos : public CContextObjects
 	{
 		/// The projection matrix of the eye according to the MVP transform model.
 		QMatrix4x4 m_projection;
@@ -46,36 +1259,134 @@ class COpenVROpenGLWidget : public QOpenGLWidget, protected QOpenGLFunctions_4_5
 		/// The view matrix of the eye according to the MVP transform model.
 		QMatrix4x4 m_view;
 
+		/// The multisampled color render buffer to render in.
+		GLuint m_glColorBuffer;
+
+		/// The multisampled depth and stencil render buffer.
+		GLuint m_glDepthBuffer;
+
+		/// The texture which receives the resolved frame, submitted to the vr system unless the frame is upscaled.
+		GLuint m_glResolveTexture;
+
+		/// The full resolution texture the upscale pass writes into, \c 0 when rendering at full resolution.
+		GLuint m_glOutputTexture;
+
+		/// The texture which receives the resolved packed regions, recombined into \c m_glResolveTexture.
+		/// \c 0 without foveation.
+		GLuint m_glPackedTexture;
+
+		/// The texture which receives the resolved frame with the holes of the radial density mask, reconstructed
+		/// into \c m_glResolveTexture. \c 0 without mask.
+		GLuint m_glMaskedTexture;
+
+		/// The texture which receives the resolved depth, \c 0 unless the depth is kept.
+		GLuint m_glDepthTexture;
+
+		/// The pool the render buffers and the textures come from.
+		CRenderTargetPool* m_pPool;
+
 		/// The frame buffer objet to render in.
-		QOpenGLFramebufferObject* m_frameBuffer;
+		GLuint m_glFrameBuffer;
 
 		/// The frame buffer objet used to grab a texture.
-		QOpenGLFramebufferObject* m_resolveBuffer;
+		GLuint m_glResolveFrameBuffer;
 
 		/// The size in pixels of the texture of the eye.
 		QSize m_size;
 
+		/// The size in pixels the scene is rendered at, smaller than \c m_size when the frame is upscaled.
+		QSize m_renderSize;
+
+		/// The size in pixels of the frame buffer: the packed regions with foveation, \c m_renderSize otherwise.
+		QSize m_targetSize;
+
+		/// Determine if the eye is rendered with fixed foveation.
+		bool m_bFoveated;
+
+		/// The number of samples of the render buffers, \c 0 without multisampling.
+		int m_iSamples;
+
+		/// The viewports of the regions in the frame buffer: the centre then the periphery with foveation, the
+		/// whole frame buffer otherwise.
+		QRect m_regions[2];
+
+		/// The projection matrix of each region.
+		QMatrix4x4 m_regionProjections[2];
+
+		/// Determine if the frame buffers are complete.
+		bool m_bValid;
+
+		/// \brief	Create the frame buffers and attach the render buffers and the texture to them.
+		void createFrameBuffers();
+
+		/// \brief	Delete the frame buffers.
+		void destroyFrameBuffers();
+
 	public:
 
 		/// \brief	Constructor: format and create frame buffers for rendering.
-		///	\param	i_eyeSize	The size of the output texture to submit to the vr system.
-		CEyeInfos(const QSize& i_eyeSize);
-
-		/// \brief	Descrutor: delete buffers properly.
+		///	\param	i_pool			The pool the render buffers and the textures are taken from and given back to.
+		///	\param	i_eyeSize		The size of the output texture to submit to the vr system.
+		///	\param	i_renderSize	The size the scene is rendered at, upscaled to \c i_eyeSize if smaller.
+		///	\param	i_iSamples		The number of samples of the render buffers, \c 0 without multisampling.
+		///	\param	i_bFoveated		\c true to render the centre at full resolution and the periphery at a lower one,
+		///							in two regions of a packed frame buffer.
+		///	\param	i_bKeepDepth		\c true to resolve the depth into a texture too, read by the occlusion culling.
+		///	\param	i_bMasked		\c true if the frame is rendered with the radial density mask, and reconstructed.
+		CEyeInfos(CRenderTargetPool* i_pool, const QSize& i_eyeSize, const QSize& i_renderSize, int i_iSamples, bool i_bFoveated, bool i_bKeepDepth = false, bool i_bMasked = false);
+
+		/// \brief	Descrutor: delete the frame buffers and give the render buffers and the textures back to the pool.
 		~CEyeInfos();
 
-		/// \brief	Initialize and prepare the scene rendering. Set and bind the buffers.
+		/// \brief	Initialize and prepare the scene rendering. Set, bind and clear the buffers.
+		/// \param	i_glState	The state cache used to set the viewport and the multisampling.
+		/// \param	i_mask		The radial density mask to apply after the clear, if any.
 		/// \note	Must be call just \e before scene rendering.
-		void SetSurface();
+		void SetSurface(CGLStateCache* i_glState, CRadialDensityMask* i_mask = nullptr);
+
+		/// \brief	Set the viewport of a region, before rendering it.
+		/// \param	i_region	The index of the region, lower than \c GetRegionCount().
+		/// \param	i_glState	The state cache used to set the viewport.
+		void SetRegion(int i_region, CGLStateCache* i_glState);
+
+		/// \brief	Accessor to the number of regions rendered: 2 with foveation, 1 otherwise.
+		int GetRegionCount() const { return m_bFoveated ? 2 : 1; }
+
+		/// \brief	Accessor to the viewport of a region in the frame buffer.
+		const QRect& GetRegion(int i_region) const { return m_regions[i_region]; }
+
+		/// \brief	Accessor to the projection matrix of a region.
+		const QMatrix4x4& GetRegionProjectionMatrix(int i_region) const { return m_regionProjections[i_region]; }
+
+		/// \brief	Determine if the eye is rendered with fixed foveation.
+		bool IsFoveated() const { return m_bFoveated; }
+
+		/// \brief	Accessor to the number of samples of the render buffers, \c 0 without multisampling.
+		int GetSamples() const { return m_iSamples; }
+
+		/// \brief	Accessor to the texture the packed regions are resolved into, \c 0 without foveation.
+		GLuint PackedTexture() const { return m_glPackedTexture; }
+
+		/// \brief	Accessor to the texture the frame with the holes of the mask is resolved into, \c 0 without mask.
+		GLuint MaskedTexture() const { return m_glMaskedTexture; }
 
 		/// \brief	Finish the rendering session by creating a texture.
 		///	\note	Must be call just \e after scene rendering.
 		void UnsetSurface();
 
 		/// \brief	Accessor to the texture generated.
-		/// \return	The ID of the texture of the frame.
+		/// \return	The ID of the texture of the frame, to submit to the vr system.
 		GLuint Texture();
 
+		/// \brief	Accessor to the texture of the scene at the render size, resolved, recombined or reconstructed.
+		GLuint RenderTexture() const { return m_glResolveTexture; }
+
+		/// \brief	Accessor to the resolved depth of the last frame, \c 0 unless the depth is kept.
+		GLuint DepthTexture() const { return m_glDepthTexture; }
+
+		/// \brief	Accessor to the size of the frame buffer, the size of the depth texture.
+		const QSize& GetTargetSize() const { return m_targetSize; }
+
 		/// \brief	Update the projection and the view matrix for this eye.
 		/// \param	i_view			The new view matrix for the eye display.
 		/// \param	i_projection	The new projection matrix for the eye display.
@@ -92,6 +1403,292 @@ class COpenVROpenGLWidget : public QOpenGLWidget, protected QOpenGLFunctions_4_5
 		/// \brief	Determine if the frame buffers were created.
 		/// \return \c true if the frame buffers were create correctly, \c false otherwise.
 		bool IsValid();
+
+		/// \brief	Accessor to the size of the submitted texture.
+		const QSize& GetSize() const { return m_size; }
+
+		/// \brief	Accessor to the size the scene is rendered at.
+		const QSize& GetRenderSize() const { return m_renderSize; }
+
+	protected:
+
+		/// \brief	Delete the frame buffers. Called by \c ReleaseContext().
+		void releaseObjects() override;
+
+		/// \brief	Create the frame buffers again in the new context. Called by \c RestoreContext().
+		void restoreObjects() override;
+	};
+
+
+	/// \class		CGpuTimer
+	/// \brief		Measure the GPU time of a sequence of commands, without waiting for the GPU.
+	///	\details	Timestamp queries are written in a ring of a few frames, and read back only once available: the
+	///				measured time is a few frames old.
+	class CGpuTimer : public CContextObjects
+	{
+		/// The number of frames the queries are kept before being read back.
+		static const int s_latency = 4;
+
+		/// The begin and end timestamp queries of each frame of the ring, bound to the context.
+		GLuint m_glQueries[s_latency][2];
+
+		/// The number of measures started since the queries were created.
+		unsigned int m_uiFrame;
+
+		/// The last measured time in milliseconds, -1 if none yet.
+		float m_fTime;
+
+	public:
+
+		/// \brief	Constructor: create the queries in the current context.
+		CGpuTimer();
+
+		/// \brief	Destructor: delete the queries.
+		~CGpuTimer();
+
+		/// \brief	Read back the oldest measure if available, and start a new one.
+		void Begin();
+
+		/// \brief	End the measure started by \c Begin().
+		void End();
+
+		/// \brief	Accessor to the last measured time in milliseconds, -1 if none yet.
+		float GetTime() const { return m_fTime; }
+
+	protected:
+
+		/// \brief	Delete the queries. Called by \c ReleaseContext().
+		void releaseObjects() override;
+
+		/// \brief	Create the queries again in the new context. Called by \c RestoreContext().
+		void restoreObjects() override;
+	};
+
+
+	/// \struct	SFramePass
+	/// \brief	A GPU pass run once per frame, before the eyes are rendered.
+	struct SFramePass
+	{
+		/// The name of the pass.
+		QString m_sName;
+
+		/// The function issuing the commands of the pass.
+		std::function<void()> m_function;
+
+		/// The timer measuring the GPU time of the pass.
+		CGpuTimer* m_pTimer = nullptr;
+
+		/// The frame and transient targets read by the pass.
+		QStringList m_inputs;
+
+		/// The frame and transient targets written by the pass, attached to \c m_glFrameBuffer.
+		QStringList m_outputs;
+
+		/// The frame buffer of the outputs, bound to the context. \c 0 without outputs.
+		GLuint m_glFrameBuffer = 0;
+
+		/// Determine if the pass reads a target written by a previous pass of the frame.
+		bool m_bBarrier = false;
+
+		/// The transient targets whose last use is this pass, invalidated after it.
+		QVector<int> m_releasedTargets;
+	};
+
+
+	/// \struct	STransientTarget
+	/// \brief	A render target only alive between the first and the last pass using it, during a frame.
+	struct STransientTarget
+	{
+		/// The name of the target.
+		QString m_sName;
+
+		/// The size in pixels of the target.
+		QSize m_size;
+
+		/// The sized internal format of the target.
+		GLenum m_glFormat = GL_RGBA8;
+
+		/// The index of the texture of the pool given to the target, -1 if the target isn't used.
+		int m_iTexture = -1;
+
+		/// The index of the first pass writing the target.
+		int m_iFirstPass = -1;
+	};
+
+
+	/// \struct	STransientTexture
+	/// \brief	A texture of the pool, shared by the transient targets whose lifetimes don't overlap.
+	struct STransientTexture
+	{
+		/// The size in pixels of the texture.
+		QSize m_size;
+
+		/// The sized internal format of the texture.
+		GLenum m_glFormat;
+
+		/// The texture.
+		GLuint m_glTexture;
+	};
+
+
+	/// \struct	SFrameUniforms
+	/// \brief	The uniforms of the frame shared by all the shaders, with the std140 layout of the \c FrameUniforms block.
+	struct SFrameUniforms
+	{
+		/// From the scene to the center of the head.
+		GLfloat m_sceneToHead[16];
+
+		/// From the scene to the clip space of each eye.
+		GLfloat m_eyeViewProjection[2][16];
+
+		/// The left, right, bottom and top tangents of the frustum enclosing both eyes.
+		GLfloat m_headTangents[4];
+
+		/// The near and far clip distances, then two unused values.
+		GLfloat m_clipPlanes[4];
+	};
+
+
+	/// \class		CEyeComputePass
+	/// \brief		A compute pass applied to the textures of both eyes before they are submitted.
+	///	\details	The program reads the eyes from the samplers \c source[2] and writes them into the images
+	///				\c destination[2]. Both eyes are processed by a single dispatch, one layer of work groups per eye,
+	///				so the program selects the eye with \c gl_WorkGroupID.z.
+	class CEyeComputePass : public CContextObjects
+	{
+		///	The compute program.
+		QOpenGLShaderProgram* m_program;
+
+		/// Determine if the program was built.
+		bool m_bValid;
+
+	public:
+
+		/// \brief	Constructor: build the compute program in the current context.
+		/// \param	i_source	The source of the compute shader, with a local size of \c EYE_COMPUTE_GROUP_SIZE.
+		CEyeComputePass(const char* i_source);
+
+		/// \brief	Destructor: delete the program.
+		~CEyeComputePass();
+
+		/// \brief	Determine if the program was built.
+		bool IsValid() const { return m_bValid; }
+
+		/// \brief	Create the pass upscaling and sharpening the eyes, with a \c sharpness uniform.
+		static CEyeComputePass* CreateUpscale();
+
+		/// \brief	Create the pass recombining the foveated regions, with \c centre, \c periphery, \c fovea and
+		///			\c blend uniforms.
+		static CEyeComputePass* CreateFoveationRecombine();
+
+		/// \brief	Create the pass filling the pixels skipped by the radial density mask, in place.
+		static CEyeComputePass* CreateDensityReconstruct();
+
+		/// \brief	Bind the program, so its uniforms can be set.
+		/// \param	i_glState	The state cache used to bind the program.
+		/// \return	The program.
+		QOpenGLShaderProgram* Bind(CGLStateCache* i_glState);
+
+		/// \brief	Run the bound program on both eyes.
+		/// \param	i_sources		The textures read by the program, one per eye.
+		/// \param	i_destinations	The textures written by the program, one per eye.
+		/// \param	i_size			The size of the destination textures.
+		/// \param	i_glState		The state cache used to bind the source textures.
+		void Dispatch(const GLuint i_sources[2], const GLuint i_destinations[2], const QSize& i_size, CGLStateCache* i_glState);
+	};
+
+
+	/// \class		CRadialDensityMask
+	/// \brief		Skip the shading of pixel quads in the periphery of the eyes, before the scene is rendered.
+	///	\details	After the clear, the depth of the masked quads is set to the near plane, so every fragment of the scene
+	///				fails the depth test there. The mask is a checkerboard of 2 x 2 pixels quads: none are masked in the
+	///				centre, one out of two in a middle ring, three out of four in the outer ring.
+	///				The skipped pixels are filled from their neighbours by the \c CEyeComputePass::CreateDensityReconstruct()
+	///				pass.
+	class CRadialDensityMask : public CContextObjects
+	{
+		///	The program writing the depth of the masked quads.
+		QOpenGLShaderProgram* m_program;
+
+		/// The location of the \c size uniform in the program.
+		int m_iSizeLocation;
+
+		/// The empty vertex array object used to draw the full screen triangle, bound to the context.
+		GLuint m_glVertArray;
+
+		/// Determine if the program was built.
+		bool m_bValid;
+
+	public:
+
+		/// \brief	Constructor: build the program in the current context.
+		CRadialDensityMask();
+
+		/// \brief	Destructor: delete the program and the vertex array.
+		~CRadialDensityMask();
+
+		/// \brief	Determine if the program was built.
+		bool IsValid() const { return m_bValid; }
+
+		/// \brief	Write the mask in the depth buffer of the bound frame buffer.
+		/// \param	i_size		The size of the frame buffer.
+		/// \param	i_glState	The state cache used to bind the program and the vertex array.
+		void Apply(const QSize& i_size, CGLStateCache* i_glState);
+
+	protected:
+
+		/// \brief	Delete the vertex array. Called by \c ReleaseContext().
+		void releaseObjects() override;
+
+		/// \brief	Create the vertex array again in the new context. Called by \c RestoreContext().
+		void restoreObjects() override;
+	};
+
+
+	/// \class		CFarFieldCompositor
+	/// \brief		Draw the far field, rendered once from the center of the head, behind the near field of an eye.
+	///	\details	A full screen triangle at the far plane reprojects the direction of each pixel of the eye in the far
+	///				field. The translation between the eyes and the center is ignored: beyond the split depth, the
+	///				disparity is below a pixel. The depth test keeps the masked pixels masked, and the depth is not written.
+	class CFarFieldCompositor : public CContextObjects
+	{
+		///	The program reprojecting the far field.
+		QOpenGLShaderProgram* m_program;
+
+		/// The location of the \c eyeToCenter uniform in the program.
+		int m_iMatrixLocation;
+
+		/// The empty vertex array object used to draw the full screen triangle, bound to the context.
+		GLuint m_glVertArray;
+
+		/// Determine if the program was built.
+		bool m_bValid;
+
+	public:
+
+		/// \brief	Constructor: build the program in the current context.
+		CFarFieldCompositor();
+
+		/// \brief	Destructor: delete the program and the vertex array.
+		~CFarFieldCompositor();
+
+		/// \brief	Determine if the program was built.
+		bool IsValid() const { return m_bValid; }
+
+		/// \brief	Draw the far field in the bound frame buffer.
+		/// \param	i_farField		The far field, rendered and resolved.
+		/// \param	i_view			The view matrix of the eye, relative to the head.
+		/// \param	i_projection	The projection matrix of the eye.
+		/// \param	i_glState		The state cache used to bind the program, the vertex array and the texture.
+		void Draw(CEyeInfos* i_farField, const QMatrix4x4& i_view, const QMatrix4x4& i_projection, CGLStateCache* i_glState);
+
+	protected:
+
+		/// \brief	Delete the vertex array. Called by \c ReleaseContext().
+		void releaseObjects() override;
+
+		/// \brief	Create the vertex array again in the new context. Called by \c RestoreContext().
+		void restoreObjects() override;
 	};
 
 
@@ -102,7 +1699,7 @@ class COpenVROpenGLWidget : public QOpenGLWidget, protected QOpenGLFunctions_4_5
 	///				This class let the developer to create and display a controller easily, just give the name of the
 	///				controller you want to use.
 	///				Then, just call \c Draw() to display it.
-	class CRenderModel : protected QOpenGLFunctions_4_5_Core
+	class CRenderModel : public CContextObjects
 	{
 		///	The program shader to display the controller.
 		QOpenGLShaderProgram* m_program;
@@ -119,6 +1716,9 @@ class COpenVROpenGLWidget : public QOpenGLWidget, protected QOpenGLFunctions_4_5
 		/// The controller's texture ID.
 		GLuint m_glTexture;
 
+		/// The location of the \c matrix uniform in the program.
+		int m_iMatrixLocation;
+
 		/// The total number of vertices of the 3D model.
 		GLsizei m_unVertexCount;
 
@@ -135,6 +1735,9 @@ class COpenVROpenGLWidget : public QOpenGLWidget, protected QOpenGLFunctions_4_5
 		///	\param	o_vrDiffuseTexture	The texture of the built 3D model.
 		bool InitModel(const vr::RenderModel_t & o_vrModel, const vr::RenderModel_TextureMap_t & o_vrDiffuseTexture);
 
+		/// \brief	Create the vertex array object from the vertex and the element buffers.
+		void createVertexArray();
+
 		/// \brief	Clean OpenGL buffers properly.
 		void Cleanup();
 
@@ -145,8 +1748,10 @@ class COpenVROpenGLWidget : public QOpenGLWidget, protected QOpenGLFunctions_4_5
 
 		/// \brief	Display the controller in the scene accordinf to the MVP matrix given as a parameter.
 		/// \param	i_mvpMatrix	The transform matrix of the controller according to the MVP transform model.
+		/// \param	i_glState	The state cache used to bind the program, the vertex array and the texture.
 		///	\note	MVP matrix can by retrieve with SDK methods.
-		void Draw(const QMatrix4x4& i_mvpMatrix);
+		///	\note	The states are left bound and \c GL_CULL_FACE enabled, so consecutive draws don't change them again.
+		void Draw(const QMatrix4x4& i_mvpMatrix, CGLStateCache* i_glState);
 
 		/// \brief	Accessor to the name of this instance of device.
 		/// \return The string containing the name of the device.
@@ -156,7 +1761,24 @@ class COpenVROpenGLWidget : public QOpenGLWidget, protected QOpenGLFunctions_4_5
 		/// \param	i_modelName		The name of the device to load and build.
 		/// \param	o_errorMeesage	And optional pointer to a string to get the error.
 		/// \return The instance of the controller named \c i_modelName.
+		/// \note	Blocks until the vr system has loaded the model and its texture.
 		static CRenderModel* LoadModel(const QString& i_modelName, QString* o_errorMeesage = nullptr);
+
+		/// \brief	Static method to load a 3D model without blocking. Call it until it returns \c true.
+		/// \param	i_modelName		The name of the device to load and build.
+		/// \param	io_vrModel		The model being loaded by the vr system. Must be \c nullptr at the first call.
+		///	\param	o_renderModel	The instance of the controller named \c i_modelName, \c nullptr in case of error.
+		/// \param	o_errorMessage	And optional pointer to a string to get the error.
+		/// \return	\c false while the vr system is loading the model or its texture, \c true once it is done.
+		static bool LoadModelAsync(const QString& i_modelName, vr::RenderModel_t** io_vrModel, CRenderModel** o_renderModel, QString* o_errorMessage = nullptr);
+
+	protected:
+
+		/// \brief	Delete the vertex array. Called by \c ReleaseContext().
+		void releaseObjects() override;
+
+		/// \brief	Create the vertex array again in the new context. Called by \c RestoreContext().
+		void restoreObjects() override;
 	};
 
 
@@ -167,11 +1789,104 @@ class COpenVROpenGLWidget : public QOpenGLWidget, protected QOpenGLFunctions_4_5
 		/// The controller model transform matrix.
 		QMatrix4x4 m_rmat4Pose;
 
-		/// The instance of 3D model to display.
-		CRenderModel *m_pRenderModel = nullptr;
-		
-		/// Determine if the controller must be displayed (not dplayed in cas of load error).
-		bool m_bShowController = false;
+		/// The instance of 3D model to display.
+		CRenderModel *m_pRenderModel = nullptr;
+		
+		/// Determine if the controller must be displayed (not dplayed in cas of load error).
+		bool m_bShowController = false;
+
+		/// The name of the 3D model being loaded, empty if none.
+		QString m_sPendingModelName;
+
+		/// The model being loaded by the vr system.
+		vr::RenderModel_t *m_pPendingModel = nullptr;
+	};
+
+
+	/// \class		CDebugMessageQueue
+	/// \brief		A lock-free queue to print the OpenGL debug messages from a background thread.
+	///	\details	\c Push() may be called from any thread, including the driver threads in asynchronous logging mode,
+	///				and never blocks nor allocates: the ID, source, type, severity and text of the message are copied
+	///				in a fixed size ring buffer, or dropped if the ring is full. A message whose source, type and ID have
+	///				already been seen is not queued again, it is only counted. The background thread formats and prints
+	///				the queued messages, and periodically prints how many times each message was repeated.
+	class CDebugMessageQueue
+	{
+		/// The number of messages the ring buffer can hold. Must be a power of two.
+		static const unsigned int s_capacity = 256;
+
+		/// The number of messages which can be deduplicated. Must be a power of two.
+		static const unsigned int s_idTableSize = 1024;
+
+		/// The size of the text of a queued message, longer texts are truncated.
+		static const int s_textSize = 256;
+
+		/// \struct	SSlot
+		/// \brief	A message of the ring buffer with its sequence number.
+		struct SSlot
+		{
+			/// The position the slot is ready for: equal to the enqueue position when free, to the position + 1 when filled.
+			std::atomic<unsigned int> m_uiSequence;
+
+			/// The queued message.
+			GLuint m_uiId;
+			QOpenGLDebugMessage::Source m_source;
+			QOpenGLDebugMessage::Type m_type;
+			QOpenGLDebugMessage::Severity m_severity;
+			char m_text[s_textSize];
+		};
+
+		/// The ring buffer.
+		SSlot m_slots[s_capacity];
+
+		/// The position of the next message to push.
+		std::atomic<unsigned int> m_uiEnqueuePos;
+
+		/// The position of the next message to print. Only used by the background thread.
+		unsigned int m_uiDequeuePos;
+
+		/// The keys of the messages seen since the last report, see \c key(), 0 means an empty entry.
+		std::atomic<quint64> m_seenKeys[s_idTableSize];
+
+		/// The number of times each seen message was repeated since it was last reported.
+		std::atomic<unsigned int> m_repeats[s_idTableSize];
+
+		/// The number of messages dropped because the ring buffer was full.
+		std::atomic<unsigned int> m_uiDropped;
+
+		/// Determine if the background thread must stop.
+		std::atomic<bool> m_bStop;
+
+		/// The background thread which prints the messages.
+		std::thread m_thread;
+
+		/// \brief	The loop of the background thread.
+		void run();
+
+		/// \brief	Print all the queued messages.
+		void drain();
+
+		/// \brief	Print and reset the repeat counters, the seen messages and the dropped messages counter.
+		void reportRepeats();
+
+		/// \brief	The key of a message in the seen messages table, never 0.
+		static quint64 key(const QOpenGLDebugMessage& i_message);
+
+		/// \brief	Register a message.
+		/// \return	\c true if it is the first time this message is seen, \c false if it was already seen or the table is full.
+		bool firstOccurrence(quint64 i_uiKey);
+
+	public:
+
+		/// \brief	Constructor: start the background thread.
+		CDebugMessageQueue();
+
+		/// \brief	Destructor: print the remaining messages and stop the background thread.
+		~CDebugMessageQueue();
+
+		/// \brief	Queue a message to print.
+		/// \param	i_message	The message to print.
+		void Push(const QOpenGLDebugMessage& i_message);
 	};
 
 
@@ -181,7 +1896,9 @@ public:
 	/// \brief	Define hand and left eye's IDs.
 	enum Eye {
 		Left,
-		Right
+		Right,
+		Center		///< The far field, rendered once for both eyes. Only given to \c Render() once enabled by
+					///< \c SetFarFieldSplitDepth(), it is disabled by default.
 	};
 
 	/// \brief	Construct the OpenVR OpenGL widget
@@ -200,7 +1917,7 @@ public:
 	virtual void UpdateRendering() = 0;
 
 	/// \brief	Method to render the scene.
-	/// \param	eye			Gives to which eye to render (left or right)
+	/// \param	eye			Gives to which eye to render (left or right, or center for the far field)
 	/// \param	view		The model view matrix.
 	/// \param	projection	The projection matrix.
 	/// \note	Must be implemented. Called in paintGL() method.
@@ -217,12 +1934,61 @@ public:
 	///	\details	Get the intputs state and process the event.
 	virtual void UpdateInputs() = 0;
 
+	/// \brief		Method to delete the scene objects which can't be shared between contexts (vertex arrays, frame buffers...).
+	/// \details	Called with the widget's context current, just before it is destroyed (when the widget is reparented or
+	///				moved to another top-level window).
+	///				With \c Qt::AA_ShareOpenGLContexts, the other resources survive and \c RestoreContextResources() is
+	///				called in the new context instead of \c InitializeRendering(). Otherwise, all the resources are lost
+	///				and \c InitializeRendering() is called again.
+	virtual void ReleaseContextResources() {}
+
+	/// \brief	Method to recreate the scene objects deleted in \c ReleaseContextResources(), in the new context.
+	virtual void RestoreContextResources() {}
+
+	/// \brief		Method to process a vr event, called in \c paintGL() before \c UpdateInputs().
+	/// \details	The widget drains the events of the vr system once per frame and handles those it needs first
+	///				(quit, device activation and roles, IPD, standby), then gives each one to this method.
+	/// \param		i_event	The event, only valid during the call.
+	virtual void ProcessVREvent(const vr::VREvent_t& i_event) { Q_UNUSED(i_event); }
+
 	/// \brief	Translate eyes positions by the vector (i_deltaX, i_deltaY, i_deltaZ).
 	/// \param	i_deltaX	Translation value on X axis.
 	/// \param	i_deltaY	Translation value on Y axis.
 	/// \param	i_deltaZ	Translation value on Z axis.
 	void TranslateEyes(float i_deltaX, float i_deltaY, float i_deltaZ);
 
+	/// \enum	StartupStage
+	/// \brief	Define the stages of the widget startup, in the order they are reached.
+	///	\details	The vr runtime is initialized in a background thread while the scene is initialized, so the mirror
+	///				view is displayed before the headset is ready.
+	enum StartupStage {
+		StartupNotStarted,		///< \c initializeGL() was not called yet.
+		StartupSceneReady,		///< \c InitializeRendering() was called, the mirror view is displayed.
+		StartupRuntimeReady,	///< The vr runtime and the compositor are initialized.
+		StartupEyesReady,		///< The eyes frame buffers are created, the frames are submitted to the headset.
+		StartupComplete,		///< The controllers 3D models are loaded.
+		StartupFailed,			///< The vr runtime or the eyes frame buffers couldn't be initialized.
+		StartupStageCount
+	};
+	Q_ENUM(StartupStage)
+
+	/// \enum	DebugLogging
+	/// \brief	Define how the OpenGL debug messages are logged.
+	enum DebugLogging {
+		DebugLoggingOff,			///< No message is logged.
+		DebugLoggingAsynchronous,	///< Messages are queued by the driver and printed by a background thread.
+		DebugLoggingSynchronous		///< Messages are printed by the OpenGL call which raised them (slow, for debugging only).
+	};
+
+	/// \brief		Set how the OpenGL debug messages are logged and which ones.
+	/// \details	May be called at any time, before or after \c initializeGL(). The severity filter is applied by the
+	///				driver, so filtered messages cost nothing. By default, debug builds log all the messages and
+	///				release builds only the high severity ones, both asynchronously.
+	///				The driver sends few messages if the context isn't created with \c QSurfaceFormat::DebugContext.
+	/// \param		i_mode			The logging mode.
+	/// \param		i_severities	The severities of the messages to log.
+	void SetDebugLogging(DebugLogging i_mode, QOpenGLDebugMessage::Severities i_severities = QOpenGLDebugMessage::AnySeverity);
+
 	/// \brief Reset eyes position to (0.0, 0.0, 0.0).
 	void ResetEyesPositions();
 
@@ -246,18 +2012,502 @@ public:
 	/// \return	A 4x4 matrix with the value of the transform matrix.
 	const QMatrix4x4& GetControllerPose(int i_hand);
 
+	/// \brief		Set whether the widget reconnects automatically to the vr system when it quits.
+	/// \details	When the compositor or the runtime quits, the widget releases the vr runtime but keeps all its
+	///				OpenGL resources (eyes frame buffers, controllers models) and the application's ones. With
+	///				automatic reconnection, it then tries to initialize the runtime again periodically.
+	///	\param		i_bAutoReconnect	\c true to reconnect automatically (default), \c false otherwise.
+	void SetAutoReconnect(bool i_bAutoReconnect);
+
+	/// \brief	Determine if the widget is connected to the vr system and submits frames to the headset.
+	bool IsVRConnected() const;
+
+	/// \brief	Display a Qt widget in the headset as a compositor overlay, updated only when the widget is repainted.
+	/// \param	i_widget			The widget to display, without parent. The panel takes its ownership.
+	/// \param	i_sKey				The key of the overlay, unique in the vr system.
+	/// \param	i_fWidthInMeters	The width of the overlay in meters.
+	/// \param	i_transform			The transform of the overlay in the standing tracking space.
+	/// \return	The panel, owned by the widget.
+	COverlayPanel* AddOverlayPanel(QWidget* i_widget, const QString& i_sKey, float i_fWidthInMeters, const QMatrix4x4& i_transform);
+
+	/// \brief	Remove and delete a panel created by \c AddOverlayPanel(), with its widget.
+	void RemoveOverlayPanel(COverlayPanel* i_panel);
+
+#ifdef QT_QUICK_LIB
+
+	/// \brief	Display a QML scene in the 3D scene, on a quad rendered only when the scene graph changes.
+	/// \param	i_qmlSource			The URL of the QML file to display.
+	/// \param	i_size				The size in pixels of the QML scene.
+	/// \param	i_fWidthInMeters	The width of the quad in meters, its height keeps the aspect ratio of \c i_size.
+	/// \param	i_transform			The transform of the quad in the scene (the space of \c Render()'s view matrix).
+	/// \return	The panel, owned by the widget, \c nullptr if the widget has no context yet.
+	/// \note	Call it from \c InitializeRendering() or later.
+	CQuickPanel* AddQuickPanel(const QUrl& i_qmlSource, const QSize& i_size, float i_fWidthInMeters, const QMatrix4x4& i_transform);
+
+	/// \brief	Remove and delete a panel created by \c AddQuickPanel().
+	void RemoveQuickPanel(CQuickPanel* i_panel);
+
+	/// \brief	Send the pointing ray of a controller to the closest Qt Quick panel it hits, as mouse events.
+	/// \param	i_hand		The considered hand ID.
+	/// \param	i_bPressed	\c true if the controller's select button is pressed.
+	/// \return	\c true if a panel was hit.
+	/// \note	Call it from \c UpdateInputs().
+	bool ProcessControllerRay(int i_hand, bool i_bPressed);
+
+#endif // QT_QUICK_LIB
+
+	/// \enum	InputActionType
+	/// \brief	Define how the state of an input action is read.
+	enum InputActionType {
+		InputDigital,	///< A button, read with \c GetDigitalActionData().
+		InputAnalog,	///< A trigger or a joystick, read with \c GetAnalogActionData().
+		InputPose		///< A pose, read with \c GetPoseActionDataForNextFrame().
+	};
+
+	/// \struct	SInputAction
+	/// \brief	An entry of the action table given to \c SetInputActions().
+	struct SInputAction
+	{
+		const char* m_sPath;		///< The path of the action in the manifest, e.g. "/actions/main/in/trigger".
+		InputActionType m_type;		///< How the state of the action is read.
+	};
+
+	/// \struct	SInputSnapshot
+	/// \brief	The state of all the actions of the table, captured once per frame before \c UpdateInputs().
+	///	\details	The states are stored by kind, indexed by the position of the action in the table; the entries of the
+	///				other kinds are unused. The bits of an action are at its position too.
+	struct SInputSnapshot
+	{
+		quint64 m_uiActive;					///< The actions bound to an active device.
+		quint64 m_uiDown;					///< The digital actions held down.
+		quint64 m_uiPressed;				///< The digital actions pressed since the previous frame.
+		quint64 m_uiReleased;				///< The digital actions released since the previous frame.
+		QVector<QVector3D> m_analog;		///< The values of the analog actions.
+		QVector<QVector3D> m_analogDelta;	///< The changes of the analog actions since the previous frame.
+		QVector<QMatrix4x4> m_poses;		///< The poses, in the tracking space of the headset.
+		QVector<QVector3D> m_velocities;	///< The linear velocities of the poses, in meters per second.
+
+		/// \brief	Determine if an action is bound to an active device.
+		bool IsActive(int i_iAction) const { return (m_uiActive >> i_iAction) & 1; }
+
+		/// \brief	Determine if a digital action is held down.
+		bool IsDown(int i_iAction) const { return (m_uiDown >> i_iAction) & 1; }
+
+		/// \brief	Determine if a digital action was pressed since the previous frame.
+		bool WasPressed(int i_iAction) const { return (m_uiPressed >> i_iAction) & 1; }
+
+		/// \brief	Determine if a digital action was released since the previous frame.
+		bool WasReleased(int i_iAction) const { return (m_uiReleased >> i_iAction) & 1; }
+	};
+
+	/// \brief		Set the table of the input actions the widget captures every frame.
+	/// \details	The handles are resolved once; each frame, the state of the active sets is updated in one call, then
+	///				all the actions are read into \c GetInputSnapshot() before \c UpdateInputs(), which only reads it.
+	///				The manifest must be set with \c vr::VRInput()->SetActionManifestPath() before.
+	/// \param		i_actionSets	The paths of the action sets, e.g. "/actions/main", all active.
+	/// \param		i_actions		The actions, at most 64. The application indexes the snapshot with their position.
+	/// \return		\c false if a path is unknown or there are too many actions.
+	/// \note		Call it from \c InitializeInputs().
+	bool SetInputActions(const QStringList& i_actionSets, const QVector<SInputAction>& i_actions);
+
+	/// \brief	Activate or deactivate an action set of the table, from the next frame.
+	/// \param	i_iSet		The position of the set in the table.
+	/// \param	i_bActive	\c true to read the actions of the set.
+	void SetInputActionSetActive(int i_iSet, bool i_bActive);
+
+	/// \brief	Accessor to the state of the actions of the table for this frame.
+	const SInputSnapshot& GetInputSnapshot() const { return m_inputSnapshot; }
+
+	/// \struct	SInputSample
+	/// \brief	A change of a digital or analog action, captured by the input sampling thread.
+	struct SInputSample
+	{
+		int m_iAction;					///< The position of the action in the table.
+		bool m_bActive;					///< Determine if the action is active, \c false once it is deactivated.
+		bool m_bState;					///< The state of a digital action.
+		QVector3D m_value;				///< The value of an analog action.
+		uint64_t m_ulVsyncFrame;		///< The vsync counter of the runtime when the change was captured.
+		float m_fSecondsSinceVsync;		///< The time since that vsync.
+	};
+
+	/// \brief		Sample the digital and analog actions of the table, and the vr events, in a background thread.
+	/// \details	The changes are queued with the time of the runtime and drained before \c UpdateInputs():
+	///				\c GetInputSamples() gives all the changes of the frame in order. The poses are still read once per frame.
+	/// \param		i_iHz	The sampling rate, e.g. 1000, \c 0 to sample once per frame in \c paintGL().
+	void SetInputSamplingRate(int i_iHz);
+
+	/// \brief	Accessor to the changes of the actions drained for this frame, in the order they were captured.
+	/// \return	The samples, empty without the input sampling thread.
+	const QVector<SInputSample>& GetInputSamples() const { return m_inputSamples; }
+
+	/// \brief		Lock the calls to \c vr::VRSystem() and \c vr::VRInput() against the input sampling thread.
+	/// \details	The widget holds it while it calls them, \c ProcessVREvent() and \c UpdateInputs() included: the
+	///				application takes it for its own calls elsewhere, e.g. \c auto lock = LockRuntime(); The lock is recursive.
+	std::unique_lock<std::recursive_mutex> LockRuntime() { return std::unique_lock<std::recursive_mutex>(m_runtimeMutex); }
+
+	/// \brief	Determine if the headset is in standby, e.g. because it isn't worn.
+	bool IsHeadsetInStandby() const { return m_bHeadsetStandby; }
+
+	/// \brief		Accessor to a string property of a tracked device, e.g. \c Prop_SerialNumber_String.
+	/// \details	The common properties are read when the device is activated and when the runtime changes them:
+	///				the tracking system, model, serial number, render model, manufacturer, firmware, hardware revision,
+	///				controller type, input profile and registered type. The others are not cached.
+	/// \return		The zero terminated UTF-8 string, valid until the next events are processed, \c nullptr if it isn't available.
+	const char* GetDeviceString(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop) const;
+
+	/// \brief		Accessor to an integer property of a tracked device: the class, the role hint, the first axes types
+	///				and the display MC type are cached.
+	/// \param		i_iDefault	The value returned if the property isn't available.
+	int32_t GetDeviceInt(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, int32_t i_iDefault = 0) const;
+
+	/// \brief		Accessor to a float property of a tracked device: the display frequency, the IPD, the battery, the
+	///				vsync to photons delay and the head to eye depth are cached.
+	/// \param		i_fDefault	The value returned if the property isn't available.
+	float GetDeviceFloat(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, float i_fDefault = 0.0f) const;
+
+	/// \brief		Accessor to a boolean property of a tracked device: the battery, charging, wireless, drift and
+	///				proximity sensor flags are cached.
+	/// \param		i_bDefault	The value returned if the property isn't available.
+	bool GetDeviceBool(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, bool i_bDefault = false) const;
+
+	/// \brief	Accessor to the current startup stage.
+	StartupStage GetStartupStage() const;
+
+	/// \brief	Accessor to the startup timeline.
+	/// \param	i_stage	The considered stage.
+	/// \return	The time in milliseconds between the call of \c initializeGL() and the stage, -1 if it was not reached.
+	qint64 GetStartupTime(StartupStage i_stage) const;
+
 	/// \brief	Accessor to the camere transforme matrix.
 	/// \return	A 4x4 matrix with the value of the camera transform matrix.
 	QMatrix4x4 GetCameraMatrix();
 
-#ifdef _DEBUG
+	/// \brief		Accessor to the OpenGL state cache used by the widget.
+	/// \details	The application can use it in \c Render() to skip the state changes already done by the widget
+	///				or by the previous eye.
+	/// \return		The state cache, \c nullptr before \c initializeGL().
+	CGLStateCache* GetGLStateCache();
+
+	/// \brief		Tell whether the application issues all its state changes through \c GetGLStateCache().
+	/// \details	By default, the cache is invalidated after each call to \c UpdateRendering() and \c Render(), as they
+	///				may change OpenGL states directly. When set, the cache is kept across them.
+	/// \param		i_bExclusive	\c true if the application only uses the state cache.
+	void SetGLStateCacheExclusive(bool i_bExclusive);
+
+	/// \brief		Render the eyes at a fraction of the recommended size, and upscale them before submitting.
+	/// \details	Below 1, the scene is rendered and resolved at the reduced size, then a compute pass upscales and
+	///				sharpens it into the full size texture submitted to the compositor. Applied at the next frame.
+	/// \param		i_fScale	The fraction of the recommended size, clamped to [0.5, 1]. 1 disables the upscaling.
+	void SetRenderScale(float i_fScale);
+
+	/// \brief	Accessor to the fraction of the recommended size the eyes are rendered at.
+	float GetRenderScale() const;
+
+	/// \brief	Set the strength of the sharpening applied by the upscale pass.
+	/// \param	i_fSharpness	From 0 (bilinear filtering only) to 1 (strongest).
+	void SetUpscaleSharpness(float i_fSharpness);
+
+	/// \brief		Render the centre of the eyes at full resolution and their periphery at a lower one.
+	/// \details	The lens distortion compresses the periphery of the eye textures, so it is rendered at half the
+	///				resolution. \c Render() is called once per region of each eye, with the projection of the region,
+	///				and \c GetCurrentViewportIndex() tells which region is being rendered. The regions are recombined
+	///				by a compute pass before the eyes are submitted. Applied at the next frame.
+	/// \param		i_bEnabled	\c true to enable the fixed foveation.
+	void SetFixedFoveation(bool i_bEnabled);
+
+	/// \brief	Determine if the fixed foveation is enabled.
+	bool IsFixedFoveationEnabled() const;
+
+	/// \brief	Accessor to the region of the eye being rendered, to be used in \c Render().
+	/// \return	0 for the centre, or the whole eye without foveation, 1 for the periphery.
+	int GetCurrentViewportIndex() const;
+
+	/// \brief		Skip the shading of a part of the pixels in the periphery of the eyes.
+	/// \details	Pixel quads are masked in a checkerboard pattern, denser toward the periphery, then filled from their
+	///				neighbours by a compute pass before the eyes are submitted. The shaders of the application don't
+	///				change, but the default depth test must be kept. Exclusive with the fixed foveation: enabling one
+	///				disables the other. Applied at the next frame.
+	/// \param		i_bEnabled	\c true to enable the radial density mask.
+	void SetRadialDensityMask(bool i_bEnabled);
+
+	/// \brief	Determine if the radial density mask is enabled.
+	bool IsRadialDensityMaskEnabled() const;
+
+	/// \brief		Render the distant geometry once for both eyes.
+	/// \details	Beyond the split depth, the stereo disparity is below a pixel: \c Render() is first called with the
+	///				\c Center eye, whose projection encloses both eyes and starts at the split depth, then with each
+	///				eye, whose projection ends at the split depth. The far field is drawn behind the near field of each
+	///				eye and of the mirror view. The application can skip the geometry out of the range of each pass.
+	///				Applied at the next frame.
+	/// \param		i_fDepth	The split depth in meters, 0 to render all the geometry for each eye, the default.
+	void SetFarFieldSplitDepth(float i_fDepth);
+
+	/// \brief	Accessor to the depth beyond which the geometry is rendered once for both eyes, 0 if disabled.
+	float GetFarFieldSplitDepth() const;
+
+	/// \struct	SCadenceStats
+	/// \brief	The statistics of the cadence of the submitted frames, from the timings of the compositor.
+	struct SCadenceStats
+	{
+		int m_iFrames;					///< The frames measured since the last reset.
+		int m_iOnCadence;				///< The frames presented for exactly 1 vsync, or 2 at half rate.
+		int m_iLate;					///< The frames presented for more vsyncs, the compositor reprojected them.
+		int m_iDropped;					///< The vsyncs the compositor had no frame for.
+		int m_iMispresented;			///< The frames presented at another vsync than the one they were predicted for.
+		float m_fMeanIntervalMs;		///< The mean time between two frames.
+		float m_fIntervalDeviationMs;	///< The standard deviation of the time between two frames.
+	};
+
+	/// \brief		Render at half the display rate, the compositor reprojecting every other vsync.
+	/// \details	The compositor returns from \c WaitGetPoses() every second vsync, so the frames come at a steady
+	///				cadence instead of being dropped at random when the scene is too heavy. When the eyes keep their
+	///				depth at the submitted size, the depth is submitted with the eyes for the reprojection. The
+	///				statistics are reset.
+	/// \param		i_bEnabled	\c true to render at half rate.
+	void SetHalfRate(bool i_bEnabled);
+
+	/// \brief	Determine if the widget renders at half the display rate.
+	bool IsHalfRate() const { return m_bHalfRate; }
+
+	/// \brief	Accessor to the statistics of the cadence since the last reset.
+	SCadenceStats GetCadenceStats() const;
+
+	/// \brief	Reset the statistics of the cadence.
+	void ResetCadenceStats();
+
+	/// \struct	SQualityLevel
+	/// \brief	A step of the quality ladder walked by the quality governor.
+	struct SQualityLevel
+	{
+		int m_iSamples;			///< The number of samples of the eyes, \c 0 without multisampling.
+		float m_fRenderScale;	///< The render scale, see \c SetRenderScale().
+		int m_iMirrorInterval;	///< The mirror view is rendered once every this many frames.
+		float m_fLodBias;		///< The level of detail bias the application should apply, higher is coarser.
+		quint32 m_uiEffects;	///< The effects the application should keep enabled, as flags of its own.
+	};
+
+	/// \brief		Set the steps of the quality ladder, from the best quality to the cheapest one.
+	/// \details	The widget applies the samples, the render scale and the mirror interval of the level; the
+	///				application reads the level of detail bias and the effects with \c GetQuality(). The governor
+	///				starts again from the first level, applied now if it is enabled or when it is. A default ladder is
+	///				used until this is called.
+	/// \param		i_ladder	The levels, at least one.
+	void SetQualityLadder(const QVector<SQualityLevel>& i_ladder);
+
+	/// \brief		Enable the quality governor.
+	/// \details	The GPU and CPU times of the frames, relative to the display interval, and the frames the compositor
+	///				dropped are watched over a sliding window of frames. The governor goes down the ladder when the
+	///				trend of the load predicts an overrun, or when frames are dropped, and goes back up after a while
+	///				with enough headroom. \c qualityLevelChanged() is emitted at each change. Once enabled, it applies
+	///				the current level and overrides the render scale set by \c SetRenderScale().
+	/// \param		i_bEnabled	\c true to enable the governor, \c false to stay at the current level.
+	void SetQualityGovernor(bool i_bEnabled);
+
+	/// \brief	Determine if the quality governor is enabled.
+	bool IsQualityGovernorEnabled() const { return m_bQualityGovernor; }
+
+	/// \brief	Accessor to the index of the current level in the quality ladder, 0 being the best quality.
+	int GetQualityLevel() const { return m_iQualityLevel; }
+
+	/// \brief	Accessor to the current level of the quality ladder.
+	const SQualityLevel& GetQuality() const { return m_qualityLadder[m_iQualityLevel]; }
+
+	/// \brief		Register a GPU pass run once per frame, after \c UpdateRendering() and before the eyes are rendered.
+	/// \details	Use it for the work shared by both eyes and the mirror view, like shadow maps, rendered in the
+	///				targets of \c AddFrameTarget(). The passes are run in their order of registration, with the widget's
+	///				context current, and the GPU time of each one is measured.
+	/// \param		i_sName	The name of the pass. A pass with the same name is replaced.
+	/// \param		i_pass	The function issuing the commands of the pass.
+	/// \note		The widget's context must be current, e.g. in \c InitializeRendering().
+	void AddFramePass(const QString& i_sName, const std::function<void()>& i_pass);
+
+	/// \brief		Register a GPU pass reading and writing named targets, run once per frame like the passes above.
+	/// \details	The passes are ordered so each one runs after the passes writing its inputs, and in their order of
+	///				registration otherwise. The outputs are attached to a frame buffer bound before the pass runs, the
+	///				colors in their order and the depth, with the viewport set to the size of the first output. The
+	///				memory barriers between a pass and the passes reading its outputs are inserted by the widget.
+	/// \param		i_sName		The name of the pass. A pass with the same name is replaced.
+	/// \param		i_pass		The function issuing the commands of the pass.
+	/// \param		i_inputs	The names of the frame targets and the transient targets read by the pass.
+	/// \param		i_outputs	The names of the frame targets and the transient targets written by the pass.
+	/// \note		The widget's context must be current, e.g. in \c InitializeRendering().
+	void AddFramePass(const QString& i_sName, const std::function<void()>& i_pass, const QStringList& i_inputs, const QStringList& i_outputs);
+
+	/// \brief	Unregister a pass added by \c AddFramePass().
+	/// \param	i_sName	The name of the pass.
+	/// \note	The widget's context must be current.
+	void RemoveFramePass(const QString& i_sName);
+
+	/// \brief	Accessor to the GPU time of a pass, measured a few frames ago.
+	/// \param	i_sName	The name of the pass.
+	/// \return	The time in milliseconds, -1 if unknown.
+	float GetFramePassTime(const QString& i_sName) const;
+
+	/// \brief		Create a render target shared by both eyes, written by the passes of \c AddFramePass().
+	/// \param		i_sName		The name of the target. A target with the same name is replaced.
+	/// \param		i_size		The size in pixels of the target.
+	/// \param		i_glFormat	The sized internal format of the target, e.g. \c GL_DEPTH_COMPONENT32F for a shadow map.
+	/// \param		i_bHistory	\c true to keep the target of the previous frame, e.g. for temporal effects.
+	/// \param		i_iLevels	The number of mipmap levels of the target.
+	/// \return		The target.
+	/// \note		The widget's context must be current, e.g. in \c InitializeRendering(). Without
+	///				\c Qt::AA_ShareOpenGLContexts, the targets are lost with the context and must be created again.
+	CFrameTarget* AddFrameTarget(const QString& i_sName, const QSize& i_size, GLenum i_glFormat, bool i_bHistory = false, int i_iLevels = 1);
+
+	/// \brief	Accessor to a target created by \c AddFrameTarget().
+	/// \param	i_sName	The name of the target.
+	/// \return	The target, \c nullptr if there is none with this name.
+	CFrameTarget* GetFrameTarget(const QString& i_sName) const;
+
+	/// \brief	Delete a target created by \c AddFrameTarget().
+	/// \param	i_sName	The name of the target.
+	/// \note	The widget's context must be current.
+	void RemoveFrameTarget(const QString& i_sName);
+
+	/// \brief		Declare a target only alive during the frame passes, from the first one writing it to the last one
+	///				reading it.
+	/// \details	The transient targets whose lifetimes don't overlap share the same texture, and their content is
+	///				invalidated after their last use. Read them in the passes with \c GetTransientTexture().
+	/// \param		i_sName		The name of the target. A target with the same name is replaced.
+	/// \param		i_size		The size in pixels of the target.
+	/// \param		i_glFormat	The sized internal format of the target.
+	void AddTransientTarget(const QString& i_sName, const QSize& i_size, GLenum i_glFormat);
+
+	/// \brief	Remove a target declared by \c AddTransientTarget().
+	/// \param	i_sName	The name of the target.
+	void RemoveTransientTarget(const QString& i_sName);
+
+	/// \brief	Accessor to the texture of a transient target, only meaningful in the passes using it.
+	/// \param	i_sName	The name of the target.
+	/// \return	The texture, \c 0 if no pass writes the target.
+	GLuint GetTransientTexture(const QString& i_sName) const;
+
+	/// \brief	Accessor to the memory in bytes of the textures of the transient targets.
+	qint64 GetTransientMemory() const;
+
+	/// \brief	Accessor to the memory in bytes saved by sharing the textures between the transient targets.
+	qint64 GetTransientMemorySaved() const;
+
+	/// \brief	The GLSL declaration of the \c FrameUniforms block, updated by the widget once per frame after
+	///			\c UpdateRendering(): the transform from the scene to the center of the head and to the clip space of
+	///			each eye, the tangents of the frustum enclosing both eyes, and the clip distances.
+	static QString FrameUniformsShaderInclude();
+
+	/// \brief		Accessor to the clustered lighting, created at the first call.
+	/// \details	The lights set in \c Lights() are assigned to the clusters by a frame pass, before the eyes are rendered.
+	/// \return		The clustered lighting module.
+	/// \note		The widget's context must be current, e.g. in \c InitializeRendering(). Without
+	///				\c Qt::AA_ShareOpenGLContexts, the module is lost with the context and must be created again.
+	CClusteredLighting* GetClusteredLighting();
+
+	/// \brief		Accessor to the occlusion culling, created at the first call.
+	/// \details	The objects set in \c Objects() are culled by a frame pass, before the eyes are rendered. The eyes
+	///				are created again at the next frame to keep their depth.
+	/// \return		The occlusion culling module.
+	/// \note		The widget's context must be current, e.g. in \c InitializeRendering(). Without
+	///				\c Qt::AA_ShareOpenGLContexts, the module is lost with the context and must be created again.
+	COcclusionCulling* GetOcclusionCulling();
+
+	/// \brief		Accessor to the scene renderer, created at the first call.
+	/// \details	The objects are uploaded and culled by a frame pass, before the eyes are rendered; call \c Draw() in
+	///				\c Render(). The eyes are created again at the next frame to keep their depth.
+	/// \return		The scene renderer.
+	/// \note		The widget's context must be current, e.g. in \c InitializeRendering(). Without
+	///				\c Qt::AA_ShareOpenGLContexts, the renderer is lost with the context and must be created again.
+	CSceneRenderer* GetSceneRenderer();
+
+	/// \brief		Accessor to the streaming buffer, created at the first call.
+	/// \details	Allocate the dynamic data of the frame in it from \c UpdateRendering() or \c Render(), instead of
+	///				\c glBufferSubData() calls. The size of each frame is set by \c SetStreamBufferFrameSize().
+	/// \return		The streaming buffer.
+	/// \note		The widget's context must be current. Without \c Qt::AA_ShareOpenGLContexts, the buffer is lost with the
+	///				context and created again at the next call.
+	CStreamBuffer* GetStreamBuffer();
+
+	/// \brief	Change the size of the region of each frame in the streaming buffer. The buffer is created again at the
+	///			next call of \c GetStreamBuffer().
+	/// \param	i_size	The size in bytes of a region.
+	/// \note	The widget's context must be current.
+	void SetStreamBufferFrameSize(GLsizeiptr i_size);
+
+	/// \enum	GpuMemoryCategory
+	/// \brief	Define the categories of the OpenGL memory allocated by the widget.
+	enum GpuMemoryCategory {
+		GpuMemoryEyes,			///< The render buffers and the textures of the eyes and of the far field, pooled or not.
+		GpuMemoryFrameTargets,	///< The textures of the frame targets and of the transient targets.
+		GpuMemoryRenderModels,	///< The buffers and the textures of the controllers models.
+		GpuMemoryPanels,		///< The textures of the overlay and Qt Quick panels.
+		GpuMemoryScene,			///< The buffers and the textures of the lighting, the culling, the scene renderer and the streaming buffer.
+		GpuMemoryPrograms,		///< The programs of the widget, estimated by the size of their binaries.
+		GpuMemoryCategoryCount
+	};
+
+	/// \brief	Accessor to the estimated memory in bytes the widget holds in a category, shared with the widgets in the
+	///			same share group.
+	/// \param	i_category	The category of memory.
+	qint64 GetGpuMemory(GpuMemoryCategory i_category) const;
+
+	/// \brief	Accessor to the estimated memory in bytes the widget holds in all the categories.
+	qint64 GetGpuMemoryTotal() const;
+
+	/// \brief	Accessor to the video memory in bytes the driver reports available, updated about once per second.
+	/// \return	The available memory, \c -1 without \c GL_NVX_gpu_memory_info nor \c GL_ATI_meminfo.
+	qint64 GetGpuMemoryAvailable() const { return m_iGpuMemoryAvailable; }
+
+	/// \brief		Set the memory the widget should hold at most, checked once per frame.
+	/// \details	\c gpuMemoryBudgetExceeded() is emitted when the total goes over the budget, or when the driver
+	///				reports less than 64 MB available.
+	/// \param		i_iBytes	The budget in bytes, \c 0 to disable the check.
+	void SetGpuMemoryBudget(qint64 i_iBytes);
+
+signals:
+
+	/// \brief	Signal emitted each time a startup stage is reached.
+	/// \param	i_stage	The reached stage.
+	void startupStageChanged(COpenVROpenGLWidget::StartupStage i_stage);
+
+	/// \brief	Signal emitted when the vr system can't be started.
+	/// \param	i_message	The error message.
+	void startupFailed(const QString& i_message);
+
+	/// \brief	Signal emitted when the compositor or the vr runtime quits.
+	void vrDisconnected();
+
+	/// \brief	Signal emitted when the widget submits frames to the headset again after a disconnection.
+	void vrReconnected();
+
+	/// \brief	Signal emitted once when the memory goes over the budget set by \c SetGpuMemoryBudget(), and again after
+	///			it went back under it.
+	/// \param	i_iUsed			The estimated memory the widget holds, see \c GetGpuMemoryTotal().
+	/// \param	i_iAvailable	The memory the driver reports available, \c -1 if unknown.
+	void gpuMemoryBudgetExceeded(qint64 i_iUsed, qint64 i_iAvailable);
+
+	/// \brief	Signal emitted when the quality governor changes the level, once the widget applied its settings.
+	/// \param	i_iLevel	The index of the new level, see \c GetQuality().
+	void qualityLevelChanged(int i_iLevel);
+
+public slots:
+
+	/// \brief	Try to reconnect to the vr system, without releasing any OpenGL resource.
+	/// \note	Does nothing if the widget is connected or a connection is in progress.
+	void Reconnect();
 
 protected slots:
 
 	/// \brief	Slot to pop-up the OpenGL error.
+	/// \note	Called from the driver threads in asynchronous logging mode.
 	void debugMessage(QOpenGLDebugMessage i_message);
 
-#endif
+private slots:
+
+	/// \brief	Slot called just before the widget's context is destroyed, with a direct connection.
+	///	\details	Release the objects bound to the context. The other resources are kept if they are shared with the
+	///				resource host, and deleted otherwise.
+	void onContextAboutToBeDestroyed();
+
+	/// \brief	Slot called in the GUI thread once the background initialization of the vr runtime is done.
+	///	\details	Create the eyes frame buffers and start loading the controllers, or report the error.
+	void onRuntimeInitialized();
 
 protected:
 
@@ -269,6 +2519,281 @@ protected:
 
 private:
 
+	/// \class		CGpuMemoryTracker
+	/// \brief		Record the estimated size of the OpenGL objects the widget allocates, by category.
+	///	\details	The objects are recorded with the share group of the current context, so the names of the groups
+	///				which don't share their resources don't collide. Only used in the GUI thread.
+	class CGpuMemoryTracker
+	{
+		/// \struct	SAllocation
+		/// \brief	A recorded object.
+		struct SAllocation
+		{
+			GpuMemoryCategory m_category;
+			qint64 m_iBytes;
+		};
+
+		/// The recorded objects of each share group, by type and name.
+		static QHash<QOpenGLContextGroup*, QHash<quint64, SAllocation>> s_allocations;
+
+		/// \brief	The key of an object in \c s_allocations.
+		static quint64 key(GLenum i_glType, GLuint i_glObject) { return (static_cast<quint64>(i_glType) << 32) | i_glObject; }
+
+	public:
+
+		/// \brief	Record an object, or change its size.
+		/// \param	i_category	The category of the object.
+		/// \param	i_glType	The type of the object: \c GL_BUFFER, \c GL_TEXTURE, \c GL_RENDERBUFFER or \c GL_PROGRAM.
+		/// \param	i_glObject	The name of the object.
+		/// \param	i_iBytes	The estimated size of the object.
+		/// \note	A context must be current.
+		static void Track(GpuMemoryCategory i_category, GLenum i_glType, GLuint i_glObject, qint64 i_iBytes);
+
+		/// \brief	Forget an object, before it is deleted. Does nothing if it isn't recorded.
+		static void Untrack(GLenum i_glType, GLuint i_glObject);
+
+		/// \brief	Record a linked program, in \c GpuMemoryPrograms.
+		static void TrackProgram(QOpenGLShaderProgram* i_program);
+
+		/// \brief	Forget a program, before it is deleted. Does nothing if it isn't linked.
+		static void UntrackProgram(QOpenGLShaderProgram* i_program);
+
+		/// \brief	The size in bytes of a texture or a render buffer.
+		/// \param	i_size		The size of the first level.
+		/// \param	i_glFormat	The internal format.
+		/// \param	i_iLevels	The number of mipmap levels.
+		/// \param	i_iSamples	The number of samples, \c 0 or \c 1 when not multisampled.
+		static qint64 TextureBytes(const QSize& i_size, GLenum i_glFormat, int i_iLevels = 1, int i_iSamples = 1);
+
+		/// \brief	The memory recorded in a share group.
+		/// \param	i_group		The share group.
+		/// \param	i_iCategory	The category, \c -1 for all of them.
+		static qint64 Total(QOpenGLContextGroup* i_group, int i_iCategory = -1);
+	};
+
+	/// \class		CSpscRing
+	/// \brief		A lock-free ring buffer between one producer thread and one consumer thread.
+	///	\details	Neither side blocks nor allocates: \c Push() fails when the ring is full.
+	/// \tparam		T				The type of the items, copied in and out.
+	/// \tparam		t_uiCapacity	The number of items the ring can hold. Must be a power of two.
+	template <typename T, unsigned int t_uiCapacity>
+	class CSpscRing
+	{
+		static_assert((t_uiCapacity & (t_uiCapacity - 1)) == 0, "The capacity must be a power of two");
+
+		/// The items.
+		T m_items[t_uiCapacity];
+
+		/// The position of the next item to push, only written by the producer.
+		std::atomic<unsigned int> m_uiHead;
+
+		/// The position of the next item to pop, only written by the consumer.
+		std::atomic<unsigned int> m_uiTail;
+
+	public:
+
+		/// \brief	Constructor: an empty ring.
+		CSpscRing() : m_uiHead(0), m_uiTail(0) {}
+
+		/// \brief	Queue an item, from the producer thread.
+		/// \return	\c false if the ring is full.
+		bool Push(const T& i_item)
+		{
+			const unsigned int head = m_uiHead.load(std::memory_order_relaxed);
+			if (head - m_uiTail.load(std::memory_order_acquire) == t_uiCapacity)
+				return false;
+			m_items[head & (t_uiCapacity - 1)] = i_item;
+			m_uiHead.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		/// \brief	Determine if the ring is full, from the producer thread: the next \c Push() fails.
+		bool IsFull() const { return m_uiHead.load(std::memory_order_relaxed) - m_uiTail.load(std::memory_order_acquire) == t_uiCapacity; }
+
+		/// \brief	Take the oldest item, from the consumer thread.
+		/// \return	\c false if the ring is empty.
+		bool Pop(T& o_item)
+		{
+			const unsigned int tail = m_uiTail.load(std::memory_order_relaxed);
+			if (tail == m_uiHead.load(std::memory_order_acquire))
+				return false;
+			o_item = m_items[tail & (t_uiCapacity - 1)];
+			m_uiTail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+	};
+
+	/// \class		CInputSampler
+	/// \brief		A background thread sampling the input actions and the vr events at a fixed rate.
+	///	\details	The thread owns the calls to \c UpdateActionState() and \c PollNextEvent() while it runs. The changes
+	///				of the digital and analog actions and the events are queued in rings drained by the GUI thread.
+	///				All its calls to the runtime are made under the lock of \c LockRuntime().
+	class CInputSampler
+	{
+		/// The changes of the actions.
+		CSpscRing<SInputSample, 4096> m_samples;
+
+		/// The vr events.
+		CSpscRing<vr::VREvent_t, 256> m_events;
+
+		/// The active action sets, copied from the widget and replaced under \c m_runtimeMutex.
+		QVector<vr::VRActiveActionSet_t> m_actionSets;
+
+		/// The lock of the widget, held during the calls to the runtime.
+		std::recursive_mutex& m_runtimeMutex;
+
+		/// The handles of the actions, copied from the widget.
+		QVector<vr::VRActionHandle_t> m_actionHandles;
+
+		/// The types of the actions, copied from the widget.
+		QVector<InputActionType> m_actionTypes;
+
+		/// The last queued activity of each action, only read by the thread.
+		QVector<bool> m_actives;
+
+		/// The last queued state of each digital action, only read by the thread.
+		QVector<bool> m_states;
+
+		/// The last queued value of each analog action, only read by the thread.
+		QVector<QVector3D> m_values;
+
+		/// The time between two samples, in microseconds.
+		std::atomic<int> m_iPeriod;
+
+		/// The number of times a sample could not be queued because the ring was full, it is queued again later.
+		std::atomic<unsigned int> m_uiDropped;
+
+		/// Determine if the thread must stop.
+		std::atomic<bool> m_bStop;
+
+		/// The sampling thread.
+		std::thread m_thread;
+
+		/// \brief	The loop of the sampling thread.
+		void run();
+
+	public:
+
+		/// \brief	Constructor: start the thread.
+		/// \param	i_actionSets	The action sets to update.
+		/// \param	i_actionHandles	The handles of the actions of the table.
+		/// \param	i_actionTypes	The types of the actions of the table.
+		/// \param	i_snapshot		The states the widget knows, only the changes from them are queued.
+		/// \param	i_runtimeMutex	The lock of the widget, held during the calls to the runtime.
+		/// \param	i_iHz			The sampling rate.
+		CInputSampler(const QVector<vr::VRActiveActionSet_t>& i_actionSets, const QVector<vr::VRActionHandle_t>& i_actionHandles,
+			const QVector<InputActionType>& i_actionTypes, const SInputSnapshot& i_snapshot, std::recursive_mutex& i_runtimeMutex, int i_iHz);
+
+		/// \brief	Destructor: stop the thread. The queued items are lost.
+		~CInputSampler();
+
+		/// \brief	Stop the thread, the queued items can still be taken.
+		void Stop();
+
+		/// \brief	Replace the action sets the thread updates, without losing its queues and states.
+		/// \param	i_actionSets	The active action sets.
+		void SetActionSets(const QVector<vr::VRActiveActionSet_t>& i_actionSets);
+
+		/// \brief	Change the sampling rate from the next sample.
+		/// \param	i_iHz	The sampling rate.
+		void SetRate(int i_iHz) { m_iPeriod = 1000000 / i_iHz; }
+
+		/// \brief	Take the oldest change of an action.
+		bool PopSample(SInputSample& o_sample) { return m_samples.Pop(o_sample); }
+
+		/// \brief	Take the oldest vr event.
+		bool PopEvent(vr::VREvent_t& o_event) { return m_events.Pop(o_event); }
+
+		/// \brief	Accessor to the number of times a sample waited because the GUI thread didn't drain the ring in time.
+		unsigned int GetDropped() const { return m_uiDropped; }
+	};
+
+	/// \class		CDevicePropertyCache
+	/// \brief		The common properties of the tracked devices, read in one pass when a device is activated.
+	///	\details	The strings of a device are packed one after the other in a fixed arena and the other values are
+	///				kept in fixed arrays, so the lookups neither call the runtime nor allocate. Only used in the GUI thread.
+	class CDevicePropertyCache
+	{
+	public:
+
+		/// The number of cached properties of each type.
+		static const int s_iStringCount = 10;
+		static const int s_iIntCount = 6;
+		static const int s_iFloatCount = 5;
+		static const int s_iBoolCount = 5;
+
+		/// The size of the arena the strings of a device are packed in.
+		static const int s_iStringArenaSize = 1024;
+
+	private:
+
+		/// The cached properties of each type, defined in the cpp.
+		static const vr::TrackedDeviceProperty s_stringProperties[s_iStringCount];
+		static const vr::TrackedDeviceProperty s_intProperties[s_iIntCount];
+		static const vr::TrackedDeviceProperty s_floatProperties[s_iFloatCount];
+		static const vr::TrackedDeviceProperty s_boolProperties[s_iBoolCount];
+
+		/// \struct	SDevice
+		/// \brief	The properties of a device.
+		struct SDevice
+		{
+			/// The offset of each string in the arena, \c s_uiMissing when the device doesn't have it.
+			quint16 m_stringOffsets[s_iStringCount];
+			char m_strings[s_iStringArenaSize];
+
+			int32_t m_ints[s_iIntCount];
+			float m_floats[s_iFloatCount];
+			bool m_bools[s_iBoolCount];
+
+			/// The values the device has, a bit by index, for each type.
+			quint32 m_uiValidInts;
+			quint32 m_uiValidFloats;
+			quint32 m_uiValidBools;
+		};
+
+		/// The offset of a string the device doesn't have.
+		static const quint16 s_uiMissing = 0xFFFF;
+
+		/// The properties of each device.
+		SDevice m_devices[vr::k_unMaxTrackedDeviceCount];
+
+		/// Determine if a string too long for the arena was already reported.
+		bool m_bOverflowReported;
+
+		/// \brief	The index of a property in its table, \c -1 if it isn't cached.
+		static int find(const vr::TrackedDeviceProperty* i_table, int i_iCount, vr::TrackedDeviceProperty i_prop);
+
+		/// \brief	Pack all the strings of a device in its arena.
+		void readStrings(vr::IVRSystem* i_vrSystem, vr::TrackedDeviceIndex_t i_device);
+
+		/// \brief	Read a value of a device, other than a string.
+		void readValue(vr::IVRSystem* i_vrSystem, vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop);
+
+	public:
+
+		/// \brief	Constructor: no device has properties.
+		CDevicePropertyCache();
+
+		/// \brief	Read all the cached properties of a device.
+		void Read(vr::IVRSystem* i_vrSystem, vr::TrackedDeviceIndex_t i_device);
+
+		/// \brief	Read again a property of a device which changed. Does nothing if the property isn't cached.
+		void Update(vr::IVRSystem* i_vrSystem, vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop);
+
+		/// \brief	Forget the properties of a deactivated device.
+		void Clear(vr::TrackedDeviceIndex_t i_device);
+
+		/// \brief	Accessor to a string property.
+		/// \return	The zero terminated string, \c nullptr if it isn't cached or the device doesn't have it.
+		const char* GetString(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop) const;
+
+		/// \brief	Accessors to the other properties.
+		/// \return	\c false if the property isn't cached or the device doesn't have it, then the value isn't changed.
+		bool GetInt(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, int32_t& o_iValue) const;
+		bool GetFloat(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, float& o_fValue) const;
+		bool GetBool(vr::TrackedDeviceIndex_t i_device, vr::TrackedDeviceProperty i_prop, bool& o_bValue) const;
+	};
+
 	/// The virtual reality system.
 	vr::IVRSystem* m_vrSystem;
 
@@ -281,14 +2806,254 @@ private:
 	/// The transformation matrix of the head mounted display.
 	QMatrix4x4 m_hmdPose;
 
-#ifdef _DEBUG
+	/// The size of the buffer the vr events are drained into.
+	static const int s_vrEventBufferSize = 64;
+
+	/// \struct	SVREventHandler
+	/// \brief	An entry of the table of the handlers of the vr events.
+	struct SVREventHandler
+	{
+		uint32_t m_uiEventType;
+		void (COpenVROpenGLWidget::*m_handler)(const vr::VREvent_t& i_event);
+	};
+
+	/// The handlers the widget registers for the vr events, defined with the handlers.
+	static const SVREventHandler s_vrEventHandlers[];
+
+	/// The buffer the vr events of the frame are drained into.
+	vr::VREvent_t m_vrEvents[s_vrEventBufferSize];
+
+	/// The vr events left in the input sampling thread when it stopped, handled before those of the next frame.
+	QVector<vr::VREvent_t> m_pendingVREvents;
+
+	/// Determine if the vr system asked the application to quit.
+	bool m_bVRQuit;
+
+	/// Determine if the compositor failed a request of this frame, e.g. because it crashed without quitting.
+	bool m_bCompositorLost;
+
+	/// Determine if the headset is in standby.
+	bool m_bHeadsetStandby;
+
+	/// The class of each tracked device, updated when a device is activated or deactivated.
+	vr::ETrackedDeviceClass m_deviceClasses[vr::k_unMaxTrackedDeviceCount];
+
+	/// The hand of each controller, \c -1 for the other devices, updated when the roles change.
+	int m_deviceHands[vr::k_unMaxTrackedDeviceCount];
+
+	/// The common properties of the tracked devices.
+	CDevicePropertyCache m_deviceProperties;
+
+	/// Determine if the transforms and the projections of the eyes must be read again, after an IPD change.
+	bool m_bEyeTransformsOutdated;
+
+	/// The tangents of the frustum enclosing both eyes, read with the projections of the eyes.
+	float m_eyesTangents[4];
+
 	/// The OpenGL logger.
 	QOpenGLDebugLogger *m_logger;
-#endif
+
+	/// The queue of the messages to print in asynchronous logging mode.
+	CDebugMessageQueue *m_debugQueue;
+
+	/// The OpenGL debug messages logging mode, also read by the driver threads in \c debugMessage().
+	std::atomic<DebugLogging> m_debugLogging;
+
+	/// The severities of the OpenGL debug messages to log.
+	QOpenGLDebugMessage::Severities m_debugSeverities;
+
+	/// The shadow copy of the OpenGL states.
+	CGLStateCache* m_glState;
+
+	/// Determine if the application only changes OpenGL states through \c m_glState.
+	bool m_bGLStateCacheExclusive;
 
 	///	The eyes informations: transformations, OpenGL buffers, display method...
 	CEyeInfos* m_eyeInfos[2];
 
+	/// The fraction of the recommended size the eyes are rendered at.
+	float m_fRenderScale;
+
+	/// The strength of the sharpening of the upscale pass.
+	float m_fUpscaleSharpness;
+
+	/// The pass upscaling the eyes, \c nullptr when they are rendered at full resolution.
+	CEyeComputePass* m_pUpscalePass;
+
+	/// Determine if the eyes are rendered with fixed foveation.
+	bool m_bFixedFoveation;
+
+	/// The pass recombining the foveated regions of the eyes, \c nullptr without foveation.
+	CEyeComputePass* m_pFoveationPass;
+
+	/// The region of the eye being rendered.
+	int m_iViewportIndex;
+
+	/// Determine if the radial density mask is enabled.
+	bool m_bRadialDensityMask;
+
+	/// The radial density mask applied to the eyes, \c nullptr when disabled.
+	CRadialDensityMask* m_pDensityMask;
+
+	/// The pass filling the pixels skipped by the radial density mask, \c nullptr when disabled.
+	CEyeComputePass* m_pDensityReconstructPass;
+
+	/// The depth beyond which the geometry is rendered once for both eyes, 0 if disabled.
+	float m_fFarFieldSplitDepth;
+
+	/// Determine if the compositor is asked to reproject every other vsync.
+	bool m_bHalfRate;
+
+	/// The statistics of the cadence, without the intervals.
+	SCadenceStats m_cadenceStats;
+
+	/// The index of the last frame measured by \c updateCadenceStats(), \c 0 if none.
+	uint32_t m_uiCadenceFrameIndex;
+
+	/// The system time in seconds of the last frame measured.
+	double m_dCadenceFrameTime;
+
+	/// The sum of the intervals between the measured frames, in seconds.
+	double m_dCadenceIntervalSum;
+
+	/// The sum of the squares of the intervals between the measured frames.
+	double m_dCadenceIntervalSquareSum;
+
+	/// The CPU time of the current frame starts once the poses are known.
+	QElapsedTimer m_frameCpuTimer;
+
+	/// The compositor frame indices of the CPU times below, in a ring.
+	QVector<uint32_t> m_frameCpuIndices;
+
+	/// The CPU times in milliseconds of the last frames, from the poses to the submission.
+	QVector<float> m_frameCpuTimes;
+
+	/// The display frequency of the headset in Hz.
+	float m_fDisplayFrequency;
+
+	/// The levels of the quality ladder, from the best quality.
+	QVector<SQualityLevel> m_qualityLadder;
+
+	/// The index of the current level.
+	int m_iQualityLevel;
+
+	/// Determine if the quality governor walks the ladder.
+	bool m_bQualityGovernor;
+
+	/// The loads of the last frames, their time over the display interval, in a ring.
+	QVector<float> m_frameLoads;
+
+	/// The number of loads in the ring since the last change of level.
+	int m_iFrameLoadCount;
+
+	/// The frames dropped by the compositor in the window, as many entries as \c m_frameLoads.
+	QVector<int> m_frameDrops;
+
+	/// The frames since the governor went down the ladder.
+	int m_iFramesSinceDegrade;
+
+	/// The number of samples of the eyes.
+	int m_iEyeSamples;
+
+	/// The mirror view is rendered once every this many frames.
+	int m_iMirrorInterval;
+
+	/// The frames counted for the mirror interval.
+	unsigned int m_uiMirrorFrame;
+
+	/// The action sets of the input table.
+	QVector<vr::VRActionSetHandle_t> m_inputActionSets;
+
+	/// The sets updated each frame, rebuilt when a set is activated or deactivated.
+	QVector<vr::VRActiveActionSet_t> m_activeActionSets;
+
+	/// The handles of the actions of the input table.
+	QVector<vr::VRActionHandle_t> m_inputActionHandles;
+
+	/// The types of the actions of the input table.
+	QVector<InputActionType> m_inputActionTypes;
+
+	/// The state of the actions for this frame.
+	SInputSnapshot m_inputSnapshot;
+
+	/// The rate of the input sampling thread, \c 0 to sample in \c paintGL().
+	int m_iInputSamplingRate;
+
+	/// The input sampling thread, \c nullptr when disabled or disconnected.
+	CInputSampler* m_pInputSampler;
+
+	/// Serialize the calls to the runtime of the GUI thread, the application included, with those of the input sampling thread.
+	std::recursive_mutex m_runtimeMutex;
+
+	/// The changes of the actions drained for this frame, its capacity kept from frame to frame.
+	QVector<SInputSample> m_inputSamples;
+
+	/// The pool of the render buffers and the textures of the eyes, kept with the shared resources.
+	CRenderTargetPool* m_pRenderTargetPool;
+
+	/// The far field rendered from the center of the head, \c nullptr when disabled.
+	CEyeInfos* m_pFarField;
+
+	/// The compositor drawing the far field behind the eyes, \c nullptr when disabled.
+	CFarFieldCompositor* m_pFarFieldCompositor;
+
+	/// The GPU passes run once per frame, in their order of registration.
+	QVector<SFramePass> m_framePasses;
+
+	/// The render targets shared by both eyes.
+	QVector<CFrameTarget*> m_frameTargets;
+
+	/// The render targets only alive during the frame passes.
+	QVector<STransientTarget> m_transientTargets;
+
+	/// The textures shared by the transient targets.
+	QVector<STransientTexture> m_transientTextures;
+
+	/// Determine if the passes or the transient targets changed since the passes were ordered.
+	bool m_bFramePassesDirty;
+
+	/// The memory in bytes the transient targets would need without sharing the textures.
+	qint64 m_iTransientMemoryNeeded;
+
+	/// The left, right, bottom and top tangents of the frustum enclosing both eyes, from the center of the head.
+	float m_headTangents[4];
+
+	/// The uniform buffer of the \c FrameUniforms block.
+	GLuint m_glFrameUniforms;
+
+	/// The transform from the scene to the clip space of each eye, as in the \c FrameUniforms block.
+	QMatrix4x4 m_eyeViewProjections[2];
+
+	/// The clustered lighting module, \c nullptr until requested.
+	CClusteredLighting* m_pClusteredLighting;
+
+	/// The occlusion culling module, \c nullptr until requested.
+	COcclusionCulling* m_pOcclusionCulling;
+
+	/// The scene renderer, \c nullptr until requested.
+	CSceneRenderer* m_pSceneRenderer;
+
+	/// The streaming buffer, \c nullptr until requested.
+	CStreamBuffer* m_pStreamBuffer;
+
+	/// The size in bytes of a region of the streaming buffer.
+	GLsizeiptr m_streamBufferFrameSize;
+
+	/// The memory budget in bytes, \c 0 when not checked.
+	qint64 m_iGpuMemoryBudget;
+
+	/// The video memory in bytes the driver reported available, \c -1 if unknown.
+	qint64 m_iGpuMemoryAvailable;
+
+	/// The frames until the driver is queried again.
+	int m_iGpuMemoryQueryCountdown;
+
+	/// Determine if \c gpuMemoryBudgetExceeded() was emitted and the memory didn't go back under the budget.
+	bool m_bGpuMemoryOverBudget;
+
+	/// Determine if the eyes must be recreated at the next frame, after a render scale change.
+	bool m_bEyesOutdated;
+
 	/// The controllers informations: transformations, 3D models; display method...
 	SControllerInfos m_controllers[2];
 
@@ -298,12 +3063,192 @@ private:
 	/// Eyes rotation angles: yaw, pitch, roll
 	QVector3D m_cameraRotations;
 
-	/// Initialize the VR system
-	bool InitializeVR();
+	/// The projection matrix of the mirror view until the eyes are created.
+	QMatrix4x4 m_mirrorProjection;
+
+	/// The Qt widgets displayed as compositor overlays.
+	QVector<COverlayPanel*> m_overlayPanels;
+
+#ifdef QT_QUICK_LIB
+	/// The Qt Quick scenes displayed in the 3D scene.
+	QVector<CQuickPanel*> m_quickPanels;
+#endif
+
+	/// The persistent context keeping the OpenGL resources alive, \c nullptr if contexts aren't shared.
+	CGLResourceHost* m_pResourceHost;
+
+	/// Determine if the widget's context was destroyed, so \c initializeGL() must restore it.
+	bool m_bContextLost;
+
+	/// Determine if the vr runtime was initialized while the widget had no context.
+	bool m_bVRSetupPending;
+
+	/// The thread initializing the vr runtime.
+	std::thread m_vrInitThread;
+
+	/// The vr system initialized by \c m_vrInitThread, not used before \c onRuntimeInitialized().
+	vr::IVRSystem* m_pendingVrSystem;
+
+	/// The error of the vr runtime initialization, empty on success.
+	QString m_vrInitError;
+
+	/// The current startup stage.
+	StartupStage m_startupStage;
+
+	/// Determine if the widget reconnects automatically when the vr system quits.
+	bool m_bAutoReconnect;
+
+	/// Determine if the vr system was lost after the startup and is being reconnected.
+	bool m_bReconnecting;
+
+	/// The time when each startup stage was reached, -1 if not reached.
+	qint64 m_startupTimeline[StartupStageCount];
+
+	/// The timer started in \c initializeGL() to measure the startup timeline.
+	QElapsedTimer m_startupTimer;
+
+	/// Start the initialization of the VR system in a background thread.
+	void InitializeVR();
+
+	/// \brief	Initialize the vr runtime and the compositor. Called in the background thread.
+	/// \param	o_vrSystem	The initialized vr system, \c nullptr on failure.
+	/// \return	The error message, empty on success.
+	static QString initializeVRRuntime(vr::IVRSystem** o_vrSystem);
+
+	/// \brief	Record that a startup stage is reached and emit \c startupStageChanged().
+	void setStartupStage(StartupStage i_stage);
+
+	/// \brief	Create the eyes and start loading the controllers once the vr runtime is initialized.
+	/// \note	The widget's context must be current.
+	void setupVRRendering();
+
+	/// \brief	Recreate or restore the resources after the widget's context was destroyed.
+	/// \note	The widget's context must be current.
+	void restoreContext();
+
+	/// \brief	The helpers of the widget which live across its contexts, released and restored together.
+	QVector<CContextObjects*> contextObjects() const;
+
+	/// \brief	Make current the widget's context if it exists, the resource host context otherwise.
+	/// \return	\c true if a context is current.
+	bool makeResourcesCurrent();
+
+	/// \brief	Release the context made current by \c makeResourcesCurrent().
+	void doneResourcesCurrent();
+
+	/// Load a step of the pending controllers 3D models, without blocking.
+	void pollControllersModels();
+
+	/// \brief	Drain the pending vr system events into \c m_vrEvents and dispatch them to the handlers of the widget,
+	///			then to \c ProcessVREvent().
+	/// \return	\c false if the vr system quits, \c true otherwise.
+	bool processVREvents();
+
+	/// \brief	Handle \c VREvent_Quit.
+	void handleVRQuit(const vr::VREvent_t& i_event);
+
+	/// \brief	Handle \c VREvent_TrackedDeviceActivated, \c VREvent_TrackedDeviceDeactivated and
+	///			\c VREvent_TrackedDeviceRoleChanged: update the device cache and load the model of a new controller.
+	void handleVRDeviceChanged(const vr::VREvent_t& i_event);
+
+	/// \brief	Handle \c VREvent_IpdChanged: read the transforms of the eyes again.
+	void handleVRIpdChanged(const vr::VREvent_t& i_event);
+
+	/// \brief	Handle \c VREvent_EnterStandbyMode and \c VREvent_LeaveStandbyMode.
+	void handleVRStandby(const vr::VREvent_t& i_event);
+
+	/// \brief	Handle \c VREvent_PropertyChanged: read the property again if it is cached.
+	void handleVRPropertyChanged(const vr::VREvent_t& i_event);
+
+	/// \brief	Read the class, the hand and the properties of a tracked device into the device caches.
+	void updateDeviceCache(vr::TrackedDeviceIndex_t i_device);
+
+	/// \brief	Load the model of a controller, unless it is already loaded.
+	void queueControllerModel(vr::TrackedDeviceIndex_t i_device);
+
+	/// \brief	Read the transforms and the projections of the eyes into them and the far field, and the frustum
+	///			enclosing them.
+	void updateEyeTransforms();
+
+	/// Release the vr runtime but keep all the OpenGL resources, then reconnect if enabled.
+	void disconnectVR();
+
+	/// Create the OpenGL logger if needed and apply the logging mode and the severity filter.
+	/// \note	The widget's context must be current.
+	void applyDebugLogging();
 
 	/// Initialize the left and right eyes informations.
 	bool InitializeEyesRendering();
 
+	/// \brief	Run the compute passes on the rendered eyes, before they are submitted.
+	void postProcessEyes();
+
+	/// \brief	Submit the eyes to the compositor, with their depth at half rate when it is available.
+	void submitEyes();
+
+	/// \brief	Get the timing of the previous frame from the compositor, and give it to the statistics and the governor.
+	void updateFrameTiming();
+
+	/// \brief	Add the timing of the previous frame to the statistics of the cadence.
+	/// \param	i_timing	The timing of the previous frame.
+	void updateCadenceStats(const vr::Compositor_FrameTiming& i_timing);
+
+	/// \brief	Add the load of the previous frame to the window of the governor, and change the level if needed.
+	/// \param	i_timing	The timing of the previous frame.
+	void updateQualityGovernor(const vr::Compositor_FrameTiming& i_timing);
+
+	/// \brief	Read the state of all the actions of the input table into \c m_inputSnapshot.
+	void updateInputSnapshot();
+
+	/// \brief	Start the input sampling thread, if it is enabled and the vr system and the action table are ready.
+	void startInputSampler();
+
+	/// \brief	Stop the input sampling thread, before the vr system is shut down or the action table changes.
+	///			The vr events it polled are kept for the next frame.
+	void stopInputSampler();
+
+	/// \brief	Call the handlers of a vr event.
+	void dispatchVREvent(const vr::VREvent_t& i_event);
+
+	/// \brief	Apply the settings of a level of the quality ladder and start a new window.
+	/// \param	i_iLevel	The index of the level.
+	void applyQualityLevel(int i_iLevel);
+
+	/// \brief	Update the frame uniforms, swap the frame targets with history and run the frame passes.
+	void runFramePasses();
+
+	/// \brief	Fill and bind the uniform buffer of the \c FrameUniforms block.
+	void updateFrameUniforms();
+
+	/// \brief	Order the frame passes, give the textures of the pool to the transient targets, and create the frame
+	///			buffers of the passes.
+	void compileFramePasses();
+
+	/// \brief	Attach the outputs of a pass to its frame buffer and bind it. Does nothing if none of them exists.
+	/// \param	i_iPass	The index of the pass in \c m_framePasses.
+	void bindFramePassOutputs(int i_iPass);
+
+	/// \brief	Accessor to the index of a transient target in \c m_transientTargets, -1 if there is none.
+	int findTransientTarget(const QString& i_sName) const;
+
+	/// \brief	Accessor to the texture of a frame target or a transient target.
+	/// \param	i_sName		The name of the target.
+	/// \param	o_size		The size of the target.
+	/// \param	o_glFormat	The format of the target.
+	/// \return	The texture, \c 0 if there is no such target.
+	GLuint getFramePassTarget(const QString& i_sName, QSize& o_size, GLenum& o_glFormat) const;
+
+	/// \brief	Delete the textures of the transient targets.
+	void destroyTransientTextures();
+
+	/// \brief	Accessor to the depth the eyes rendered during the previous frame, for the culling.
+	/// \param	o_depthTextures	The depth texture of each eye, \c 0 if the eyes don't keep their depth.
+	/// \param	o_size			The size of the depth textures.
+	void getEyesDepth(GLuint o_depthTextures[2], QSize& o_size) const;
+
+	/// \brief	Query the memory the driver reports available from time to time, and check the budget.
+	void checkGpuMemory();
+
 	/// Initialisez the left and right controllers models.
 	bool InitializeControllers();
 
@@ -314,8 +3259,9 @@ private:
 	void ShutDownVR();
 
 	/// \brief	Render the scene for the eye given as parameter.
-	///	\param	i_eye	The considered eye ID.
-	void renderEye(Eye i_eye);
+	///	\param	i_eye		The considered eye ID.
+	///	\param	i_bMirror	\c true to render the mirror view, with the projection of the whole eye.
+	void renderEye(Eye i_eye, bool i_bMirror = false);
 
 	/// Update the positions and the transformations of the eyes, the controllers, etc...
 	void UpdatePositions();
@@ -325,17 +3271,16 @@ private:
 	/// \return The converted \c QMatrix4x4 matrix.
 	QMatrix4x4 vrMatrixToQt(const vr::HmdMatrix34_t &i_mat);
 
+	/// \brief	Convert a matrix from a \c QMatrix4x4 format to a \c HmdMatrix34_t matrix format.
+	/// \param	i_mat	The matrix to convert, its last row is ignored.
+	/// \return The converted \c HmdMatrix34_t matrix.
+	static vr::HmdMatrix34_t qtMatrixToVr(const QMatrix4x4 &i_mat);
+
 	/// \brief	Convert a matrix from a \c HmdMatrix44_t format to a \c QMatrix4x4 matrix format.
 	/// \param	i_mat	The matrix to convert.
 	/// \return The converted \c QMatrix4x4 matrix.
 	QMatrix4x4 vrMatrixToQt(const vr::HmdMatrix44_t &mat);
 
-	/// \brief	Retrieve a string value from a device property.
-	/// \param	i_device	The index of the device we want to get the property.
-	///	\param	i_prop		The property ID to retrieve.
-	///	\param	o_error		The returned error in case of failure.
-	/// \return The property value as a string.  
-	QString getTrackedDeviceString(vr::TrackedDeviceIndex_t i_device,	vr::TrackedDeviceProperty i_prop,	vr::TrackedPropertyError *o_error = nullptr);
 };
 
 #endif // __OPENVROPENGLWIDGET_H__